@@ -0,0 +1,42 @@
+// Copyright (c) 2020 smarsufan. All Rights Reserved.
+
+#pragma once
+#include <chrono>
+#include <cstdio>
+#include <string>
+
+namespace bench {
+
+inline double Now() {
+  using namespace std::chrono;
+  return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+// Read the whole file at path, or an empty string.
+inline std::string Load(const char *path) {
+  std::string src;
+  FILE *fp = fopen(path, "rb");
+  if (!fp) {
+    return src;
+  }
+  char buf[4096];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) {
+    src.append(buf, n);
+  }
+  fclose(fp);
+  return src;
+}
+
+// Repeat src until it is at least bytes long.
+inline std::string Repeat(const std::string &src, size_t bytes) {
+  std::string out;
+  out.reserve(bytes + src.size());
+  while (out.size() < bytes) {
+    out += src;
+    out += '\n';
+  }
+  return out;
+}
+
+}  // namespace bench
@@ -0,0 +1,57 @@
+// Copyright (c) 2020 smarsufan. All Rights Reserved.
+
+// Rows per second of Batch over columnar input, from one thread up to
+// every core.
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "api.h"
+#include "bench.h"
+
+int main(int argv, char *args[]) {
+  if (argv < 2) {
+    fprintf(stderr, "Usage: %s <input.sm> [rows]\n", args[0]);
+    return -1;
+  }
+
+  auto reader = smcc::OpenReader(args[1]);
+  if (!reader) {
+    fprintf(stderr, "can not open %s\n", args[1]);
+    return -1;
+  }
+  smcc::Program program(reader.get());
+
+  size_t rows = argv > 2 ? atol(args[2]) : 1000000;
+  std::vector<double> pos(rows), size(rows, 16000.), out(rows);
+  for (size_t row = 0; row < rows; ++row) {
+    pos[row] = row % 16000;
+  }
+  const double *columns[] = {pos.data(), size.data()};
+
+  int cores = std::max(1u, std::thread::hardware_concurrency());
+  std::vector<int> counts;
+  for (int threads = 1; threads < cores; threads *= 2) {
+    counts.push_back(threads);
+  }
+  counts.push_back(cores);
+
+  double base = 0;
+  for (int threads : counts) {
+    smcc::Batch batch(&program, threads);
+    batch.run("main", columns, rows, out.data());  // warm up
+    double t0 = bench::Now();
+    batch.run("main", columns, rows, out.data());
+    double t1 = bench::Now();
+    double rate = rows / (t1 - t0);
+    if (threads == 1) {
+      base = rate;
+    }
+    printf("%3d threads: %.2f Mrows/s (%.1fx)\n", threads, rate / 1e6,
+           rate / base);
+  }
+  return out[0] == 12345.6789;  // keep out alive
+}
@@ -0,0 +1,63 @@
+// Copyright (c) 2020 smarsufan. All Rights Reserved.
+
+// Calls per second, and latency per call, of a script function through
+// the tree walker (eval), the bytecode interpreter (call) and the JIT.
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "api.h"
+#include "bench.h"
+
+int main(int argv, char *args[]) {
+  if (argv < 2) {
+    fprintf(stderr, "Usage: %s <input.sm> [func] [args...]\n", args[0]);
+    return -1;
+  }
+
+  auto reader = smcc::OpenReader(args[1]);
+  if (!reader) {
+    fprintf(stderr, "can not open %s\n", args[1]);
+    return -1;
+  }
+  smcc::Program program(reader.get());
+  smcc::Context ctx(&program);
+  smcc::Jit jit(program);
+
+  std::string func = argv > 2 ? args[2] : "main";
+  std::vector<double> values;
+  for (int i = 3; i < argv; ++i) {
+    values.push_back(atof(args[i]));
+  }
+  if (argv <= 3) {
+    values = {0., 16000.};
+  }
+
+  const int n = 200000;
+  double sum = 0;
+
+  double t0 = bench::Now();
+  for (int i = 0; i < n; ++i) {
+    sum += ctx.eval(func, values);
+  }
+  double t1 = bench::Now();
+  for (int i = 0; i < n; ++i) {
+    sum += ctx.call(func, values);
+  }
+  double t2 = bench::Now();
+  smcc::FunctionExpr *fn = program.function(func);
+  for (int i = 0; i < n; ++i) {
+    sum += jit.call(fn, values.data(), values.size());
+  }
+  double t3 = bench::Now();
+
+  printf("eval: %.2f Mcalls/s, %.0f ns/call\n", n / (t1 - t0) / 1e6,
+         (t1 - t0) / n * 1e9);
+  printf("call: %.2f Mcalls/s, %.0f ns/call (%.1fx)\n", n / (t2 - t1) / 1e6,
+         (t2 - t1) / n * 1e9, (t1 - t0) / (t2 - t1));
+  printf("jit:  %.2f Mcalls/s, %.0f ns/call (%.1fx)\n", n / (t3 - t2) / 1e6,
+         (t3 - t2) / n * 1e9, (t1 - t0) / (t3 - t2));
+  return sum == 0;  // keep sum alive
+}
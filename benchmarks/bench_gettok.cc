@@ -0,0 +1,67 @@
+// Copyright (c) 2020 smarsufan. All Rights Reserved.
+
+// Tokens per second of AST::gettok() on a streaming reader, the
+// contiguous-buffer lexer, and up-front Tokenize() on 1 and N threads.
+
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+#include "api.h"
+#include "bench.h"
+
+static long Lex(smcc::Reader *reader) {
+  smcc::AST ast(reader);
+  long n = 0;
+  while (ast.gettok() != tok_eof) {
+    ++n;
+  }
+  return n;
+}
+
+int main(int argv, char *args[]) {
+  if (argv < 2) {
+    fprintf(stderr, "Usage: %s <input.sm> [MiB]\n", args[0]);
+    return -1;
+  }
+
+  std::string src = bench::Load(args[1]);
+  if (src.empty()) {
+    fprintf(stderr, "can not open %s\n", args[1]);
+    return -1;
+  }
+  size_t mib = argv > 2 ? atoi(args[2]) : 32;
+  src = bench::Repeat(src, mib << 20);
+
+  FILE *fp = fmemopen(&src[0], src.size(), "r");
+  smcc::ReaderStdio stream(fp);
+  double t0 = bench::Now();
+  long n_stream = Lex(&stream);
+  double t1 = bench::Now();
+  fclose(fp);
+
+  smcc::ReaderMem mem(src.data(), src.size());
+  double t2 = bench::Now();
+  long n_mem = Lex(&mem);
+  double t3 = bench::Now();
+
+  if (n_stream != n_mem) {
+    fprintf(stderr, "token count mismatch: %ld vs %ld\n", n_stream, n_mem);
+    return -1;
+  }
+
+  printf("%zu bytes, %ld tokens\n", src.size(), n_mem);
+  printf("stream: %.1f Mtok/s\n", n_stream / (t1 - t0) / 1e6);
+  printf("buffer: %.1f Mtok/s\n", n_mem / (t3 - t2) / 1e6);
+
+  const char *begin = src.data();
+  const char *end = begin + src.size();
+  int cores = std::max(1u, std::thread::hardware_concurrency());
+  for (int threads : {1, cores}) {
+    double t4 = bench::Now();
+    auto tokens = smcc::Tokenize(begin, end, threads);
+    double t5 = bench::Now();
+    printf("tokenize x%d: %.1f Mtok/s\n", threads,
+           tokens.size() / (t5 - t4) / 1e6);
+  }
+}
@@ -0,0 +1,52 @@
+// Copyright (c) 2020 smarsufan. All Rights Reserved.
+
+// Cold start of a generated rule set of many small functions: parsed
+// from source, against loaded from the Image the first run wrote.
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include "api.h"
+#include "bench.h"
+
+static std::string Generate(int n) {
+  std::string src;
+  char buf[512];
+  for (int i = 0; i < n; ++i) {
+    snprintf(buf, sizeof(buf),
+             "double f%d(double x, double y) {\n"
+             "  if (x * 0.5 + y * 0.25 < %d) {\n"
+             "    return f%d(x - 1, y);\n"
+             "  }\n"
+             "  return (x - 3) * (x + y) / 7 + y * 0.25;\n"
+             "}\n\n", i, i % 97, i / 2);
+    src += buf;
+  }
+  return src;
+}
+
+int main(int argv, char *args[]) {
+  int n = argv > 1 ? atoi(args[1]) : 5000;
+  const char *cache = argv > 2 ? args[2] : "bench_image.img";
+  std::string src = Generate(n);
+  smcc::ReaderMem reader(src.data(), src.size());
+  remove(cache);
+
+  double t0 = bench::Now();
+  smcc::Program parsed(&reader);
+  double t1 = bench::Now();
+  smcc::Program written(&reader, cache);
+  double t2 = bench::Now();
+  smcc::Program loaded(&reader, cache);
+  double t3 = bench::Now();
+  if (written.cached() || !loaded.cached()) {
+    fprintf(stderr, "%s was not used\n", cache);
+    return -1;
+  }
+  smcc::Context ctx(&loaded);
+  printf("%d functions: parse %.2f ms, parse and write %.2f ms, "
+         "load %.2f ms (f0 %g)\n", n, (t1 - t0) * 1e3, (t2 - t1) * 1e3,
+         (t3 - t2) * 1e3, ctx.call("f0", {1., 2.}));
+  remove(cache);
+}
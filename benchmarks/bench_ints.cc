@@ -0,0 +1,44 @@
+// Copyright (c) 2020 smarsufan. All Rights Reserved.
+
+// The tail-recursive counter add(0, 1, n) with a double counter, from
+// examples/tail.c, against the same with an int one, from
+// examples/ints.c, through the bytecode and the JIT.
+
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+
+#include "api.h"
+#include "bench.h"
+
+int main(int argv, char *args[]) {
+  if (argv < 3) {
+    fprintf(stderr, "Usage: %s <tail.c> <ints.c> [n]\n", args[0]);
+    return -1;
+  }
+
+  double n = argv > 3 ? atof(args[3]) : 1e7;
+  const double values[] = {0., 1., n};
+  for (int idx = 1; idx <= 2; ++idx) {
+    auto reader = smcc::OpenReader(args[idx]);
+    if (!reader) {
+      fprintf(stderr, "can not open %s\n", args[idx]);
+      return -1;
+    }
+    smcc::Program program(reader.get());
+    smcc::Context ctx(&program);
+    smcc::Jit jit(program);
+    smcc::FunctionExpr *add = program.function("add");
+    const char *counter =
+        add->proto_->args_[2]->type_ == smcc::Type::kInt ? "int" : "double";
+
+    double t0 = bench::Now();
+    double value = ctx.call(add, values, 3);
+    double t1 = bench::Now();
+    double jitted = jit.call(add, values, 3);
+    double t2 = bench::Now();
+    printf("%-6s call %.0f in %.1f ns/call, jit %.0f in %.2f ns/call\n",
+           counter, value, (t1 - t0) / n * 1e9, jitted, (t2 - t1) / n * 1e9);
+  }
+  return 0;
+}
@@ -0,0 +1,61 @@
+// Copyright (c) 2020 smarsufan. All Rights Reserved.
+
+// Calls per second of main(pos, size) when pos repeats a few distinct
+// values, without and with a cache of score(), and the cache's hit rate.
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "api.h"
+#include "bench.h"
+
+static double tick(double x) {
+  return x;
+}
+
+int main(int argv, char *args[]) {
+  if (argv < 2) {
+    fprintf(stderr, "Usage: %s <memo.c> [distinct] [calls]\n", args[0]);
+    return -1;
+  }
+
+  smcc::natives().Register("tick", tick);
+  auto reader = smcc::OpenReader(args[1]);
+  if (!reader) {
+    fprintf(stderr, "can not open %s\n", args[1]);
+    return -1;
+  }
+  smcc::Program program(reader.get());
+
+  int distinct = argv > 2 ? atoi(args[2]) : 64;
+  int n = argv > 3 ? atoi(args[3]) : 20000;
+  std::vector<double> pos(n);
+  for (int i = 0; i < n; ++i) {
+    pos[i] = (i * 7919 % distinct) * 16000. / distinct;
+  }
+
+  double base = 0;
+  for (bool memo : {false, true}) {
+    smcc::Context ctx(&program);
+    if (memo) {
+      ctx.memoize("score");
+    }
+    double sum = 0;
+    double t0 = bench::Now();
+    for (int i = 0; i < n; ++i) {
+      double a[] = {pos[i], 16000.};
+      sum += ctx.call(program.function("main"), a, 2);
+    }
+    double t1 = bench::Now();
+    double rate = n / (t1 - t0);
+    if (!memo) {
+      base = rate;
+    }
+    auto stats = ctx.memo_stats("score");
+    double total = stats.hits + stats.misses;
+    printf("%-7s %.2f Mcalls/s (%.1fx), hit rate %.1f%% (sum %g)\n",
+           memo ? "memo:" : "plain:", rate / 1e6, rate / base,
+           total ? 100. * stats.hits / total : 0., sum);
+  }
+}
@@ -0,0 +1,57 @@
+// Copyright (c) 2020 smarsufan. All Rights Reserved.
+
+// Parse time and tree-walk time on a generated program of many small
+// functions.
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "api.h"
+#include "bench.h"
+
+static std::string Generate(int n) {
+  std::string src;
+  char buf[512];
+  for (int i = 0; i < n; ++i) {
+    snprintf(buf, sizeof(buf),
+             "double f%d(double x, double y) {\n"
+             "  if (x * 0.5 + y * 0.25 < %d) {\n"
+             "    return x * x - x / (y + 1);\n"
+             "  }\n"
+             "  return (x - 3) * (x + y) / 7 + y * 0.25;\n"
+             "}\n\n", i, i % 97);
+    src += buf;
+  }
+  return src;
+}
+
+int main(int argv, char *args[]) {
+  int n = argv > 1 ? atoi(args[1]) : 100000;
+  int rounds = argv > 2 ? atoi(args[2]) : 10;
+  std::string src = Generate(n);
+
+  smcc::ReaderMem reader(src.data(), src.size());
+  double t0 = bench::Now();
+  smcc::Program program(&reader);
+  double t1 = bench::Now();
+  smcc::Context ctx(&program);
+  printf("parse: %d functions, %.1f MB in %.3f s (%.1f MB/s)\n", n,
+         src.size() / 1e6, t1 - t0, src.size() / (t1 - t0) / 1e6);
+
+  std::vector<std::string> names(n);
+  for (int i = 0; i < n; ++i) {
+    names[i] = "f" + std::to_string(i);
+  }
+
+  double sum = 0;
+  double t2 = bench::Now();
+  for (int r = 0; r < rounds; ++r) {
+    for (int i = 0; i < n; ++i) {
+      sum += ctx.call(names[i], {static_cast<double>(r), 2.});
+    }
+  }
+  double t3 = bench::Now();
+  printf("walk: %.2f Mcalls/s (sum %g)\n", 1e-6 * n * rounds / (t3 - t2), sum);
+}
@@ -0,0 +1,54 @@
+// Copyright (c) 2020 smarsufan. All Rights Reserved.
+
+// Machine code for examples/add.c with every value in a frame slot, as
+// before register allocation, and with values in registers. The JIT runs
+// the same lowering CodeGen writes out, so this is the emitted code's
+// speed: add(0, 1, n), a tail-call loop, and main(pos, size) over a
+// sweep of pos that takes each of its branches.
+
+#include <cstdio>
+#include <cstdlib>
+
+#include "api.h"
+#include "bench.h"
+
+int main(int argv, char *args[]) {
+  if (argv < 2) {
+    fprintf(stderr, "Usage: %s <add.c> [n]\n", args[0]);
+    return -1;
+  }
+
+  auto reader = smcc::OpenReader(args[1]);
+  if (!reader) {
+    fprintf(stderr, "can not open %s\n", args[1]);
+    return -1;
+  }
+  smcc::Program program(reader.get());
+  double n = argv > 2 ? atof(args[2]) : 1e8;
+  const int kCalls = 10000000;
+
+  double base[2] = {0, 0};
+  for (bool registers : {false, true}) {
+    smcc::Jit jit(program, registers);
+    auto add = jit.function<double (*)(double, double, double)>("add");
+    auto main = jit.function<double (*)(double, double)>("main");
+
+    double t0 = bench::Now();
+    double sum = add(0, 1, n);
+    double t1 = bench::Now();
+    for (int i = 0; i < kCalls; ++i) {
+      sum += main(i % 1000, 1000);
+    }
+    double t2 = bench::Now();
+
+    double ns[2] = {(t1 - t0) / n * 1e9, (t2 - t1) / kCalls * 1e9};
+    if (!registers) {
+      base[0] = ns[0];
+      base[1] = ns[1];
+    }
+    printf("%-6s %zu bytes, add %.2f ns/step (%.2fx), main %.2f ns/call "
+           "(%.2fx) (sum %g)\n", registers ? "regs:" : "slots:", jit.size(),
+           ns[0], base[0] / ns[0], ns[1], base[1] / ns[1], sum);
+  }
+  return 0;
+}
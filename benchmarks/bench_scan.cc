@@ -0,0 +1,72 @@
+// Copyright (c) 2020 smarsufan. All Rights Reserved.
+
+// Lexer throughput with the scalar, SSE2 and AVX2 scanning kernels on
+// comment-heavy and identifier-heavy inputs.
+
+#include <cstdio>
+#include <string>
+
+#include "api.h"
+#include "bench.h"
+
+static std::string CommentHeavy() {
+  std::string line =
+      "// piecewise rule generated from the pricing table, do not edit by "
+      "hand; regenerate with the exporter instead\n"
+      "double rate = 0.25;\n";
+  return bench::Repeat(line, 64 << 20);
+}
+
+static std::string IdentHeavy() {
+  std::string line =
+      "double accumulatedScoreForSegment42 = previousAccumulatedScore17 + "
+      "weightOfTheCurrentObservation3 * normalizedObservationValue128;\n";
+  return bench::Repeat(line, 64 << 20);
+}
+
+static long Lex(const std::string &src) {
+  smcc::Lexer lexer(src.data(), src.data() + src.size());
+  long n = 0;
+  while (lexer.gettok() != tok_eof) {
+    ++n;
+  }
+  return n;
+}
+
+int main() {
+  struct Input {
+    const char *name;
+    std::string src;
+  } inputs[] = {
+    {"comments", CommentHeavy()},
+    {"identifiers", IdentHeavy()},
+  };
+  struct Isa {
+    const char *name;
+    smcc::ScanIsa isa;
+  } isas[] = {
+    {"scalar", smcc::ScanIsa::kScalar},
+    {"sse2", smcc::ScanIsa::kSSE2},
+    {"avx2", smcc::ScanIsa::kAVX2},
+  };
+
+  for (auto &input : inputs) {
+    long expect = -1;
+    for (auto &isa : isas) {
+      if (!smcc::set_scan_isa(isa.isa)) {
+        printf("%-12s %-7s unsupported\n", input.name, isa.name);
+        continue;
+      }
+      double t0 = bench::Now();
+      long n = Lex(input.src);
+      double t1 = bench::Now();
+      if (expect >= 0 && n != expect) {
+        fprintf(stderr, "token count mismatch: %ld vs %ld\n", n, expect);
+        return -1;
+      }
+      expect = n;
+      printf("%-12s %-7s %7.0f MB/s\n", input.name, isa.name,
+             input.src.size() / (t1 - t0) / 1e6);
+    }
+  }
+}
@@ -0,0 +1,57 @@
+// Copyright (c) 2020 smarsufan. All Rights Reserved.
+
+// Editing one function of a generated rule set: a fresh Program against a
+// Session that reparses only what the edit reaches.
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include "api.h"
+#include "bench.h"
+
+static std::string Generate(int n, int edit) {
+  std::string src;
+  char buf[512];
+  for (int i = 0; i < n; ++i) {
+    snprintf(buf, sizeof(buf),
+             "double f%d(double x, double y) {\n"
+             "  if (x * 0.5 + y * 0.25 < %d) {\n"
+             "    return f%d(x - 1, y);\n"
+             "  }\n"
+             "  return (x - 3) * (x + y) / 7 + y * %g;\n"
+             "}\n\n", i, i % 97, i / 2, i == n - 1 ? 0.5 * edit : 0.25);
+    src += buf;
+  }
+  return src;
+}
+
+int main(int argv, char *args[]) {
+  int n = argv > 1 ? atoi(args[1]) : 5000;
+  int edits = argv > 2 ? atoi(args[2]) : 20;
+  smcc::Session session;
+  std::string src = Generate(n, 0);
+
+  double t0 = bench::Now();
+  session.update(src);
+  double t1 = bench::Now();
+  double parse = 0, update = 0;
+  size_t parsed = 0;
+  for (int i = 1; i <= edits; ++i) {
+    src = Generate(n, i);
+    smcc::ReaderMem reader(src.data(), src.size());
+    double t2 = bench::Now();
+    smcc::Program program(&reader);
+    double t3 = bench::Now();
+    session.update(src);
+    double t4 = bench::Now();
+    parse += t3 - t2;
+    update += t4 - t3;
+    parsed += session.parsed();
+  }
+  smcc::Context ctx(&session.program());
+  printf("%d functions: first update %.2f ms; per edit: parse %.2f ms, "
+         "update %.2f ms, %zu parsed (f%d %g)\n", n, (t1 - t0) * 1e3,
+         parse / edits * 1e3, update / edits * 1e3, parsed / edits, n - 1,
+         ctx.call("f" + std::to_string(n - 1), {1000., 2.}));
+}
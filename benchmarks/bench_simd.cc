@@ -0,0 +1,74 @@
+// Copyright (c) 2020 smarsufan. All Rights Reserved.
+
+// Rows per second of each Batch engine on one thread, with rows in order
+// (neighbours branch alike) and shuffled (they diverge).
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "api.h"
+#include "bench.h"
+
+int main(int argv, char *args[]) {
+  if (argv < 2) {
+    fprintf(stderr, "Usage: %s <input.sm> [rows]\n", args[0]);
+    return -1;
+  }
+
+  auto reader = smcc::OpenReader(args[1]);
+  if (!reader) {
+    fprintf(stderr, "can not open %s\n", args[1]);
+    return -1;
+  }
+  smcc::Program program(reader.get());
+  smcc::Batch batch(&program, 1);
+
+  size_t rows = argv > 2 ? atol(args[2]) : 1000000;
+  const int kRuns = 5;
+  std::vector<double> pos(rows), size(rows, 16000.), out(rows);
+  const double *columns[] = {pos.data(), size.data()};
+
+  const struct {
+    const char *name;
+    smcc::Engine engine;
+  } kEngines[] = {
+    {"walk", smcc::Engine::kWalk},
+    {"bytecode", smcc::Engine::kBytecode},
+    {"simd", smcc::Engine::kSimd},
+  };
+
+  for (bool shuffled : {false, true}) {
+    for (size_t row = 0; row < rows; ++row) {
+      pos[row] = row % 16000;
+    }
+    if (shuffled) {
+      std::shuffle(pos.begin(), pos.end(), std::mt19937(42));
+    }
+    double base = 0;
+    for (auto &e : kEngines) {
+      batch.run("main", columns, rows, out.data(), e.engine);  // warm up
+      // The best of a few runs, as the machine allows.
+      double best = 0;
+      for (int run = 0; run < kRuns; ++run) {
+        double t0 = bench::Now();
+        batch.run("main", columns, rows, out.data(), e.engine);
+        double t1 = bench::Now();
+        best = run ? std::min(best, t1 - t0) : t1 - t0;
+      }
+      double rate = rows / best;
+      if (e.engine == smcc::Engine::kBytecode) {
+        base = rate;
+      }
+      printf("%-8s %-8s: %.2f Mrows/s", shuffled ? "shuffled" : "sorted",
+             e.name, rate / 1e6);
+      if (base) {
+        printf(" (%.1fx bytecode)", rate / base);
+      }
+      printf("\n");
+    }
+  }
+  return out[0] == 12345.6789;  // keep out alive
+}
@@ -0,0 +1,66 @@
+// Copyright (c) 2020 smarsufan. All Rights Reserved.
+
+// A tail-recursive loop, add(0, 1, n) from examples/add.c, through every
+// backend, with the peak memory of the process after each: tail calls
+// must not grow it with n.
+
+#include <sys/resource.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "api.h"
+#include "bench.h"
+
+namespace {
+
+long PeakKiB() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+}  // namespace
+
+int main(int argv, char *args[]) {
+  if (argv < 2) {
+    fprintf(stderr, "Usage: %s <input.sm> [n]\n", args[0]);
+    return -1;
+  }
+
+  auto reader = smcc::OpenReader(args[1]);
+  if (!reader) {
+    fprintf(stderr, "can not open %s\n", args[1]);
+    return -1;
+  }
+  smcc::Program program(reader.get());
+  smcc::Context ctx(&program);
+  smcc::Jit jit(program);
+  smcc::FunctionExpr *add = program.function("add");
+
+  double n = argv > 2 ? atof(args[2]) : 1e7;
+  const double values[] = {0., 1., n};
+  printf("add(0, 1, %.0f), peak %ld KiB before\n", n, PeakKiB());
+
+  struct {
+    const char *name;
+    double (*run)(smcc::Context &, const smcc::Jit &, smcc::FunctionExpr *,
+                  const double *);
+  } kBackends[] = {
+    {"eval", [](smcc::Context &ctx, const smcc::Jit &, smcc::FunctionExpr *f,
+                const double *a) { return ctx.eval(f, a, 3); }},
+    {"call", [](smcc::Context &ctx, const smcc::Jit &, smcc::FunctionExpr *f,
+                const double *a) { return ctx.call(f, a, 3); }},
+    {"jit", [](smcc::Context &, const smcc::Jit &jit, smcc::FunctionExpr *f,
+               const double *a) { return jit.call(f, a, 3); }},
+  };
+  for (auto &backend : kBackends) {
+    double t0 = bench::Now();
+    double value = backend.run(ctx, jit, add, values);
+    double t1 = bench::Now();
+    printf("%-5s %.0f in %.3f s, %.1f ns/call, peak %ld KiB\n", backend.name,
+           value, t1 - t0, (t1 - t0) / n * 1e9, PeakKiB());
+  }
+  return 0;
+}
@@ -2,3 +2,13 @@
 
 #pragma once
 #include "ast.h"
+#include "batch.h"
+#include "bytecode.h"
+#include "codegen.h"
+#include "context.h"
+#include "image.h"
+#include "jit.h"
+#include "native.h"
+#include "program.h"
+#include "session.h"
+#include "ssa.h"
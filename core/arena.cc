@@ -0,0 +1,35 @@
+// Copyright (c) 2020 smarsufan. All Rights Reserved.
+
+#include "arena.h"
+
+#include <cstdlib>
+
+namespace smcc {
+
+void *Arena::allocate_slow(size_t size, size_t align) {
+  size_t bytes = size + align > kBlockSize ? size + align : kBlockSize;
+  char *block = static_cast<char *>(malloc(bytes));
+  if (!block) {
+    throw std::bad_alloc();
+  }
+  blocks_.push_back(block);
+  capacity_ += bytes;
+  cur_ = block;
+  end_ = block + bytes;
+  return allocate(size, align);
+}
+
+void Arena::clear() {
+  for (auto it = dtors_.rbegin(); it != dtors_.rend(); ++it) {
+    it->fn(it->obj);
+  }
+  dtors_.clear();
+  for (char *block : blocks_) {
+    free(block);
+  }
+  blocks_.clear();
+  cur_ = end_ = nullptr;
+  capacity_ = 0;
+}
+
+}  // namespace smcc
@@ -0,0 +1,108 @@
+// Copyright (c) 2020 smarsufan. All Rights Reserved.
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace smcc {
+
+/// A contiguous run of T owned by an Arena.
+template <typename T>
+class Span {
+ public:
+  Span() = default;
+
+  Span(T *data, uint32_t size) : data_(data), size_(size) {}
+
+  T *begin() const { return data_; }
+
+  T *end() const { return data_ + size_; }
+
+  T &operator[](size_t idx) const { return data_[idx]; }
+
+  size_t size() const { return size_; }
+
+  bool empty() const { return size_ == 0; }
+
+ private:
+  T *data_{nullptr};
+  uint32_t size_{0};
+};
+
+/// Bump allocator owning every node of a parsed program. Nothing is freed
+/// one by one; the whole arena goes at once.
+class Arena {
+ public:
+  static constexpr size_t kBlockSize = 64 * 1024;
+
+  Arena() = default;
+
+  Arena(const Arena &) = delete;
+
+  Arena &operator=(const Arena &) = delete;
+
+  ~Arena() { clear(); }
+
+  void *allocate(size_t size, size_t align) {
+    uintptr_t p =
+        (reinterpret_cast<uintptr_t>(cur_) + align - 1) & ~(align - 1);
+    if (p + size > reinterpret_cast<uintptr_t>(end_)) {
+      return allocate_slow(size, align);
+    }
+    cur_ = reinterpret_cast<char *>(p + size);
+    return reinterpret_cast<void *>(p);
+  }
+
+  // Construct a T in the arena. Non-trivial destructors run in clear().
+  template <typename T, typename... Args>
+  T *make(Args &&... args) {
+    void *mem = allocate(sizeof(T), alignof(T));
+    T *obj = new (mem) T(std::forward<Args>(args)...);
+    if (!std::is_trivially_destructible<T>::value) {
+      dtors_.push_back({obj, [](void *p) { static_cast<T *>(p)->~T(); }});
+    }
+    return obj;
+  }
+
+  // Copy items[from, end) into the arena and drop them from items.
+  template <typename T>
+  Span<T> take(std::vector<T> *items, size_t from = 0) {
+    static_assert(std::is_trivially_copyable<T>::value, "span of pods");
+    size_t n = items->size() - from;
+    T *data = nullptr;
+    if (n) {
+      data = static_cast<T *>(allocate(n * sizeof(T), alignof(T)));
+      memcpy(data, items->data() + from, n * sizeof(T));
+    }
+    items->resize(from);
+    return Span<T>(data, static_cast<uint32_t>(n));
+  }
+
+  // Free everything.
+  void clear();
+
+  // Bytes reserved from the system.
+  size_t capacity() const { return capacity_; }
+
+ private:
+  void *allocate_slow(size_t size, size_t align);
+
+ private:
+  struct Dtor {
+    void *obj;
+    void (*fn)(void *);
+  };
+
+  char *cur_{nullptr};
+  char *end_{nullptr};
+  size_t capacity_{0};
+  std::vector<char *> blocks_;
+  std::vector<Dtor> dtors_;
+};
+
+}  // namespace smcc
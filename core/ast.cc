@@ -1,7 +1,13 @@
 // Copyright (c) 2020 smarsufan. All Rights Reserved.
 
 #include "ast.h"
+#include <cstring>
 #include <iostream>
+
+#include "check.h"
+#include "fold.h"
+#include "link.h"
+#include "resolve.h"
 #include <memory>
 #include <utility>
 
@@ -20,14 +26,70 @@ namespace smcc {
 
 AST::AST(Reader *reader)
     : reader_(reader) {
-
+  if (reader_ && reader_->data()) {
+    lexing_ = true;
+    lexer_ = Lexer(reader_->data(), reader_->data() + reader_->size());
+  }
 }
 
 AST::~AST() {
   
 }
 
+std::string AST::identifier() const {
+  if (tokenized_) {
+    size_t pos = tok_pos_ - 1;
+    return std::string(reader_->data() + tokens_.offsets[pos],
+                       tokens_.lengths[pos]);
+  }
+  return lexing_ ? lexer_.str() : identifier_str;
+}
+
+Symbol AST::symbol() const {
+  if (tokenized_) {
+    return cur_sym_;
+  }
+  if (lexing_) {
+    return symbols().intern(lexer_.text(), lexer_.length());
+  }
+  return symbols().intern(identifier_str);
+}
+
+void AST::number(const char *s, size_t n) {
+  num_integral_ = !memchr(s, '.', n);
+  if (num_integral_ && !ParseInt(s, n, &num_int_)) {
+    fprintf(stderr, "-2000");
+    abort();
+  }
+}
+
 int AST::gettok() {
+  if (tokenized_) {
+    int tok = tokens_.kinds[tok_pos_];
+    if (tok == tok_eof) {
+      return tok;  // Don't eat the EOF.
+    }
+    if (tok == tok_number) {
+      num_val = tokens_.numbers[num_pos_++];
+      number(reader_->data() + tokens_.offsets[tok_pos_],
+             tokens_.lengths[tok_pos_]);
+    }
+    else if (tok == tok_identifier) {
+      cur_sym_ = tokens_.symbols[sym_pos_++];
+    }
+    ++tok_pos_;
+    return tok;
+  }
+
+  if (lexing_) {
+    int tok = lexer_.gettok();
+    num_val = lexer_.num_val();
+    if (tok == tok_number) {
+      number(lexer_.text(), lexer_.length());
+    }
+    return tok;
+  }
+
   // Skip any whitespace.
   while (isspace(last_char))
     last_char = getchar();
@@ -62,6 +124,7 @@ int AST::gettok() {
     } while (isdigit(last_char) || last_char == '.');
 
     num_val = strtod(num_str.c_str(), nullptr);
+    number(num_str.data(), num_str.size());
     return tok_number;
   }
 
@@ -156,11 +219,37 @@ int AST::GetTokPrecedence() {
 }
 
 void AST::parse() {
-  getNextToken();
+  parse_toplevel();
 
-  // std::vector<std::unique_ptr<Expr>> exprs;
+  for (auto expr : exprs) {
+    if (auto func = expr_cast<FunctionExpr>(expr)) {
+      Resolve(func);
+    }
+  }
+
+  Link(exprs);
+  Check(exprs, &arena_);
+  Fold(exprs, &arena_);
+}
+
+void AST::parse_toplevel() {
+  if (lexing_) {
+    const char *begin = reader_->data();
+    tokens_ = Tokenize(begin, begin + reader_->size());
+    tokenized_ = true;
+    tok_pos_ = 0;
+    num_pos_ = 0;
+    sym_pos_ = 0;
+  }
+
+  getNextToken();
 
   while (cur_tok != tok_eof) {
+    if (cur_tok == tok_extern) {
+      exprs.push_back(ParseExtern());
+      continue;
+    }
+
     if (cur_tok <= tok_dt) {
       fprintf(stderr, "-100");
       abort();
@@ -174,23 +263,62 @@ void AST::parse() {
       fprintf(stderr, "-200");
       abort();
     }
-    auto name = identifier_str;
+    auto name = symbol();
     getNextToken();  // eat id
     if (cur_tok == '(') {
       // getNextToken();  // eat (
       auto expr = ParseDefinition(cur_type, name);
-      exprs.push_back(std::move(expr));
+      exprs.push_back(expr);
     }
     else {
-      auto vars = ParseVars(cur_type, name);
-      for (auto &var : vars) {
-        exprs.push_back(std::move(var));
-      }
+      size_t mark = scratch_.size();
+      ParseVars(cur_type, name);
+      exprs.insert(exprs.end(), scratch_.begin() + mark, scratch_.end());
+      scratch_.resize(mark);
     }
   }
 }
 
-std::unique_ptr<Expr> AST::ParseDefinition(Token def_token, const std::string &def_name) {
+Expr *AST::ParseExtern() {
+  getNextToken();  // eat extern
+  if (cur_tok <= tok_dt) {
+    fprintf(stderr, "-1900");
+    abort();
+  }
+
+  cur_type = curtok();
+  getNextToken();  // eat type
+
+  if (cur_tok != tok_identifier) {
+    fprintf(stderr, "-1910");
+    abort();
+  }
+  auto name = symbol();
+  getNextToken();  // eat id
+
+  auto proto = ParsePrototype(cur_type, name);
+  if (cur_tok != ';') {
+    fprintf(stderr, "-1920");
+    abort();
+  }
+  getNextToken();  // eat ;
+  return proto;
+}
+
+Expr *AST::ParseDefinition(Token def_token, Symbol def_name) {
+  auto def = ParsePrototype(def_token, def_name);
+
+  if (cur_tok != '{') {
+    fprintf(stderr, "-700");
+    abort();
+  }
+
+  auto body = ParseBody();
+
+  return arena_.make<FunctionExpr>(def, body);
+}
+
+PrototypeExpr *AST::ParsePrototype(Token def_token, Symbol def_name) {
   if (cur_tok != '(') {
     fprintf(stderr, "-300");
     abort();
@@ -198,7 +326,7 @@ std::unique_ptr<Expr> AST::ParseDefinition(Token def_token, const std::string &d
 
   getNextToken();  // eat '('
 
-  std::vector<std::unique_ptr<VarExpr>> args;
+  std::vector<VarExpr *> args;
   while (cur_tok != ')') {
     if (cur_tok <= tok_dt) {
       fprintf(stderr, "-400");
@@ -212,10 +340,10 @@ std::unique_ptr<Expr> AST::ParseDefinition(Token def_token, const std::string &d
       fprintf(stderr, "-500");
       abort();
     }
-    auto name = identifier_str;
+    auto name = symbol();
 
-    auto arg = std::make_unique<VarExpr>(cur_type, name);
-    args.emplace_back(std::move(arg));
+    auto arg = arena_.make<VarExpr>(cur_type, name);
+    args.push_back(arg);
 
     getNextToken();  // eat name
     if (cur_tok != ',' && cur_tok != ')') {
@@ -228,28 +356,18 @@ std::unique_ptr<Expr> AST::ParseDefinition(Token def_token, const std::string &d
     }
   }
 
-  auto def = std::make_unique<PrototypeExpr>(def_token, def_name, std::move(args));
+  auto def =
+      arena_.make<PrototypeExpr>(def_token, def_name, arena_.take(&args));
 
   getNextToken();  // eat )
-
-  if (cur_tok != '{') {
-    fprintf(stderr, "-700");
-    abort();
-  }
-
-  auto body = ParseBody();
-
-  auto func = std::make_unique<FunctionExpr>(std::move(def), std::move(body));
-  return std::move(func);
+  return def;
 }
 
-std::vector<std::unique_ptr<Expr>> AST::ParseVars(Token token, const std::string &name) {
-  std::unique_ptr<VarExpr> var = std::make_unique<VarExpr>(token, name);
+void AST::ParseVars(Token token, Symbol name) {
+  auto var = arena_.make<VarExpr>(token, name);
 
-  std::vector<std::unique_ptr<Expr>> exprs;
-
-  auto expr = ParseBinaryOp(0, std::move(var));
-  exprs.push_back(std::move(expr));
+  auto expr = ParseBinaryOp(0, var);
+  scratch_.push_back(expr);
 
   while (cur_tok != ';') {
     if (cur_tok != ',') {
@@ -271,41 +389,40 @@ std::vector<std::unique_ptr<Expr>> AST::ParseVars(Token token, const std::string
       abort();
     }
 
-    auto cur_name = identifier_str;
+    auto cur_name = symbol();
+    getNextToken();  // eat id
 
-    std::unique_ptr<VarExpr> var = std::make_unique<VarExpr>(cur_type, cur_name);
-    auto expr = ParseBinaryOp(0, std::move(var));
-    exprs.push_back(std::move(expr));
+    auto var = arena_.make<VarExpr>(cur_type, cur_name);
+    auto expr = ParseBinaryOp(0, var);
+    scratch_.push_back(expr);
   }
 
-  return exprs;
+  getNextToken();  // eat ;
 }
 
-std::vector<std::unique_ptr<Expr>> AST::ParseBody() {
-  std::vector<std::unique_ptr<Expr>> exprs;
+ExprList AST::ParseBody() {
+  size_t mark = scratch_.size();
   getNextToken();  // eat {
   while (cur_tok != '}') {
-    if (cur_tok == tok_dt) {
-      // Token type = curtok();
+    if (cur_tok == tok_int || cur_tok == tok_dbl) {
+      cur_type = curtok();
       getNextToken();  // eat dt
       if (cur_tok != tok_identifier) {
         fprintf(stderr, "-900");
         abort();
       }
-      auto name = identifier_str;
-      auto vars = ParseVars(cur_type, name);
-      for (auto &var : vars) {
-        exprs.push_back(std::move(var));
-      }
+      auto name = symbol();
+      getNextToken();  // eat id
+      ParseVars(cur_type, name);
     }
     else if (cur_tok == tok_if) {
       auto expr = ParseIf();
-      exprs.push_back(std::move(expr));
+      scratch_.push_back(expr);
     }
     else if (cur_tok == tok_return) {
       getNextToken();  // eat return
       auto expr = ParseExpression();
-      exprs.push_back(std::make_unique<ReturnExpe>(std::move(expr)));
+      scratch_.push_back(arena_.make<ReturnExpe>(expr));
 
       if (cur_tok != ';') {
         fprintf(stderr, "-910");
@@ -316,7 +433,7 @@ std::vector<std::unique_ptr<Expr>> AST::ParseBody() {
     }
     else {
       auto expr = ParseExpression();
-      exprs.push_back(std::move(expr));
+      scratch_.push_back(expr);
 
       if (cur_tok != ';') {
         fprintf(stderr, "-920");
@@ -328,12 +445,10 @@ std::vector<std::unique_ptr<Expr>> AST::ParseBody() {
   }
 
   getNextToken();  // eat }
-  // return std::move(exprs);
-  return exprs;
-
+  return arena_.take(&scratch_, mark);
 }
 
-std::unique_ptr<Expr> AST::ParseIf() {
+Expr *AST::ParseIf() {
   getNextToken();  // eat if
   if (cur_tok != '(') {
     fprintf(stderr, "-1000");
@@ -346,12 +461,13 @@ std::unique_ptr<Expr> AST::ParseIf() {
     abort();
   }
   auto body = ParseBody();
-  std::vector<std::unique_ptr<Expr>> other;
+  ExprList other;
   if (cur_tok == tok_else) {
     getNextToken();  // eat else
     if (cur_tok == tok_if) {
-      auto expr = ParseIf();
-      other.push_back(std::move(expr));
+      size_t mark = scratch_.size();
+      scratch_.push_back(ParseIf());
+      other = arena_.take(&scratch_, mark);
     }
     else {
       // other = std::move(ParseBody());
@@ -359,29 +475,29 @@ std::unique_ptr<Expr> AST::ParseIf() {
     }
   }
 
-  return std::make_unique<IfExpr>(std::move(cond), std::move(body), std::move(other));
+  return arena_.make<IfExpr>(cond, body, other);
 }
 
-std::unique_ptr<Expr> AST::ParseExpression() {
+Expr *AST::ParseExpression() {
   auto lhs = ParsePrimary();
-  return ParseBinaryOp(0, std::move(lhs));
+  return ParseBinaryOp(0, lhs);
 }
 
-std::unique_ptr<Expr> AST::ParsePrimary() {
+Expr *AST::ParsePrimary() {
   if (cur_tok == tok_identifier) {
     // ParseIdentifierExpr
-    auto name = identifier_str;
+    auto name = symbol();
     getNextToken(); // eat id
     if (cur_tok != '(') {
-      return std::make_unique<VarExpr>(tok_dt, name);
+      return arena_.make<VarExpr>(tok_dt, name);
     }
 
     getNextToken(); // eat (
-    std::vector<std::unique_ptr<Expr>> args;
+    size_t mark = scratch_.size();
     if (cur_tok != ')') {
       while (true) {
         auto arg = ParseExpression();
-        args.push_back(std::move(arg));
+        scratch_.push_back(arg);
 
         if (cur_tok == ')')
           break;
@@ -397,12 +513,13 @@ std::unique_ptr<Expr> AST::ParsePrimary() {
     // Eat the ')'.
     getNextToken();
 
-    return std::make_unique<CallExpr>(name, std::move(args));
+    return arena_.make<CallExpr>(name, arena_.take(&scratch_, mark));
   }
   else if (cur_tok == tok_number) {
-    auto expr = std::make_unique<NumberExpr>(num_val);
+    auto expr = arena_.make<NumberExpr>(constants().intern(num_val),
+                                        num_integral_, num_int_);
     getNextToken(); // eat the number
-    return std::move(expr);
+    return expr;
   }
   else if (cur_tok == '(') {
     getNextToken();  // eat '('
@@ -420,7 +537,7 @@ std::unique_ptr<Expr> AST::ParsePrimary() {
   }
 }
 
-std::unique_ptr<Expr> AST::ParseBinaryOp(int expr_prec, std::unique_ptr<Expr> lhs) {
+Expr *AST::ParseBinaryOp(int expr_prec, Expr *lhs) {
   while (true) {
     int tok_prec = GetTokPrecedence();
 
@@ -439,14 +556,14 @@ std::unique_ptr<Expr> AST::ParseBinaryOp(int expr_prec, std::unique_ptr<Expr> lh
 
     int next_prec = GetTokPrecedence();
     if (tok_prec < next_prec) {
-      rhs = ParseBinaryOp(tok_prec + 1, std::move(rhs));
+      rhs = ParseBinaryOp(tok_prec + 1, rhs);
       if (!rhs) {
         fprintf(stderr, "-1800");
         abort();
       }
     }
 
-    lhs = std::make_unique<BinaryExpr>(binop, std::move(lhs), std::move(rhs));
+    lhs = arena_.make<BinaryExpr>(binop, lhs, rhs);
   }
 }
 
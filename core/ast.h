@@ -5,6 +5,7 @@
 #include <map>
 
 #include "reader.h"
+#include "lexer.h"
 #include "expr.h"
 
 // The lexer returns tokens [0-255] if it is an unknown character, otherwise one
@@ -70,20 +71,39 @@ typedef struct TokenInfo {
 
 /** this table gives more information about tokens */
 static const TokenInfo token_info_[-tok_nb] = {
-    [-tok_nb+tok_eof]        = { .name =  "eof"        },
-    [-tok_nb+tok_def]        = { .name =  "def"        },
-    [-tok_nb+tok_extern]     = { .name =  "extern"     },
-    [-tok_nb+tok_identifier] = { .name =  "identifier" },
-    [-tok_nb+tok_number]     = { .name =  "number"     }
+    { .name = ""           },  // tok_nb
+    { .name = "eof"        },
+    { .name = "def"        },
+    { .name = "extern"     },
+    { .name = "identifier" },
+    { .name = "number"     },
+    { .name = "if"         },
+    { .name = "else"       },
+    { .name = "return"     },
+    { .name = "<"          },
+    { .name = "<="         },
+    { .name = ">"          },
+    { .name = ">="         },
+    { .name = "=="         },
+    { .name = "+"          },
+    { .name = "-"          },
+    { .name = "*"          },
+    { .name = "/"          },
+    { .name = "="          },
+    { .name = "dt"         },
+    { .name = "int"        },
+    { .name = "double"     },
 };
 
-static const TokenInfo *token_info = token_info_ - tok_nb;
+static const TokenInfo *const token_info = token_info_ - tok_nb;
 
 namespace smcc {
 
 /// The abstract syntax tree.
 class AST {
  public:
+  // A null reader makes an empty tree, for a program built without
+  // parse().
   AST(Reader *reader);
 
   ~AST();
@@ -93,10 +113,31 @@ class AST {
   // get a tok.
   int gettok();
 
+  // Take in the literal [s, s + n) of the last tok_number.
+  void number(const char *s, size_t n);
+
   void parse();
 
+  // Only parse, leaving Resolve() and the passes after it to the caller,
+  // e.g. a Session linking the definitions with others.
+  void parse_toplevel();
+
   Token curtok() { return static_cast<Token>(cur_tok); }
 
+  // The name of the last tok_identifier.
+  std::string identifier() const;
+
+  // The interned name of the last tok_identifier.
+  Symbol symbol() const;
+
+  // The functions and externs parse() found, in source order.
+  const std::vector<Expr *> &toplevel() const { return exprs; }
+
+  // Where a program built without parse(), e.g. by Image::load(), goes.
+  Arena *arena() { return &arena_; }
+
+  std::vector<Expr *> *mutable_toplevel() { return &exprs; }
+
  private:
   Reader *reader() {
     return reader_;
@@ -108,32 +149,61 @@ class AST {
 
   int GetTokPrecedence();
 
-  std::unique_ptr<Expr> ParseDefinition(Token token, const std::string &name);
+  Expr *ParseDefinition(Token token, Symbol name);
 
-  std::vector<std::unique_ptr<Expr>> ParseBody();
+  // extern <type> <name>(<params>);
+  Expr *ParseExtern();
 
-  std::unique_ptr<Expr> ParseIf();
+  // The parameter list after a function's name.
+  PrototypeExpr *ParsePrototype(Token token, Symbol name);
 
-  std::unique_ptr<Expr> ParsePrimary();
+  ExprList ParseBody();
 
-  std::vector<std::unique_ptr<Expr>> ParseVars(Token token, const std::string &name);
+  Expr *ParseIf();
 
-  std::unique_ptr<Expr> ParseExpression();
+  Expr *ParsePrimary();
 
-  std::unique_ptr<Expr> ParseBinaryOp(int expr_prec, std::unique_ptr<Expr> lhs);
+  // Push the declarations onto scratch_.
+  void ParseVars(Token token, Symbol name);
+
+  Expr *ParseExpression();
+
+  Expr *ParseBinaryOp(int expr_prec, Expr *lhs);
 
  private:
   Reader *reader_{nullptr};
 
+  // Lex straight from the reader's buffer when it has one.
+  bool lexing_{false};
+  Lexer lexer_;
+
+  // parse() lexes the buffer up front and walks the tokens.
+  bool tokenized_{false};
+  TokenStream tokens_;
+  size_t tok_pos_{0};
+  size_t num_pos_{0};
+  size_t sym_pos_{0};
+  Symbol cur_sym_{kNoSymbol};
+
   int last_char = ' ';
   std::string identifier_str;
   double num_val{0};
+  // The last tok_number was written without a point, and its exact value
+  // if so.
+  bool num_integral_{false};
+  int64_t num_int_{0};
 
   int cur_tok{0};
 
   Token cur_type{tok_dt};
 
-  std::vector<std::unique_ptr<Expr>> exprs;
+  // Owns every node below.
+  Arena arena_;
+
+  std::vector<Expr *> exprs;
+
+  // Children being parsed; each list moves into the arena once complete.
+  std::vector<Expr *> scratch_;
 };
 
 }  // namespace smcc
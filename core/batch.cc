@@ -0,0 +1,65 @@
+// Copyright (c) 2020 smarsufan. All Rights Reserved.
+
+#include "batch.h"
+
+#include <atomic>
+
+namespace smcc {
+
+Batch::Batch(const Program *program, int threads)
+    : program_(program), pool_(threads) {
+  for (int worker = 0; worker < pool_.size(); ++worker) {
+    contexts_.emplace_back(new Context(program_));
+  }
+  lanes_.resize(pool_.size());
+}
+
+void Batch::run(const std::string &name, const double *const *columns,
+                size_t rows, double *out, Engine engine) {
+  FunctionExpr *func = program_->function(name);
+  if (!func) {
+    fprintf(stderr, "batch -100: undefined function %s\n", name.c_str());
+    abort();
+  }
+  run(func, columns, rows, out, engine);
+}
+
+void Batch::run(FunctionExpr *func, const double *const *columns,
+                size_t rows, double *out, Engine engine) {
+  size_t nparams = func->proto_->args_.size();
+  size_t nchunks = (rows + kBatchRows - 1) / kBatchRows;
+  std::atomic<size_t> next(0);
+
+  pool_.run([&](int worker) {
+    Context &ctx = *contexts_[worker];
+    std::vector<double> args(nparams);
+    std::vector<const double *> lanes(nparams);
+    if (engine == Engine::kSimd && !lanes_[worker]) {
+      lanes_[worker].reset(new LaneContext(&ctx));
+    }
+    for (size_t chunk = next++; chunk < nchunks; chunk = next++) {
+      size_t begin = chunk * kBatchRows;
+      size_t end = std::min(rows, begin + kBatchRows);
+      if (engine == Engine::kSimd) {
+        for (size_t row = begin; row < end; row += kLanes) {
+          for (size_t p = 0; p < nparams; ++p) {
+            lanes[p] = columns[p] + row;
+          }
+          lanes_[worker]->run(func, lanes.data(),
+                              std::min(kLanes, end - row), out + row);
+        }
+        continue;
+      }
+      for (size_t row = begin; row < end; ++row) {
+        for (size_t p = 0; p < nparams; ++p) {
+          args[p] = columns[p][row];
+        }
+        out[row] = engine == Engine::kWalk
+                       ? ctx.eval(func, args.data(), nparams)
+                       : ctx.call(func, args.data(), nparams);
+      }
+    }
+  });
+}
+
+}  // namespace smcc
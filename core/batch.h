@@ -0,0 +1,53 @@
+// Copyright (c) 2020 smarsufan. All Rights Reserved.
+
+#pragma once
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "context.h"
+#include "pool.h"
+#include "program.h"
+#include "simd.h"
+
+namespace smcc {
+
+// How Batch runs each row.
+enum class Engine {
+  kWalk,
+  kBytecode,
+  // kLanes rows at a time; see LaneContext.
+  kSimd,
+};
+
+// Rows a worker takes at a time.
+constexpr size_t kBatchRows = 1024;
+
+/// Runs one function over many rows on a pool of threads.
+///
+/// Arguments are columns: columns[p][row] is parameter p of row, and the
+/// result of row goes to out[row]. The function is looked up once per
+/// batch, and every worker keeps its Context across batches.
+class Batch {
+ public:
+  // threads <= 0 uses every core.
+  explicit Batch(const Program *program, int threads = 0);
+
+  int threads() const { return pool_.size(); }
+
+  // columns holds one column per parameter of func.
+  void run(FunctionExpr *func, const double *const *columns, size_t rows,
+           double *out, Engine engine = Engine::kBytecode);
+
+  void run(const std::string &name, const double *const *columns,
+           size_t rows, double *out, Engine engine = Engine::kBytecode);
+
+ private:
+  const Program *program_;
+  ThreadPool pool_;
+  std::vector<std::unique_ptr<Context>> contexts_;
+  // Made by each worker the first time it runs kSimd.
+  std::vector<std::unique_ptr<LaneContext>> lanes_;
+};
+
+}  // namespace smcc
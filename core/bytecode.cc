@@ -0,0 +1,552 @@
+// Copyright (c) 2020 smarsufan. All Rights Reserved.
+
+#include "bytecode.h"
+
+#include <cmath>
+
+#include "ast.h"
+#include "ssa.h"
+
+#if defined(__GNUC__) && !defined(SMCC_NO_COMPUTED_GOTO)
+#define SMCC_COMPUTED_GOTO 1
+#endif
+
+namespace smcc {
+
+namespace {
+
+const char *kOpNames[] = {
+#define SMCC_OP_NAME(name) #name,
+  SMCC_OPS(SMCC_OP_NAME)
+#undef SMCC_OP_NAME
+};
+
+}  // namespace
+
+/// Lowers one FunctionExpr, through its SSA form, to register code.
+///
+/// Every value gets a register of its own, parameters the ones the caller
+/// passed them in. Calls take their arguments in registers above all of
+/// those, since the callee's frame starts at the first; where it is safe,
+/// an argument is computed there in the first place. Phis are moves at
+/// the end of each predecessor.
+class Compiler {
+ public:
+  Compiler(Module *module, FunctionExpr *func)
+      : module_(module), func_(func) {}
+
+  BytecodeFunction compile() {
+    ssa_ = BuildSsa(func_);
+    OptimizeSsa(&ssa_);
+    fn_.name = func_->proto_->name_;
+    fn_.nparams = func_->proto_->args_.size();
+
+    std::vector<uint32_t> args = arguments();
+    reg_.assign(ssa_.values.size(), 0);
+    uint32_t top = fn_.nparams;
+    uint32_t nargs = 1;
+    for (auto &b : ssa_.blocks) {
+      for (uint32_t v : b.code) {
+        auto &ins = ssa_.values[v];
+        if (ins.op == kSsaParam) {
+          reg_[v] = ins.k;
+        }
+        else if (args[v] == kNoArg) {
+          reg_[v] = top++;
+        }
+        nargs = std::max<uint32_t>(nargs, ins.args.size());
+      }
+    }
+    base_ = top;
+    for (uint32_t v = 0; v < args.size(); ++v) {
+      if (args[v] != kNoArg) {
+        reg_[v] = base_ + args[v];
+      }
+    }
+    if (static_cast<uint64_t>(base_) + nargs > kMaxRegs) {
+      fprintf(stderr, "bytecode -100: %s needs too many registers\n",
+              symbols().name(fn_.name).c_str());
+      abort();
+    }
+    fn_.nregs = base_ + nargs;
+
+    std::vector<uint32_t> starts(ssa_.blocks.size());
+    for (uint32_t b = 0; b < ssa_.blocks.size(); ++b) {
+      starts[b] = here();
+      block(b);
+    }
+    for (auto &fix : fixups_) {
+      fn_.code[fix.first].b = starts[fix.second];
+    }
+    return std::move(fn_);
+  }
+
+ private:
+  void emit(Op op, uint32_t a, uint32_t b = 0, uint32_t c = 0) {
+    Instr ins;
+    ins.op = op;
+    ins.a = a;
+    ins.b = b;
+    ins.c = c;
+    fn_.code.push_back(ins);
+  }
+
+  uint32_t here() const { return static_cast<uint32_t>(fn_.code.size()); }
+
+  // For each value, the register above base_ it can live in, or kNoArg.
+  // An argument can be computed straight into its place, if nothing else
+  // uses it and no call comes between, since calls write those registers.
+  // A call's result can stay where it lands, if its only use comes before
+  // anything else writes there.
+  std::vector<uint32_t> arguments() const {
+    std::vector<uint32_t> uses(ssa_.values.size(), 0);
+    for (auto &b : ssa_.blocks) {
+      for (uint32_t v : b.code) {
+        for (uint32_t arg : ssa_.values[v].args) {
+          ++uses[arg];
+        }
+      }
+      if (b.jump != SsaBlock::kGoto) {
+        ++uses[b.value];
+      }
+    }
+    auto call = [this](uint32_t v) {
+      return ssa_.values[v].op == kSsaCall || ssa_.values[v].op == kSsaNative;
+    };
+
+    std::vector<uint32_t> args(ssa_.values.size(), kNoArg);
+    // The stretch of code between calls each value was defined in.
+    std::vector<uint32_t> since(ssa_.values.size(), 0);
+    uint32_t stretch = 0;
+    for (auto &b : ssa_.blocks) {
+      ++stretch;
+      for (uint32_t v : b.code) {
+        auto &ins = ssa_.values[v];
+        if (!call(v)) {
+          if (ins.op != kSsaParam && ins.op != kSsaPhi) {
+            since[v] = stretch;
+          }
+          continue;
+        }
+        for (uint32_t idx = 0; idx < ins.args.size(); ++idx) {
+          uint32_t arg = ins.args[idx];
+          if (since[arg] == stretch && uses[arg] == 1) {
+            args[arg] = idx;
+          }
+        }
+        ++stretch;
+      }
+
+      for (size_t i = 0; i < b.code.size(); ++i) {
+        uint32_t r = b.code[i];
+        if (!call(r) || uses[r] != 1) {
+          continue;
+        }
+        bool used = b.jump != SsaBlock::kGoto && b.value == r;
+        for (size_t j = i + 1; j < b.code.size(); ++j) {
+          uint32_t v = b.code[j];
+          auto &vargs = ssa_.values[v].args;
+          if (std::find(vargs.begin(), vargs.end(), r) != vargs.end()) {
+            // A call moves its first argument in before the others.
+            used = !call(v) || vargs[0] == r;
+            break;
+          }
+          if (call(v) || args[v] == 0) {
+            used = false;
+            break;
+          }
+        }
+        if (used) {
+          args[r] = 0;
+        }
+      }
+    }
+    return args;
+  }
+
+  // Jmp, or JmpF on a, to the start of block.
+  void jump(Op op, uint32_t block, uint32_t a = 0) {
+    fixups_.emplace_back(here(), block);
+    emit(op, a);
+  }
+
+  void block(uint32_t idx) {
+    const SsaBlock &b = ssa_.blocks[idx];
+    bool tail = ssa_.tail(b);
+    for (uint32_t v : b.code) {
+      instr(v, tail && v == b.value);
+    }
+    uint32_t next = idx + 1;
+    switch (b.jump) {
+      case SsaBlock::kGoto: {
+        const SsaBlock &succ = ssa_.blocks[b.succ[0]];
+        size_t from = std::find(succ.preds.begin(), succ.preds.end(), idx) -
+                      succ.preds.begin();
+        for (uint32_t v : succ.code) {
+          auto &ins = ssa_.values[v];
+          if (ins.op == kSsaPhi) {
+            mov(reg_[v], reg_[ins.args[from]]);
+          }
+        }
+        if (b.succ[0] != next) {
+          jump(kOpJmp, b.succ[0]);
+        }
+        break;
+      }
+      case SsaBlock::kBranch:
+        jump(ssa_.values[b.value].type == Type::kInt ? kOpJmpZ : kOpJmpF,
+             b.succ[1], reg_[b.value]);
+        if (b.succ[0] != next) {
+          jump(kOpJmp, b.succ[0]);
+        }
+        break;
+      case SsaBlock::kReturn:
+        if (!tail) {
+          emit(kOpRet, reg_[b.value]);
+        }
+        break;
+    }
+  }
+
+  void mov(uint32_t dst, uint32_t src) {
+    if (dst != src) {
+      emit(kOpMov, dst, src);
+    }
+  }
+
+  // A tail call replaces the function's Ret.
+  void instr(uint32_t v, bool tail) {
+    const SsaInstr &ins = ssa_.values[v];
+    uint32_t dst = reg_[v];
+    auto arg = [&](size_t idx) { return reg_[ins.args[idx]]; };
+    // The int form of an operator, by the type of its operands.
+    auto op = [&](Op op) {
+      bool ints = ssa_.values[ins.args[0]].type == Type::kInt;
+      return ints ? static_cast<Op>(op + kOpAddI - kOpAdd) : op;
+    };
+    switch (ins.op) {
+      case kSsaParam:
+      case kSsaPhi:
+        return;
+      case kSsaConst: emit(kOpLoadK, dst, ins.k); return;
+      case kSsaCopy: mov(dst, arg(0)); return;
+      case kSsaAdd: emit(op(kOpAdd), dst, arg(0), arg(1)); return;
+      case kSsaSub: emit(op(kOpSub), dst, arg(0), arg(1)); return;
+      case kSsaMul: emit(op(kOpMul), dst, arg(0), arg(1)); return;
+      case kSsaDiv: emit(op(kOpDiv), dst, arg(0), arg(1)); return;
+      case kSsaLt: emit(op(kOpLt), dst, arg(0), arg(1)); return;
+      case kSsaLe: emit(op(kOpLe), dst, arg(0), arg(1)); return;
+      case kSsaGt: emit(op(kOpGt), dst, arg(0), arg(1)); return;
+      case kSsaGe: emit(op(kOpGe), dst, arg(0), arg(1)); return;
+      case kSsaEq: emit(op(kOpEq), dst, arg(0), arg(1)); return;
+      case kSsaToInt: emit(kOpToInt, dst, arg(0)); return;
+      case kSsaToDouble: emit(kOpToDouble, dst, arg(0)); return;
+      case kSsaSqrt: emit(kOpSqrt, dst, arg(0)); return;
+      case kSsaSin: emit(kOpSin, dst, arg(0)); return;
+      case kSsaPow: emit(kOpPow, dst, arg(0), arg(1)); return;
+      case kSsaCall:
+      case kSsaNative:
+        break;
+    }
+
+    // Link() checked the arity, so the arguments fill the callee's
+    // parameters exactly.
+    uint32_t nargs = ins.args.size();
+    for (uint32_t idx = 0; idx < nargs; ++idx) {
+      mov(base_ + idx, arg(idx));
+    }
+    if (ins.op == kSsaNative) {
+      emit(kOpNative, base_, nargs, module_->import(ins.native));
+    }
+    else {
+      emit(tail ? kOpTailCall : kOpCall, base_, nargs,
+           module_->index(ins.callee));
+    }
+    if (!tail) {
+      mov(dst, base_);
+    }
+  }
+
+ private:
+  static constexpr uint32_t kMaxRegs = 1 << 24;
+  static constexpr uint32_t kNoArg = UINT32_MAX;
+
+  Module *module_;
+  FunctionExpr *func_;
+  SsaFunction ssa_;
+  BytecodeFunction fn_;
+
+  // The register of each value.
+  std::vector<uint32_t> reg_;
+  // Where call arguments go.
+  uint32_t base_{0};
+  // Jumps to patch: (pc, target block).
+  std::vector<std::pair<uint32_t, uint32_t>> fixups_;
+};
+
+uint32_t Module::index(FunctionExpr *func) {
+  if (func->code_ < 0) {
+    func->code_ = static_cast<int>(funcs_.size());
+    funcs_.emplace_back();
+    pending_.push_back(func);
+  }
+  return func->code_;
+}
+
+uint32_t Module::import(const Native *native) {
+  for (size_t idx = 0; idx < imports_.size(); ++idx) {
+    if (imports_[idx] == native) {
+      return static_cast<uint32_t>(idx);
+    }
+  }
+  imports_.push_back(native);
+  return static_cast<uint32_t>(imports_.size() - 1);
+}
+
+uint32_t Module::compile(FunctionExpr *func) {
+  uint32_t idx = index(func);
+  drain();
+  return idx;
+}
+
+void Module::recompile(FunctionExpr *func) {
+  if (func->code_ < 0) {
+    compile(func);
+    return;
+  }
+  pending_.push_back(func);
+  drain();
+}
+
+void Module::drain() {
+  while (!pending_.empty()) {
+    FunctionExpr *next = pending_.back();
+    pending_.pop_back();
+    BytecodeFunction fn = Compiler(this, next).compile();
+    funcs_[next->code_] = std::move(fn);
+  }
+}
+
+void Module::dump(FILE *fp) const {
+  for (size_t idx = 0; idx < funcs_.size(); ++idx) {
+    auto &fn = funcs_[idx];
+    fprintf(fp, "%zu %s: params %u, regs %u\n", idx,
+            symbols().name(fn.name).c_str(), fn.nparams, fn.nregs);
+    for (size_t pc = 0; pc < fn.code.size(); ++pc) {
+      auto &ins = fn.code[pc];
+      fprintf(fp, "  %4zu %-6s %u %u %u", pc, kOpNames[ins.op], ins.a, ins.b,
+              ins.c);
+      if (ins.op == kOpLoadK) {
+        fprintf(fp, "  ; %g", constants()[ins.b]);
+      }
+      fprintf(fp, "\n");
+    }
+  }
+}
+
+double Interpreter::run(uint32_t func, const double *args, size_t nargs) {
+  const BytecodeFunction *fn = &module_->function(func);
+  size_t entry = frames_.size();
+  // Above whatever the stack already holds, e.g. a tree walker's frames.
+  double *R = stack_->top();
+  stack_->reserve(R, fn->nregs);
+  for (size_t idx = 0; idx < fn->nparams; ++idx) {
+    R[idx] = idx < nargs ? args[idx] : 0;
+  }
+  MemoTable *memo = memo_ ? memo_[func] : nullptr;
+  MemoTable::Ticket ticket{0, 0};
+  double cached;
+  if (memo && memo->lookup(R, &cached, &ticket)) {
+    return cached;
+  }
+
+  const double *K = constants().data();
+  const Instr *pc = fn->code.data();
+  const BytecodeFunction *funcs = module_->functions().data();
+
+#ifdef SMCC_COMPUTED_GOTO
+  static void *const kLabels[] = {
+#define SMCC_OP_LABEL(name) &&op_##name,
+    SMCC_OPS(SMCC_OP_LABEL)
+#undef SMCC_OP_LABEL
+  };
+#define VM_CASE(name) op_##name:
+#define VM_NEXT() goto *kLabels[pc->op]
+#define VM_BEGIN() VM_NEXT();
+#define VM_END()
+#else
+#define VM_CASE(name) case kOp##name:
+#define VM_NEXT() goto dispatch
+#define VM_BEGIN() dispatch: switch (pc->op) {
+#define VM_END() }
+#endif
+
+#define VM_BINARY(name, expr)            \
+  VM_CASE(name) {                        \
+    double lhs = R[pc->b];               \
+    double rhs = R[pc->c];               \
+    R[pc->a] = (expr);                   \
+    ++pc;                                \
+    VM_NEXT();                           \
+  }
+
+  VM_BEGIN()
+
+  VM_CASE(LoadK) {
+    R[pc->a] = K[pc->b];
+    ++pc;
+    VM_NEXT();
+  }
+
+  VM_CASE(Mov) {
+    R[pc->a] = R[pc->b];
+    ++pc;
+    VM_NEXT();
+  }
+
+#define VM_IBINARY(name, expr)           \
+  VM_CASE(name) {                        \
+    int64_t lhs = BitsInt(R[pc->b]);     \
+    int64_t rhs = BitsInt(R[pc->c]);     \
+    R[pc->a] = IntBits(expr);            \
+    ++pc;                                \
+    VM_NEXT();                           \
+  }
+
+  VM_BINARY(Add, lhs + rhs)
+  VM_BINARY(Sub, lhs - rhs)
+  VM_BINARY(Mul, lhs * rhs)
+  VM_BINARY(Div, lhs / rhs)
+  VM_BINARY(Lt, IntBits(lhs < rhs))
+  VM_BINARY(Le, IntBits(lhs <= rhs))
+  VM_BINARY(Gt, IntBits(lhs > rhs))
+  VM_BINARY(Ge, IntBits(lhs >= rhs))
+  VM_BINARY(Eq, IntBits(lhs == rhs))
+  VM_BINARY(Pow, std::pow(lhs, rhs))
+  VM_IBINARY(AddI, IntAdd(lhs, rhs))
+  VM_IBINARY(SubI, IntSub(lhs, rhs))
+  VM_IBINARY(MulI, IntMul(lhs, rhs))
+  VM_IBINARY(DivI, IntDiv(lhs, rhs))
+  VM_IBINARY(LtI, lhs < rhs)
+  VM_IBINARY(LeI, lhs <= rhs)
+  VM_IBINARY(GtI, lhs > rhs)
+  VM_IBINARY(GeI, lhs >= rhs)
+  VM_IBINARY(EqI, lhs == rhs)
+
+  VM_CASE(ToInt) {
+    R[pc->a] = IntBits(TruncInt(R[pc->b]));
+    ++pc;
+    VM_NEXT();
+  }
+
+  VM_CASE(ToDouble) {
+    R[pc->a] = static_cast<double>(BitsInt(R[pc->b]));
+    ++pc;
+    VM_NEXT();
+  }
+
+  VM_CASE(Jmp) {
+    pc = fn->code.data() + pc->b;
+    VM_NEXT();
+  }
+
+  VM_CASE(JmpF) {
+    if (R[pc->a] == 0) {
+      pc = fn->code.data() + pc->b;
+    }
+    else {
+      ++pc;
+    }
+    VM_NEXT();
+  }
+
+  VM_CASE(JmpZ) {
+    if (BitsInt(R[pc->a]) == 0) {
+      pc = fn->code.data() + pc->b;
+    }
+    else {
+      ++pc;
+    }
+    VM_NEXT();
+  }
+
+  VM_CASE(Call) {
+    MemoTable *callee_memo = memo_ ? memo_[pc->c] : nullptr;
+    MemoTable::Ticket callee_ticket{0, 0};
+    if (callee_memo &&
+        callee_memo->lookup(R + pc->a, R + pc->a, &callee_ticket)) {
+      ++pc;
+      VM_NEXT();
+    }
+    frames_.push_back({fn, pc + 1, R, callee_memo, callee_ticket});
+    R += pc->a;
+    fn = funcs + pc->c;
+    stack_->reserve(R, fn->nregs);
+    pc = fn->code.data();
+    VM_NEXT();
+  }
+
+  VM_CASE(TailCall) {
+    // The arguments replace this frame's parameters; no frame is pushed.
+    const double *args = R + pc->a;
+    for (uint32_t idx = 0; idx < pc->b; ++idx) {
+      R[idx] = args[idx];
+    }
+    fn = funcs + pc->c;
+    stack_->reserve(R, fn->nregs);
+    pc = fn->code.data();
+    VM_NEXT();
+  }
+
+  VM_CASE(Native) {
+    R[pc->a] = module_->imports()[pc->c]->call(R + pc->a);
+    ++pc;
+    VM_NEXT();
+  }
+
+  VM_CASE(Sqrt) {
+    R[pc->a] = std::sqrt(R[pc->b]);
+    ++pc;
+    VM_NEXT();
+  }
+
+  VM_CASE(Sin) {
+    R[pc->a] = std::sin(R[pc->b]);
+    ++pc;
+    VM_NEXT();
+  }
+
+  VM_CASE(Ret) {
+    // The callee's frame starts at the caller's destination register.
+    double value = R[pc->a];
+    if (frames_.size() == entry) {
+      if (memo) {
+        memo->fill(ticket, value);
+      }
+      return value;
+    }
+    R[0] = value;
+    Frame &frame = frames_.back();
+    if (frame.memo) {
+      frame.memo->fill(frame.ticket, value);
+    }
+    fn = frame.fn;
+    pc = frame.pc;
+    R = frame.regs;
+    frames_.pop_back();
+    VM_NEXT();
+  }
+
+  VM_END()
+
+#undef VM_BINARY
+#undef VM_IBINARY
+#undef VM_CASE
+#undef VM_NEXT
+#undef VM_BEGIN
+#undef VM_END
+
+  return 0;
+}
+
+}  // namespace smcc
@@ -0,0 +1,166 @@
+// Copyright (c) 2020 smarsufan. All Rights Reserved.
+
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "expr.h"
+#include "memo.h"
+#include "native.h"
+#include "stack.h"
+#include "symbol.h"
+
+namespace smcc {
+
+// Every opcode, in dispatch table order.
+#define SMCC_OPS(X) \
+  X(LoadK)          \
+  X(Mov)            \
+  X(Add)            \
+  X(Sub)            \
+  X(Mul)            \
+  X(Div)            \
+  X(Lt)             \
+  X(Le)             \
+  X(Gt)             \
+  X(Ge)             \
+  X(Eq)             \
+  X(AddI)           \
+  X(SubI)           \
+  X(MulI)           \
+  X(DivI)           \
+  X(LtI)            \
+  X(LeI)            \
+  X(GtI)            \
+  X(GeI)            \
+  X(EqI)            \
+  X(ToInt)          \
+  X(ToDouble)       \
+  X(Jmp)            \
+  X(JmpF)           \
+  X(JmpZ)           \
+  X(Call)           \
+  X(TailCall)       \
+  X(Native)         \
+  X(Sqrt)           \
+  X(Sin)            \
+  X(Pow)            \
+  X(Ret)
+
+enum Op : uint8_t {
+#define SMCC_OP_ENUM(name) kOp##name,
+  SMCC_OPS(SMCC_OP_ENUM)
+#undef SMCC_OP_ENUM
+  kOpCount,
+};
+
+/// One register instruction. Registers are slots of the function's frame:
+/// parameters first, then locals, then temporaries. They hold doubles or
+/// the bits of ints (see value.h); the opcode says which.
+///
+///   LoadK  a, k       R[a] = K[k], K being constants()
+///   Mov    a, b       R[a] = R[b]
+///   Add    a, b, c    R[a] = R[b] + R[c]    (and Sub ... Eq, which give
+///                                            the int 1 or 0)
+///   AddI   a, b, c    the same on ints      (and SubI ... EqI)
+///   ToInt  a, b       R[a] = int(R[b])      (and ToDouble)
+///   Jmp    k          pc = k
+///   JmpF   a, k       if (R[a] == 0) pc = k
+///   JmpZ   a, k       the same for an int
+///   Call   a, n, f    R[a] = f(R[a], ..., R[a + n - 1])
+///   TailCall a, n, f  return f(R[a], ..., R[a + n - 1]), in this frame
+///   Native a, n, i    R[a] = imports[i](R[a], ..., R[a + n - 1])
+///   Sqrt   a, b       R[a] = sqrt(R[b])     (and Sin)
+///   Pow    a, b, c    R[a] = pow(R[b], R[c])
+///   Ret    a          return R[a]
+struct Instr {
+  uint32_t op : 8;
+  uint32_t a : 24;
+  uint32_t b;
+  uint32_t c;
+};
+
+struct BytecodeFunction {
+  Symbol name{kNoSymbol};
+  uint32_t nparams{0};
+  // Frame size: parameters, locals and temporaries.
+  uint32_t nregs{0};
+  std::vector<Instr> code;
+};
+
+/// Compiled functions. A callee's frame starts at the caller's argument
+/// registers, so calls copy nothing.
+class Module {
+ public:
+  // Compile func and everything it calls. Returns its index.
+  uint32_t compile(FunctionExpr *func);
+
+  // Compile func again into its code_, e.g. once a Session has reparsed
+  // it, along with whatever new it calls.
+  void recompile(FunctionExpr *func);
+
+  const BytecodeFunction &function(uint32_t idx) const { return funcs_[idx]; }
+
+  const std::vector<BytecodeFunction> &functions() const { return funcs_; }
+
+  // Host functions called by Native, by import index.
+  const std::vector<const Native *> &imports() const { return imports_; }
+
+  // Print the bytecode of every function.
+  void dump(FILE *fp) const;
+
+ private:
+  friend class Compiler;
+  friend class Image;
+
+  // The index func compiles to; queues it if it is new.
+  uint32_t index(FunctionExpr *func);
+
+  // The import index of native.
+  uint32_t import(const Native *native);
+
+  // Compile everything queued.
+  void drain();
+
+ private:
+  std::vector<BytecodeFunction> funcs_;
+  std::vector<const Native *> imports_;
+  std::vector<FunctionExpr *> pending_;
+};
+
+/// The bytecode interpreter. Dispatch is threaded through computed goto
+/// where the compiler supports it, a switch otherwise.
+class Interpreter {
+ public:
+  // Register windows go on stack, above its top.
+  Interpreter(const Module *module, Stack *stack)
+      : module_(module), stack_(stack) {}
+
+  double run(uint32_t func, const double *args, size_t nargs);
+
+  // Caches by function index, nullptr for none; calls to a function with
+  // a cache are looked up in it first.
+  void set_memo(MemoTable *const *memo) { memo_ = memo; }
+
+ private:
+  struct Frame {
+    const BytecodeFunction *fn;
+    const Instr *pc;
+    double *regs;
+    // Where the result goes when the call returns, if it is cached.
+    MemoTable *memo;
+    MemoTable::Ticket ticket;
+  };
+
+ private:
+  const Module *module_{nullptr};
+  // Register windows of the active calls; frames never move.
+  Stack *stack_{nullptr};
+  std::vector<Frame> frames_;
+  MemoTable *const *memo_{nullptr};
+};
+
+}  // namespace smcc
@@ -0,0 +1,156 @@
+// Copyright (c) 2020 smarsufan. All Rights Reserved.
+
+#include "check.h"
+
+#include "ast.h"
+
+namespace smcc {
+
+namespace {
+
+Type Declared(int token) {
+  return token == tok_int ? Type::kInt : Type::kDouble;
+}
+
+// A literal that becomes an int next to one.
+bool Integral(Expr *expr) {
+  auto num = expr_cast<NumberExpr>(expr);
+  return num && num->integral_ && num->type_ == Type::kDouble;
+}
+
+bool Comparison(int tok) {
+  return tok == tok_less || tok == tok_lessequal || tok == tok_great ||
+         tok == tok_greatequal || tok == tok_equal;
+}
+
+class Checker {
+ public:
+  explicit Checker(Arena *arena) : arena_(arena) {}
+
+  void run(const std::vector<Expr *> &exprs) {
+    // Calls may come before the callee, so every signature goes first.
+    for (auto expr : exprs) {
+      if (auto func = expr_cast<FunctionExpr>(expr)) {
+        func->type_ = func->proto_->type_ = Declared(func->proto_->token_);
+        func->ints_ = func->type_ == Type::kInt;
+        for (auto arg : func->proto_->args_) {
+          func->ints_ = func->ints_ || arg->type_ == Type::kInt;
+        }
+      }
+      else if (auto proto = expr_cast<PrototypeExpr>(expr)) {
+        external(proto);
+      }
+    }
+    for (auto expr : exprs) {
+      if (auto func = expr_cast<FunctionExpr>(expr)) {
+        func_ = func;
+        body(func->body_);
+      }
+    }
+  }
+
+ private:
+  void external(PrototypeExpr *proto) {
+    bool ints = proto->token_ == tok_int;
+    for (auto arg : proto->args_) {
+      ints = ints || arg->token_ == tok_int;
+    }
+    if (ints) {
+      fprintf(stderr, "check -100: extern %s must take and return double\n",
+              symbols().name(proto->name_).c_str());
+      abort();
+    }
+  }
+
+  void body(const ExprList &exprs) {
+    for (auto expr : exprs) {
+      statement(expr);
+    }
+  }
+
+  void statement(Expr *expr) {
+    if (auto ret = expr_cast<ReturnExpe>(expr)) {
+      value(ret->expr_);
+      auto call = expr_cast<CallExpr>(ret->expr_);
+      ret->expr_ = convert(ret->expr_, func_->type_);
+      if (call && ret->expr_ != call) {
+        call->tail_ = false;
+      }
+    }
+    else if (auto cond = expr_cast<IfExpr>(expr)) {
+      value(cond->cond_);
+      body(cond->body_);
+      body(cond->other_);
+    }
+    else {
+      value(expr);
+    }
+  }
+
+  void value(Expr *expr) {
+    if (auto bin = expr_cast<BinaryExpr>(expr)) {
+      binary(bin);
+    }
+    else if (auto call = expr_cast<CallExpr>(expr)) {
+      this->call(call);
+    }
+    // Variables have their type from Resolve(), literals start as
+    // doubles.
+  }
+
+  void binary(BinaryExpr *bin) {
+    value(bin->lhs_);
+    value(bin->rhs_);
+    if (bin->tok_ == tok_assign) {
+      bin->rhs_ = convert(bin->rhs_, bin->lhs_->type_);
+      bin->type_ = bin->lhs_->type_;
+      return;
+    }
+    Type lhs = bin->lhs_->type_;
+    Type rhs = bin->rhs_->type_;
+    Type type = (lhs == Type::kInt || Integral(bin->lhs_)) &&
+                        (rhs == Type::kInt || Integral(bin->rhs_)) &&
+                        (lhs == Type::kInt || rhs == Type::kInt)
+                    ? Type::kInt
+                    : Type::kDouble;
+    bin->lhs_ = convert(bin->lhs_, type);
+    bin->rhs_ = convert(bin->rhs_, type);
+    bin->type_ = Comparison(bin->tok_) ? Type::kInt : type;
+  }
+
+  void call(CallExpr *call) {
+    for (size_t idx = 0; idx < call->args_.size(); ++idx) {
+      Expr *&arg = call->args_[idx];
+      value(arg);
+      Type param = call->callee_ ? call->callee_->proto_->args_[idx]->type_
+                                 : Type::kDouble;
+      arg = convert(arg, param);
+    }
+    call->type_ = call->callee_ ? call->callee_->type_ : Type::kDouble;
+  }
+
+  Expr *convert(Expr *expr, Type type) {
+    if (expr->type_ == type) {
+      return expr;
+    }
+    if (Integral(expr) && type == Type::kInt) {
+      int64_t value = static_cast<NumberExpr *>(expr)->int_val_;
+      auto num = arena_->make<NumberExpr>(constants().intern(IntBits(value)));
+      num->type_ = Type::kInt;
+      return num;
+    }
+    return arena_->make<CastExpr>(expr, type);
+  }
+
+ private:
+  Arena *arena_;
+  FunctionExpr *func_{nullptr};
+};
+
+}  // namespace
+
+void Check(const std::vector<Expr *> &exprs, Arena *arena) {
+  Checker(arena).run(exprs);
+}
+
+}  // namespace smcc
@@ -0,0 +1,25 @@
+// Copyright (c) 2020 smarsufan. All Rights Reserved.
+
+#pragma once
+#include <vector>
+
+#include "arena.h"
+#include "expr.h"
+
+namespace smcc {
+
+/// Give every node of a linked program its static type_, and make each
+/// conversion a CastExpr, so that no backend has to work types out.
+///
+/// A variable has the type it is declared with and a function returns the
+/// one before its name; builtins and externs take and return double. An
+/// operator works on ints when both operands are ints, on doubles
+/// otherwise, and a comparison gives the int 1 or 0. A literal written
+/// without a point is an int next to an int and a double anywhere else.
+/// Arguments, assigned and returned values convert to the type they go
+/// to: int to double rounding past 2^53, double to int toward zero (see
+/// TruncInt()). A tail call whose result must convert is no longer one.
+/// New nodes go in arena.
+void Check(const std::vector<Expr *> &exprs, Arena *arena);
+
+}  // namespace smcc
@@ -1,7 +1,221 @@
 // Copyright (c) 2020 smarsufan. All Rights Reserved.
 
 #include "codegen.h"
+
+#include <cinttypes>
+#include <cstdarg>
+
 #include "expr.h"
 
 namespace smcc {
+
+namespace {
+
+// The 64-bit name of general purpose register reg.
+const char *Reg(int reg) {
+  static const char *const kNames[] = {
+    "rax", "rcx", "rdx", "rbx", "rsp", "rbp", "rsi", "rdi",
+    "r8",  "r9",  "r10", "r11", "r12", "r13", "r14", "r15",
+  };
+  return kNames[reg];
+}
+
+// The suffix of jcc and setcc for cond.
+const char *CondName(X64Assembler::Cond cond) {
+  switch (cond) {
+    case X64Assembler::kB: return "b";
+    case X64Assembler::kE: return "e";
+    case X64Assembler::kNE: return "ne";
+    case X64Assembler::kBE: return "be";
+    case X64Assembler::kP: return "p";
+    case X64Assembler::kL: return "l";
+    case X64Assembler::kGE: return "ge";
+    case X64Assembler::kLE: return "le";
+    case X64Assembler::kG: return "g";
+  }
+  return "";
+}
+
+}  // namespace
+
+CodeGen::CodeGen(FILE *out, std::string prefix)
+    : out_(out), prefix_(std::move(prefix)) {}
+
+void CodeGen::emit(const Program &program) {
+  for (auto expr : program.toplevel()) {
+    if (auto func = expr_cast<FunctionExpr>(expr)) {
+      emit(func);
+    }
+  }
+  finish();
+}
+
+void CodeGen::emit(FunctionExpr *func) {
+  LowerX64(func, this);
+}
+
+void CodeGen::finish() {
+  constants().write_rodata(out_, ks_.data(), ks_.size());
+  fprintf(out_, "\t.section\t.note.GNU-stack,\"\",@progbits\n");
+}
+
+void CodeGen::ins(const char *fmt, ...) {
+  char buf[256];
+  va_list ap;
+  va_start(ap, fmt);
+  vsnprintf(buf, sizeof(buf), fmt, ap);
+  va_end(ap);
+  code_ += '\t';
+  code_ += buf;
+  code_ += '\n';
+}
+
+std::string CodeGen::name(FunctionExpr *func) const {
+  return prefix_ + symbols().name(func->proto_->name_);
+}
+
+void CodeGen::begin(FunctionExpr *func) {
+  // The body is kept until end(), which knows the frame size.
+  code_.clear();
+}
+
+void CodeGen::end(FunctionExpr *func, int frame) {
+  std::string name = this->name(func);
+  fprintf(out_, "\t.text\n");
+  fprintf(out_, "\t.globl\t%s\n", name.c_str());
+  fprintf(out_, "\t.type\t%s, @function\n", name.c_str());
+  fprintf(out_, "\t.p2align\t4\n");
+  fprintf(out_, "%s:\n", name.c_str());
+  fprintf(out_, "\tpushq\t%%rbp\n");
+  fprintf(out_, "\tmovq\t%%rsp, %%rbp\n");
+  if (frame) {
+    fprintf(out_, "\tsubq\t$%d, %%rsp\n", frame);
+  }
+  fputs(code_.c_str(), out_);
+  fprintf(out_, "\t.size\t%s, .-%s\n\n", name.c_str(), name.c_str());
+}
+
+void CodeGen::load(int xmm, int disp) {
+  ins("movsd\t%d(%%rbp), %%xmm%d", disp, xmm);
+}
+
+void CodeGen::store(int disp, int xmm) {
+  ins("movsd\t%%xmm%d, %d(%%rbp)", xmm, disp);
+}
+
+void CodeGen::constant(int xmm, double value) {
+  uint32_t k = constants().intern(value);
+  if (seen_.insert(k).second) {
+    ks_.push_back(k);
+  }
+  ins("movsd\t%s(%%rip), %%xmm%d", ConstantPool::label(k).c_str(), xmm);
+}
+
+void CodeGen::sse(Sse op, int dst, int src) {
+  static const char *const kNames[] = {
+    "addsd", "subsd", "mulsd", "divsd", "movapd", "andpd", "pxor", "ucomisd",
+    "sqrtsd",
+  };
+  ins("%s\t%%xmm%d, %%xmm%d", kNames[op], src, dst);
+}
+
+void CodeGen::cmpsd(Pred pred, int dst, int src) {
+  static const char *const kNames[] = {"cmpeqsd", "cmpltsd", "cmplesd"};
+  ins("%s\t%%xmm%d, %%xmm%d", kNames[pred], src, dst);
+}
+
+void CodeGen::load_int(int reg, int disp) {
+  ins("movq\t%d(%%rbp), %%%s", disp, Reg(reg));
+}
+
+void CodeGen::store_int(int disp, int reg) {
+  ins("movq\t%%%s, %d(%%rbp)", Reg(reg), disp);
+}
+
+void CodeGen::constant_int(int reg, int64_t value) {
+  if (value >= INT32_MIN && value <= INT32_MAX) {
+    ins("movq\t$%" PRId64 ", %%%s", value, Reg(reg));
+  }
+  else {
+    ins("movabsq\t$%" PRId64 ", %%%s", value, Reg(reg));
+  }
+}
+
+void CodeGen::alu(Alu op, int dst, int src) {
+  static const char *const kNames[] = {
+    "addq", "subq", "imulq", "cmpq", "testq", "movq",
+  };
+  ins("%s\t%%%s, %%%s", kNames[op], Reg(src), Reg(dst));
+}
+
+void CodeGen::neg(int reg) {
+  ins("negq\t%%%s", Reg(reg));
+}
+
+void CodeGen::idiv(int src) {
+  ins("cqto");
+  ins("idivq\t%%%s", Reg(src));
+}
+
+void CodeGen::setcc(Cond cond) {
+  ins("set%s\t%%al", CondName(cond));
+  ins("movzbq\t%%al, %%rax");
+}
+
+void CodeGen::cvtsi2sd(int xmm, int reg) {
+  ins("cvtsi2sdq\t%%%s, %%xmm%d", Reg(reg), xmm);
+}
+
+void CodeGen::cvttsd2si(int reg, int xmm) {
+  ins("cvttsd2siq\t%%xmm%d, %%%s", xmm, Reg(reg));
+}
+
+void CodeGen::movq(int reg, int xmm) {
+  ins("movq\t%%xmm%d, %%%s", xmm, Reg(reg));
+}
+
+void CodeGen::bind(uint32_t label) {
+  code_ += ".LB" + std::to_string(label) + ":\n";
+}
+
+void CodeGen::jcc(Cond cond, uint32_t label) {
+  ins("j%s\t.LB%u", CondName(cond), label);
+}
+
+void CodeGen::jmp(uint32_t label) {
+  ins("jmp\t.LB%u", label);
+}
+
+void CodeGen::push(int disp) {
+  ins("pushq\t%d(%%rbp)", disp);
+}
+
+void CodeGen::add_rsp(int bytes) {
+  if (bytes < 0) {
+    ins("subq\t$%d, %%rsp", -bytes);
+  }
+  else {
+    ins("addq\t$%d, %%rsp", bytes);
+  }
+}
+
+void CodeGen::call(FunctionExpr *callee) {
+  ins("call\t%s", name(callee).c_str());
+}
+
+void CodeGen::call(const Native *native) {
+  // libm's for the builtins, the host's for externs.
+  ins("call\t%s@PLT", symbols().name(native->name).c_str());
+}
+
+void CodeGen::tail(FunctionExpr *callee) {
+  ins("leave");
+  ins("jmp\t%s", name(callee).c_str());
+}
+
+void CodeGen::ret() {
+  ins("leave");
+  ins("ret");
+}
+
 }  // namespace smcc
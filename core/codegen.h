@@ -1,18 +1,80 @@
 // Copyright (c) 2020 smarsufan. All Rights Reserved.
 
 #pragma once
+#include <cstdint>
+#include <cstdio>
 #include <string>
+#include <unordered_set>
+#include <vector>
 
 #include "expr.h"
 #include "ast.h"
+#include "program.h"
+#include "x64.h"
 
 namespace smcc {
 
-class CodeGen {
+/// Emits GNU as x86-64 code, System V ABI, for script functions.
+///
+/// Every function becomes a global `double <prefix><name>(double, ...)`,
+/// so C can call it; int parameters and results are int64_t. Builtins call libm, externs call the host symbol of
+/// the same name, and literals go in a rodata section from constants().
+class CodeGen : private X64Assembler {
  public:
-  CodeGen() {}
+  explicit CodeGen(FILE *out, std::string prefix = "");
 
-  ~CodeGen() {}
+  // Every function of program, then the constants they use.
+  void emit(const Program &program);
+
+  void emit(FunctionExpr *func);
+
+  // Write the constants used so far; once, after the last function.
+  void finish();
+
+ private:
+  // Append one instruction to the current function.
+  void ins(const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+  std::string name(FunctionExpr *func) const;
+
+  void begin(FunctionExpr *func) override;
+  void end(FunctionExpr *func, int frame) override;
+  void load(int xmm, int disp) override;
+  void store(int disp, int xmm) override;
+  void constant(int xmm, double value) override;
+  void sse(Sse op, int dst, int src) override;
+  void cmpsd(Pred pred, int dst, int src) override;
+  void load_int(int reg, int disp) override;
+  void store_int(int disp, int reg) override;
+  void constant_int(int reg, int64_t value) override;
+  void alu(Alu op, int dst, int src) override;
+  void neg(int reg) override;
+  void idiv(int src) override;
+  void setcc(Cond cond) override;
+  void cvtsi2sd(int xmm, int reg) override;
+  void cvttsd2si(int reg, int xmm) override;
+  void movq(int reg, int xmm) override;
+  uint32_t new_label() override { return labels_++; }
+  void bind(uint32_t label) override;
+  void jcc(Cond cond, uint32_t label) override;
+  void jmp(uint32_t label) override;
+  void push(int disp) override;
+  void add_rsp(int bytes) override;
+  void call(FunctionExpr *callee) override;
+  void call(const Native *native) override;
+  void tail(FunctionExpr *callee) override;
+  void ret() override;
+
+ private:
+  FILE *out_;
+  std::string prefix_;
+  std::string code_;
+  // Labels are numbered across functions, so they never clash.
+  uint32_t labels_{0};
+
+  // Constants referenced, in first-use order.
+  std::vector<uint32_t> ks_;
+  std::unordered_set<uint32_t> seen_;
 };
 
 }  // namespace smcc
@@ -0,0 +1,74 @@
+// Copyright (c) 2020 smarsufan. All Rights Reserved.
+
+#include "constant.h"
+
+#include <cinttypes>
+#include <cstdlib>
+#include <cstring>
+#include <sys/mman.h>
+
+namespace smcc {
+
+ConstantPool::ConstantPool(uint32_t max_constants) : max_(max_constants) {
+  size_t bytes = static_cast<size_t>(max_) * sizeof(double);
+  void *addr = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (addr == MAP_FAILED) {
+    fprintf(stderr, "constant -100: can not reserve %zu bytes\n", bytes);
+    abort();
+  }
+  data_ = static_cast<double *>(addr);
+}
+
+ConstantPool::~ConstantPool() {
+  munmap(data_, static_cast<size_t>(max_) * sizeof(double));
+}
+
+uint32_t ConstantPool::intern(double value) {
+  uint64_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto it = index_.find(bits);
+  if (it != index_.end()) {
+    return it->second;
+  }
+  if (size_ == max_) {
+    fprintf(stderr, "constant -200: more than %u constants\n", max_);
+    abort();
+  }
+  data_[size_] = value;
+  index_.emplace(bits, size_);
+  return size_++;
+}
+
+uint32_t ConstantPool::size() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return size_;
+}
+
+std::string ConstantPool::label(uint32_t k) {
+  return ".LK" + std::to_string(k);
+}
+
+void ConstantPool::write_rodata(FILE *fp, const uint32_t *ks,
+                                size_t n) const {
+  if (n == 0) {
+    return;
+  }
+  fprintf(fp, "\t.section\t.rodata.cst8,\"aM\",@progbits,8\n");
+  fprintf(fp, "\t.p2align\t3\n");
+  for (size_t idx = 0; idx < n; ++idx) {
+    uint64_t bits;
+    memcpy(&bits, &data_[ks[idx]], sizeof(bits));
+    fprintf(fp, "%s:\n", label(ks[idx]).c_str());
+    fprintf(fp, "\t.quad\t0x%016" PRIx64 "\t# %g\n", bits, data_[ks[idx]]);
+  }
+}
+
+ConstantPool &constants() {
+  static ConstantPool pool;
+  return pool;
+}
+
+}  // namespace smcc
@@ -0,0 +1,58 @@
+// Copyright (c) 2020 smarsufan. All Rights Reserved.
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace smcc {
+
+/// Numeric literals, each stored once.
+///
+/// Storage is reserved up front, so a constant never moves once interned:
+/// nodes keep a pointer to their value, the interpreter indexes the pool as
+/// its K array, and CodeGen writes it out as a rodata section.
+class ConstantPool {
+ public:
+  // 128 MiB of address space.
+  static constexpr uint32_t kMaxConstants = 1 << 24;
+
+  ConstantPool(uint32_t max_constants = kMaxConstants);
+
+  ~ConstantPool();
+
+  ConstantPool(const ConstantPool &) = delete;
+
+  ConstantPool &operator=(const ConstantPool &) = delete;
+
+  // The index of value. Constants are told apart by bit pattern, so 0 and
+  // -0 (or two NaNs) stay distinct.
+  uint32_t intern(double value);
+
+  const double *data() const { return data_; }
+
+  double operator[](uint32_t k) const { return data_[k]; }
+
+  uint32_t size() const;
+
+  // Assembler label of constant k.
+  static std::string label(uint32_t k);
+
+  // Write constants ks[0, n) as a GNU as rodata section.
+  void write_rodata(FILE *fp, const uint32_t *ks, size_t n) const;
+
+ private:
+  mutable std::mutex mutex_;
+  double *data_{nullptr};
+  uint32_t size_{0};
+  uint32_t max_{0};
+  std::unordered_map<uint64_t, uint32_t> index_;
+};
+
+// The process-wide constant pool.
+ConstantPool &constants();
+
+}  // namespace smcc
@@ -0,0 +1,105 @@
+// Copyright (c) 2020 smarsufan. All Rights Reserved.
+
+#include "context.h"
+
+namespace smcc {
+
+namespace {
+
+// Host arguments, missing ones 0, as the values of func's parameters.
+std::vector<double> Values(const FunctionExpr *func, const double *args,
+                           size_t nargs) {
+  auto &params = func->proto_->args_;
+  std::vector<double> values(params.size());
+  for (size_t idx = 0; idx < values.size(); ++idx) {
+    values[idx] = FromHost(params[idx]->type_, idx < nargs ? args[idx] : 0);
+  }
+  return values;
+}
+
+}  // namespace
+
+Context::Context(const Program *program)
+    : program_(program), interp_(&program->module(), &stack_) {
+}
+
+FunctionExpr *Context::find(const std::string &name) const {
+  FunctionExpr *func = program_->function(name);
+  if (!func) {
+    fprintf(stderr, "context -100: undefined function %s\n", name.c_str());
+    abort();
+  }
+  return func;
+}
+
+void Context::memoize(const std::string &name, size_t entries) {
+  FunctionExpr *func = find(name);
+  if (!func->pure_) {
+    fprintf(stderr, "context -300: %s calls externs, so it can not be "
+            "memoized\n", name.c_str());
+    abort();
+  }
+  if (memo_.empty()) {
+    tables_.resize(program_->module().functions().size());
+    memo_.resize(tables_.size(), nullptr);
+    interp_.set_memo(memo_.data());
+  }
+  tables_[func->code_].reset(
+      new MemoTable(func->proto_->args_.size(), entries));
+  memo_[func->code_] = tables_[func->code_].get();
+}
+
+MemoStats Context::memo_stats(const std::string &name) const {
+  FunctionExpr *func = find(name);
+  if (memo_.empty() || !memo_[func->code_]) {
+    return MemoStats();
+  }
+  return memo_[func->code_]->stats();
+}
+
+void Context::overflow(FunctionExpr *func) const {
+  fprintf(stderr, "context -200: call stack overflow in %s\n",
+          symbols().name(func->proto_->name_).c_str());
+  abort();
+}
+
+double Context::eval(const std::string &name,
+                     const std::vector<double> &args) {
+  return eval(find(name), args.data(), args.size());
+}
+
+double Context::call(const std::string &name,
+                     const std::vector<double> &args) {
+  return call(find(name), args.data(), args.size());
+}
+
+void Context::tail(CallExpr *call) {
+  size_t nargs = call->args_.size();
+  double *args = stack_.push(nargs);
+  for (size_t idx = 0; idx < nargs; ++idx) {
+    args[idx] = call->args_[idx]->run(*this);
+  }
+  tail_ = call->callee_;
+  tail_args_ = args;
+}
+
+double Context::eval(FunctionExpr *func, const double *args, size_t nargs) {
+  native_limit_ = NativeStackFloor();
+  if (func->ints_) {
+    std::vector<double> values = Values(func, args, nargs);
+    const double *v = values.data();
+    double value =
+        invoke(func, values.size(), [v](size_t idx) { return v[idx]; });
+    return ToHost(func->type_, value);
+  }
+  return invoke(func, nargs, [args](size_t idx) { return args[idx]; });
+}
+
+double Context::convert(const FunctionExpr *func, const double *args,
+                        size_t nargs) {
+  std::vector<double> values = Values(func, args, nargs);
+  double value = interp_.run(func->code_, values.data(), values.size());
+  return ToHost(func->type_, value);
+}
+
+}  // namespace smcc
@@ -0,0 +1,145 @@
+// Copyright (c) 2020 smarsufan. All Rights Reserved.
+
+#pragma once
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "bytecode.h"
+#include "memo.h"
+#include "program.h"
+#include "stack.h"
+
+namespace smcc {
+
+/// What a thread needs to run a Program: the value stack and the state of
+/// both backends. Contexts are cheap, since the stack is only committed as
+/// it is touched; make one per thread and reuse it.
+class Context {
+ public:
+  explicit Context(const Program *program);
+
+  Context(const Context &) = delete;
+
+  Context &operator=(const Context &) = delete;
+
+  const Program *program() const { return program_; }
+
+  // Run name by walking its tree; the reference for the other backends.
+  double eval(const std::string &name, const std::vector<double> &args);
+
+  // Run name in the bytecode interpreter.
+  double call(const std::string &name, const std::vector<double> &args);
+
+  // Arguments and results are host doubles; where func takes or returns
+  // an int, they convert as FromHost() and ToHost() do.
+  double eval(FunctionExpr *func, const double *args, size_t nargs);
+
+  double call(const FunctionExpr *func, const double *args, size_t nargs) {
+    if (func->ints_) {
+      return convert(func, args, nargs);
+    }
+    return interp_.run(func->code_, args, nargs);
+  }
+
+  // call() on values of func's own types, ints as their bits, giving one
+  // of its return type; how other engines call into this one.
+  double run(const FunctionExpr *func, const double *values, size_t n) {
+    return interp_.run(func->code_, values, n);
+  }
+
+  // Cache up to entries results of name, which must be pure_, in this
+  // context. Both eval() and call() look calls of name up in it first,
+  // including calls from other functions. Off by default.
+  void memoize(const std::string &name, size_t entries = 4096);
+
+  // The hits and misses of name's cache; zero if it has none.
+  MemoStats memo_stats(const std::string &name) const;
+
+ public:
+  // The tree walker's state, used by Expr::run().
+
+  // Run func in a new frame whose parameters are set by arg(idx). The
+  // frame is popped when func returns.
+  template <typename Arg>
+  double invoke(FunctionExpr *func, size_t nargs, Arg arg);
+
+  // The running function's frame.
+  double *frame_{nullptr};
+
+  // Set by a return statement until its function is left.
+  bool returning_{false};
+
+  // Evaluate the arguments of a tail call; invoke() makes the call once
+  // the current function has returned, in the same frame.
+  void tail(CallExpr *call);
+
+ private:
+  FunctionExpr *find(const std::string &name) const;
+
+  [[noreturn]] void overflow(FunctionExpr *func) const;
+
+  // call() of a function that takes or returns an int.
+  double convert(const FunctionExpr *func, const double *args, size_t nargs);
+
+ private:
+  const Program *program_;
+  Stack stack_;
+  Interpreter interp_;
+  // The walker recurses on the C++ stack; calls below this address are
+  // reported instead of running off the thread's stack.
+  const char *native_limit_{nullptr};
+  // Caches by FunctionExpr::code_, all nullptr until memoize().
+  std::vector<std::unique_ptr<MemoTable>> tables_;
+  std::vector<MemoTable *> memo_;
+  // The pending tail call, with its arguments on the stack.
+  FunctionExpr *tail_{nullptr};
+  double *tail_args_{nullptr};
+};
+
+template <typename Arg>
+double Context::invoke(FunctionExpr *func, size_t nargs, Arg arg) {
+  if (static_cast<const char *>(__builtin_frame_address(0)) < native_limit_) {
+    overflow(func);
+  }
+  double *callee = stack_.push(func->nslots_);
+  size_t nparams = func->proto_->args_.size();
+  for (size_t idx = 0; idx < nparams; ++idx) {
+    callee[idx] = idx < nargs ? arg(idx) : 0;
+  }
+  // Locals start at 0, as in every other backend.
+  std::fill(callee + nparams, callee + func->nslots_, 0.);
+  MemoTable *memo = memo_.empty() ? nullptr : memo_[func->code_];
+  MemoTable::Ticket ticket{0, 0};
+  double value;
+  if (memo && memo->lookup(callee, &value, &ticket)) {
+    stack_.pop(callee);
+    return value;
+  }
+  double *caller = frame_;
+  frame_ = callee;
+  value = func->run(*this);
+  while (tail_) {
+    // The arguments sit right above the frame; slide them down into a
+    // frame for the callee, so tail calls run in constant space.
+    func = tail_;
+    tail_ = nullptr;
+    nparams = func->proto_->args_.size();
+    stack_.pop(callee);
+    callee = stack_.push(func->nslots_);
+    memmove(callee, tail_args_, nparams * sizeof(double));
+    std::fill(callee + nparams, callee + func->nslots_, 0.);
+    frame_ = callee;
+    value = func->run(*this);
+  }
+  frame_ = caller;
+  stack_.pop(callee);
+  if (memo) {
+    memo->fill(ticket, value);
+  }
+  return value;
+}
+
+}  // namespace smcc
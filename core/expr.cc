@@ -1,170 +1,94 @@
 // Copyright (c) 2020 smarsufan. All Rights Reserved.
 
 #include <utility>
-#include <map>
-#include <cmath>
 
 #include "expr.h"
 #include "ast.h"
+#include "context.h"
 
 namespace smcc {
 
-std::vector<double> stack(8 * 1024 * 1024);
-
-int prefix = 0;
-std::map<std::string, int> vars;
-std::map<std::string, FunctionExpr *> funcs;
-int stack_idx = 0;
-int this_func_idx = 0;
-int find_return = 0;
-
-void reset() {
-  prefix = 0;
-  vars.clear();
-//   funcs.clear();
-  stack_idx = 0;
-  this_func_idx = 0;
-  find_return = 0;
-}
-
-double call(const std::string &func_id, const std::vector<double> &args) {
-  if (funcs.find(func_id) != funcs.end()) {
-    funcs[func_id]->proto_->run();
-    for (int idx = 0; idx < args.size(); ++idx) {
-      // int proto_index = funcs[func_id]->proto_->args_[idx]->this_stack_idx_;
-      int proto_index = funcs[func_id]->proto_->args_[idx]->this_stack_idx();
-      stack[proto_index] = args[idx];
-    }
-    int index = funcs[func_id]->run();
-    return stack[index];
-  }
-  else {
-    fprintf(stderr, "expr -1000\n");
-    abort();
-  }
-}
-
-int runExprs(const std::vector<std::unique_ptr<Expr>> &body) {
-  int isFind = find_return;
-  int index = -1;
+double runExprs(Context &ctx, const ExprList &body) {
+  double value = 0;
   for (auto &b : body) {
-    index = b->run();
-    if (isFind != find_return) {
+    value = b->run(ctx);
+    if (ctx.returning_) {
       break;
     }
   }
-  return index;
+  return value;
 }
 
-PrototypeExpr::PrototypeExpr(int token, std::string name, std::vector<std::unique_ptr<VarExpr>> args)
-    : token_(token), name_(name), args_(std::move(args)) {
+PrototypeExpr::PrototypeExpr(int token, Symbol name, Span<VarExpr *> args)
+    : Expr(kKind), token_(token), name_(name), args_(args) {
 }
 
-int PrototypeExpr::run() {
-  for (auto &arg : args_) {
-    arg->run();
-  }
-  return -1;
+double PrototypeExpr::run(Context &ctx) {
+  // The arguments' slots are fixed by Resolve().
+  return 0;
 }
 
-FunctionExpr::FunctionExpr(std::unique_ptr<PrototypeExpr> proto, std::vector<std::unique_ptr<Expr>> body)
-    : proto_(std::move(proto)), body_(std::move(body)) {
-  funcs[proto_->name_] = this;
+FunctionExpr::FunctionExpr(PrototypeExpr *proto, ExprList body)
+    : Expr(kKind), proto_(proto), body_(body) {
 }
 
-int FunctionExpr::run() {
-  // for (auto &b : body_) {
-  //   this_stack_idx_ = b->run();
-  //   if (find_return) {
-  //     break;
-  //   }
-  // }
-  this_stack_idx_ = runExprs(body_);
-  // find_return = false;
-  --find_return;
-  return this_stack_idx_;
+double FunctionExpr::run(Context &ctx) {
+  double value = runExprs(ctx, body_);
+  // Falling off the end returns 0.
+  if (!ctx.returning_) {
+    return 0;
+  }
+  ctx.returning_ = false;
+  return value;
 }
 
-IfExpr::IfExpr(std::unique_ptr<Expr> cond, std::vector<std::unique_ptr<Expr>> body, std::vector<std::unique_ptr<Expr>> other)
-    : cond_(std::move(cond)), body_(std::move(body)), other_(std::move(other)) {
+IfExpr::IfExpr(Expr *cond, ExprList body, ExprList other)
+    : Expr(kKind), cond_(cond), body_(body), other_(other) {
 }
 
-int IfExpr::run() {
-  if (stack[cond_->run()]) {
-    // for (auto &b : body_) {
-    //   this_stack_idx_ = b->run();
-    //   if (find_return) {
-    //     break;
-    //   }
-    // }
-    this_stack_idx_ = runExprs(body_);
+double IfExpr::run(Context &ctx) {
+  if (Holds(cond_->type_, cond_->run(ctx))) {
+    return runExprs(ctx, body_);
   }
   else {
-    // for (auto &o : other_) {
-    //   this_stack_idx_ = o->run();
-    //   if (find_return) {
-    //     break;
-    //   }
-    // }
-    this_stack_idx_ = runExprs(other_);
+    return runExprs(ctx, other_);
   }
-  return this_stack_idx_;
-}
-
-VarExpr::VarExpr(int token, std::string name)
-    : token_(token), name_(name) {  // It's danger to move.
 }
 
-int VarExpr::this_stack_idx() {
-  return prefix_to_index_[prefix];
+VarExpr::VarExpr(int token, Symbol name)
+    : Expr(kKind), token_(token), name_(name) {
 }
 
-int VarExpr::run() {
-  std::string name = std::to_string(prefix) + name_;
-  if (vars.find(name) != vars.end()) {
-    // Found It
-    if (token_ != tok_dt) {
-      fprintf(stderr, "expr -2000\n");
-      abort();
-    }
-    prefix_to_index_[prefix] = vars[name];
-    // this_stack_idx_ = vars[name];
-  }
-  else {
-    // Not Found
-    if (token_ <= tok_dt) {
-      fprintf(stderr, "expr -3000\n");
-      abort();
-    }
-    // this_stack_idx_ = ++stack_idx;
-    // vars[name] = this_stack_idx_;
-    prefix_to_index_[prefix] = ++stack_idx;
-    vars[name] = prefix_to_index_[prefix];
-  }
-
-  // return this_stack_idx_;
-  return prefix_to_index_[prefix];
+double VarExpr::run(Context &ctx) {
+  return ctx.frame_[slot_];
 }
 
-NumberExpr::NumberExpr(double num_val)
-    : num_val_(num_val) {
+NumberExpr::NumberExpr(uint32_t k, bool integral, int64_t ints)
+    : Expr(kKind), k_(k), integral_(integral), int_val_(ints),
+      value_(constants().data() + k) {
 }
 
-int NumberExpr::run() {
-  this_stack_idx_ = ++stack_idx;
-  stack[this_stack_idx_] = num_val_;
-  return this_stack_idx_;
+double NumberExpr::run(Context &ctx) {
+  return *value_;
 }
 
-BinaryExpr::BinaryExpr(int tok, std::unique_ptr<Expr> lhs, std::unique_ptr<Expr> rhs)
-    : tok_(tok), lhs_(std::move(lhs)), rhs_(std::move(rhs)) {
+BinaryExpr::BinaryExpr(int tok, Expr *lhs, Expr *rhs)
+    : Expr(kKind), tok_(tok), lhs_(lhs), rhs_(rhs) {
 }
 
-int BinaryExpr::run() {
-  auto lhs = lhs_->run();
-  auto rhs = rhs_->run();
+double BinaryExpr::run(Context &ctx) {
+  if (tok_ == tok_assign) {
+    double value = rhs_->run(ctx);
+    // Resolve() only accepts variables on the left.
+    return ctx.frame_[static_cast<VarExpr *>(lhs_)->slot_] = value;
+  }
 
-  this_stack_idx_ = stack_idx + 1;
+  double lhs = lhs_->run(ctx);
+  double rhs = rhs_->run(ctx);
+  // Check() gave both operands the same type; comparisons give an int.
+  if (lhs_->type_ == Type::kInt) {
+    return binary(BitsInt(lhs), BitsInt(rhs));
+  }
 
   switch (tok_) {
     default:
@@ -172,100 +96,118 @@ int BinaryExpr::run() {
       abort();
 
     case tok_less:
-      stack[++stack_idx] = stack[lhs] < stack[rhs];
-      break;
+      return IntBits(lhs < rhs);
 
     case tok_lessequal:
-      stack[++stack_idx] = stack[lhs] <= stack[rhs];
-      break;
+      return IntBits(lhs <= rhs);
 
     case tok_great:
-      stack[++stack_idx] = stack[lhs] > stack[rhs];
-      break;
+      return IntBits(lhs > rhs);
 
     case tok_greatequal:
-      stack[++stack_idx] = stack[lhs] >= stack[rhs];
-      break;
+      return IntBits(lhs >= rhs);
 
     case tok_equal:
-      stack[++stack_idx] = stack[lhs] == stack[rhs];
-      break;
+      return IntBits(lhs == rhs);
 
     case tok_add:
-      stack[++stack_idx] = stack[lhs] + stack[rhs];
-      break;
+      return lhs + rhs;
 
     case tok_sub:
-      stack[++stack_idx] = stack[lhs] - stack[rhs];
-      break;
+      return lhs - rhs;
 
     case tok_mul:
-      stack[++stack_idx] = stack[lhs] * stack[rhs];
-      break;
+      return lhs * rhs;
 
     case tok_div:
-      stack[++stack_idx] = stack[lhs] / stack[rhs];
-      break;
-
-    case tok_assign:
-      stack[++stack_idx] = (stack[lhs] = stack[rhs]);
-      break;
+      return lhs / rhs;
   }
-
-  return this_stack_idx_;
 }
 
-CallExpr::CallExpr(std::string id, std::vector<std::unique_ptr<Expr>> args)
-    : id_(id), args_(std::move(args)) {
-}
+double BinaryExpr::binary(int64_t lhs, int64_t rhs) const {
+  switch (tok_) {
+    default:
+      fprintf(stderr, "expr -4000\n");
+      abort();
 
-int CallExpr::run() {
-  this_stack_idx_ = ++stack_idx;
+    case tok_less:
+      return IntBits(lhs < rhs);
 
-  if (funcs.find(id_) != funcs.end()) {
-    std::vector<double> args_values(args_.size());
-    for (int idx = 0; idx < args_.size(); ++idx) {
-      args_values[idx] = stack[args_[idx]->run()];
-    }
-    ++prefix;
-    for (int idx = 0; idx < args_.size(); ++idx) {
-      int proto_index = funcs[id_]->proto_->args_[idx]->run();
-      // stack[proto_index] = stack[args_[idx]->run()];
-      stack[proto_index] = args_values[idx];
-    }
-    int idx = funcs[id_]->run();
-    stack[this_stack_idx_] = stack[idx];
-    --prefix;
-  }
-  else if (id_ == "sqrt") {
-    // The args have not been run this time, so we should run it.
-    double value = std::sqrt(stack[args_[0]->run()]);
-    stack[this_stack_idx_] = value;
-  }
-  else if (id_ == "sin") {
-    double value = std::sin(stack[args_[0]->run()]);
-    stack[this_stack_idx_] = value;
+    case tok_lessequal:
+      return IntBits(lhs <= rhs);
+
+    case tok_great:
+      return IntBits(lhs > rhs);
+
+    case tok_greatequal:
+      return IntBits(lhs >= rhs);
+
+    case tok_equal:
+      return IntBits(lhs == rhs);
+
+    case tok_add:
+      return IntBits(IntAdd(lhs, rhs));
+
+    case tok_sub:
+      return IntBits(IntSub(lhs, rhs));
+
+    case tok_mul:
+      return IntBits(IntMul(lhs, rhs));
+
+    case tok_div:
+      return IntBits(IntDiv(lhs, rhs));
   }
-  else if (id_ == "pow") {
-    double value = std::pow(stack[args_[0]->run()], stack[args_[1]->run()]);
-    stack[this_stack_idx_] = value;
+}
+
+CallExpr::CallExpr(Symbol id, ExprList args)
+    : Expr(kKind), id_(id), args_(args) {
+}
+
+// Out of line, so the argument array does not grow the frame of every
+// script call on deep recursions.
+__attribute__((noinline)) double runNative(Context &ctx, const Native *native,
+                                           const ExprList &exprs) {
+  double args[kMaxNativeArgs];
+  for (size_t idx = 0; idx < exprs.size(); ++idx) {
+    args[idx] = exprs[idx]->run(ctx);
   }
-  else {
-    fprintf(stderr, "expr -5000: %s\n", id_.c_str());
-    abort();
+  return native->call(args);
+}
+
+double CallExpr::run(Context &ctx) {
+  if (native_) {
+    return runNative(ctx, native_, args_);
   }
 
-  return this_stack_idx_;
+  // Arguments are evaluated in the caller's frame, straight into the
+  // callee's.
+  return ctx.invoke(callee_, args_.size(),
+                    [this, &ctx](size_t idx) { return args_[idx]->run(ctx); });
+}
+
+ReturnExpe::ReturnExpe(Expr *expr)
+    : Expr(kKind), expr_(expr) {
+}
+
+double ReturnExpe::run(Context &ctx) {
+  auto call = expr_cast<CallExpr>(expr_);
+  if (call && call->tail_) {
+    ctx.tail(call);
+    ctx.returning_ = true;
+    return 0;
+  }
+  double value = expr_->run(ctx);
+  ctx.returning_ = true;
+  return value;
 }
 
-ReturnExpe::ReturnExpe(std::unique_ptr<Expr> expr)
-    : expr_(std::move(expr)) {
+CastExpr::CastExpr(Expr *expr, Type type)
+    : Expr(kKind), expr_(expr) {
+  type_ = type;
 }
 
-int ReturnExpe::run() { 
-  // find_return = true;
-  ++find_return;
-  return expr_->run();
+double CastExpr::run(Context &ctx) {
+  return Cast(type_, expr_->run(ctx));
 }
 
 }  // namespace smcc
@@ -4,119 +4,224 @@
 #include <vector>
 #include <string>
 #include <memory>
-#include <map>
+
+#include "arena.h"
+#include "constant.h"
+#include "native.h"
+#include "symbol.h"
+#include "value.h"
 
 // #include "ast.h"
 
 namespace smcc {
 
-void reset();
-double call(const std::string &func_id, const std::vector<double> &args);
+class Context;
+class FunctionExpr;
+class Expr;
+class VarExpr;
+
+typedef Span<Expr *> ExprList;
+
+enum class ExprKind : uint8_t {
+  kVar,
+  kPrototype,
+  kFunction,
+  kIf,
+  kNumber,
+  kBinary,
+  kCall,
+  kReturn,
+  kCast,
+};
 
+/// Nodes live in the parser's Arena and are never deleted through Expr *,
+/// so the destructor is not virtual and most nodes destroy trivially.
 class Expr {
  public:
-  Expr() = default;
+  Expr(ExprKind kind) : kind_(kind) {}
 
-  virtual ~Expr() = default;
+  ~Expr() = default;
 
-  virtual int run() = 0;
+  ExprKind kind() const { return kind_; }
 
-  virtual int this_stack_idx() { return this_stack_idx_; }
+  // The node's value. Temporaries live on the C++ stack; only call frames
+  // go to ctx's value stack.
+  virtual double run(Context &ctx) = 0;
+
+ public:
+  // The type of the value, set by Check(); a function's is what it
+  // returns.
+  Type type_ = Type::kDouble;
 
- protected:
-  int this_stack_idx_ = -1;
+ private:
+  const ExprKind kind_;
 };
 
+// expr as a T, or nullptr. Passes test node kinds with this rather than
+// dynamic_cast, which is several times slower per node.
+template <typename T>
+T *expr_cast(Expr *expr) {
+  return expr && expr->kind() == T::kKind ? static_cast<T *>(expr) : nullptr;
+}
+
 class VarExpr : public Expr {
  public:
-  VarExpr(int token, std::string name);
+  static constexpr ExprKind kKind = ExprKind::kVar;
 
-  virtual int run();
+  VarExpr(int token, Symbol name);
 
-  virtual int this_stack_idx();
+  virtual double run(Context &ctx);
 
  public:
   int token_;
-  std::string name_;
-  std::map<int, int> prefix_to_index_;
+  Symbol name_;
+  // Offset in the function's frame, set by Resolve(), which also sets
+  // type_ from the declaration.
+  int slot_ = -1;
 };
 
 class PrototypeExpr : public Expr {
  public:
-  PrototypeExpr(int token, std::string name, std::vector<std::unique_ptr<VarExpr>> args);
+  static constexpr ExprKind kKind = ExprKind::kPrototype;
+
+  PrototypeExpr(int token, Symbol name, Span<VarExpr *> args);
 
-  virtual int run();
+  virtual double run(Context &ctx);
 
  public:
   int token_;
-  std::string name_;
-  std::vector<std::unique_ptr<VarExpr>> args_;
+  Symbol name_;
+  Span<VarExpr *> args_;
 };
 
 class FunctionExpr : public Expr {
  public:
-  FunctionExpr(std::unique_ptr<PrototypeExpr> proto, std::vector<std::unique_ptr<Expr>> body);
+  static constexpr ExprKind kKind = ExprKind::kFunction;
+
+  FunctionExpr(PrototypeExpr *proto, ExprList body);
 
-  virtual int run();
+  virtual double run(Context &ctx);
 
  public:
-  std::unique_ptr<PrototypeExpr> proto_;
-  std::vector<std::unique_ptr<Expr>> body_;
+  PrototypeExpr *proto_;
+  ExprList body_;
+
+  // Parameters and locals, and the type of each, set by Resolve().
+  int nslots_ = 0;
+  std::vector<Type> slot_types_;
+
+  // Takes or returns an int, so calls from the host convert; set by
+  // Check().
+  bool ints_ = false;
+
+  // Calls itself, directly or through others; set by Link().
+  bool recursive_ = false;
+
+  // Calls no host function but the builtins, directly or through others,
+  // so the result depends on the arguments only; set by Link().
+  bool pure_ = true;
+
+  // Index in the bytecode Module once compiled.
+  int code_ = -1;
 };
 
 class IfExpr : public Expr {
  public:
-  IfExpr(std::unique_ptr<Expr> cond, std::vector<std::unique_ptr<Expr>> body, std::vector<std::unique_ptr<Expr>> other);
+  static constexpr ExprKind kKind = ExprKind::kIf;
+
+  IfExpr(Expr *cond, ExprList body, ExprList other);
 
-  virtual int run();
+  virtual double run(Context &ctx);
 
  public:
-  std::unique_ptr<Expr> cond_;
-  std::vector<std::unique_ptr<Expr>> body_;
-  std::vector<std::unique_ptr<Expr>> other_;
+  Expr *cond_;
+  ExprList body_;
+  ExprList other_;
 };
 
 class NumberExpr : public Expr {
  public:
-  NumberExpr(double num_val);
+  static constexpr ExprKind kKind = ExprKind::kNumber;
+
+  // The literal constants()[k]. An integral one was written without a
+  // point, so Check() may make it an int, of value ints; k may round it.
+  NumberExpr(uint32_t k, bool integral = false, int64_t ints = 0);
 
-  virtual int run();
+  virtual double run(Context &ctx);
+
+  // The constant's bits; an int's are an int64_t.
+  double num_val() const { return *value_; }
 
  public:
-  double num_val_;
+  uint32_t k_;
+  bool integral_;
+  int64_t int_val_;
+  // Into the constant pool, which never moves.
+  const double *value_;
 };
 
 class BinaryExpr : public Expr {
  public:
-  BinaryExpr(int tok, std::unique_ptr<Expr> lhs, std::unique_ptr<Expr> rhs);
+  static constexpr ExprKind kKind = ExprKind::kBinary;
+
+  BinaryExpr(int tok, Expr *lhs, Expr *rhs);
 
-  virtual int run();
+  virtual double run(Context &ctx);
+
+  // The operator on int operands.
+  double binary(int64_t lhs, int64_t rhs) const;
 
  public:
   int tok_;
-  std::unique_ptr<Expr> lhs_;
-  std::unique_ptr<Expr> rhs_;
+  Expr *lhs_;
+  Expr *rhs_;
 };
 
 class CallExpr : public Expr {
  public:
-  CallExpr(std::string id, std::vector<std::unique_ptr<Expr>> args);
+  static constexpr ExprKind kKind = ExprKind::kCall;
+
+  CallExpr(Symbol id, ExprList args);
 
-  virtual int run();
+  virtual double run(Context &ctx);
 
  public:
-  std::string id_;
-  std::vector<std::unique_ptr<Expr>> args_;
+  Symbol id_;
+  ExprList args_;
+
+  // The callee, bound by Link(): a script function or a host function.
+  FunctionExpr *callee_ = nullptr;
+  const Native *native_ = nullptr;
+
+  // `return f(...)` of a script function f; set by Link(). The caller's
+  // frame is done with, so every backend reuses it for the callee.
+  bool tail_ = false;
 };
 
 class ReturnExpe : public Expr {
  public:
-  ReturnExpe(std::unique_ptr<Expr> expr);
+  static constexpr ExprKind kKind = ExprKind::kReturn;
+
+  ReturnExpe(Expr *expr);
+
+  virtual double run(Context &ctx);
+
+ public:
+  Expr *expr_;
+};
+
+/// expr converted to type_; Check() puts these wherever the types of a
+/// value and of its use differ.
+class CastExpr : public Expr {
+ public:
+  static constexpr ExprKind kKind = ExprKind::kCast;
+
+  CastExpr(Expr *expr, Type type);
 
-  virtual int run();
+  virtual double run(Context &ctx);
 
  public:
-  std::unique_ptr<Expr> expr_;
+  Expr *expr_;
 };
 
 }  // namespace smcc
@@ -0,0 +1,347 @@
+// Copyright (c) 2020 smarsufan. All Rights Reserved.
+
+#include "fold.h"
+
+#include <cmath>
+#include <cstring>
+
+#include "ast.h"
+#include "native.h"
+
+namespace smcc {
+
+namespace {
+
+bool Literal(Expr *expr, double *value) {
+  auto num = expr_cast<NumberExpr>(expr);
+  if (num) {
+    *value = num->num_val();
+  }
+  return num != nullptr;
+}
+
+bool SameBits(double a, double b) {
+  return memcmp(&a, &b, sizeof(a)) == 0;
+}
+
+// bin on the values of its operands.
+double Apply(const BinaryExpr *bin, double lhs, double rhs) {
+  if (bin->lhs_->type_ == Type::kInt) {
+    return bin->binary(BitsInt(lhs), BitsInt(rhs));
+  }
+  switch (bin->tok_) {
+    case tok_less: return IntBits(lhs < rhs);
+    case tok_lessequal: return IntBits(lhs <= rhs);
+    case tok_great: return IntBits(lhs > rhs);
+    case tok_greatequal: return IntBits(lhs >= rhs);
+    case tok_equal: return IntBits(lhs == rhs);
+    case tok_add: return lhs + rhs;
+    case tok_sub: return lhs - rhs;
+    case tok_mul: return lhs * rhs;
+    case tok_div: return lhs / rhs;
+    default:
+      fprintf(stderr, "fold -100: bad operator %d\n", bin->tok_);
+      abort();
+  }
+}
+
+/// Runs pure functions on literal arguments. Gives up on calls that nest
+/// too deep or take too many steps, since those may never finish.
+class Evaluator {
+ public:
+  bool call(FunctionExpr *func, std::vector<double> args, double *out) {
+    fuel_ = kFuel;
+    return invoke(func, std::move(args), out);
+  }
+
+ private:
+  static constexpr int kFuel = 1 << 16;
+  static constexpr int kMaxDepth = 256;
+
+  enum Flow { kNext, kReturn, kFail };
+
+  bool invoke(FunctionExpr *func, std::vector<double> args, double *out) {
+    if (depth_ >= kMaxDepth) {
+      return false;
+    }
+    ++depth_;
+    Flow flow;
+    do {
+      // Tail calls come back here, in place of nesting.
+      std::vector<double> frame(std::max<size_t>(func->nslots_, 1));
+      std::copy(args.begin(), args.end(), frame.begin());
+      tail_ = nullptr;
+      *out = 0;
+      flow = body(func->body_, frame.data(), out);
+      func = tail_;
+      args.swap(tail_args_);
+    } while (flow != kFail && func);
+    --depth_;
+    return flow != kFail;
+  }
+
+  Flow body(const ExprList &exprs, double *frame, double *out) {
+    for (auto expr : exprs) {
+      Flow flow = statement(expr, frame, out);
+      if (flow != kNext) {
+        return flow;
+      }
+    }
+    return kNext;
+  }
+
+  Flow statement(Expr *expr, double *frame, double *out) {
+    if (auto ret = expr_cast<ReturnExpe>(expr)) {
+      auto call = expr_cast<CallExpr>(ret->expr_);
+      if (call && call->tail_) {
+        // An argument may be a call, which uses tail_args_ itself.
+        std::vector<double> args;
+        if (!arguments(call, frame, &args)) {
+          return kFail;
+        }
+        tail_args_.swap(args);
+        tail_ = call->callee_;
+        return kReturn;
+      }
+      return value(ret->expr_, frame, out) ? kReturn : kFail;
+    }
+    if (auto cond = expr_cast<IfExpr>(expr)) {
+      double test;
+      if (!value(cond->cond_, frame, &test)) {
+        return kFail;
+      }
+      return body(Holds(cond->cond_->type_, test) ? cond->body_
+                                                  : cond->other_,
+                  frame, out);
+    }
+    double ignored;
+    return value(expr, frame, &ignored) ? kNext : kFail;
+  }
+
+  bool arguments(CallExpr *call, double *frame, std::vector<double> *args) {
+    args->resize(call->args_.size());
+    for (size_t idx = 0; idx < args->size(); ++idx) {
+      if (!value(call->args_[idx], frame, &(*args)[idx])) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  bool value(Expr *expr, double *frame, double *out) {
+    if (--fuel_ < 0) {
+      return false;
+    }
+    switch (expr->kind()) {
+      case ExprKind::kNumber:
+        *out = static_cast<NumberExpr *>(expr)->num_val();
+        return true;
+      case ExprKind::kVar:
+        *out = frame[static_cast<VarExpr *>(expr)->slot_];
+        return true;
+      case ExprKind::kBinary: {
+        auto bin = static_cast<BinaryExpr *>(expr);
+        double lhs, rhs;
+        if (bin->tok_ == tok_assign) {
+          if (!value(bin->rhs_, frame, out)) {
+            return false;
+          }
+          frame[static_cast<VarExpr *>(bin->lhs_)->slot_] = *out;
+          return true;
+        }
+        if (!value(bin->lhs_, frame, &lhs) || !value(bin->rhs_, frame, &rhs)) {
+          return false;
+        }
+        *out = Apply(bin, lhs, rhs);
+        return true;
+      }
+      case ExprKind::kCast: {
+        auto cast = static_cast<CastExpr *>(expr);
+        if (!value(cast->expr_, frame, out)) {
+          return false;
+        }
+        *out = Cast(cast->type_, *out);
+        return true;
+      }
+      case ExprKind::kCall: {
+        auto call = static_cast<CallExpr *>(expr);
+        std::vector<double> args;
+        if (!arguments(call, frame, &args)) {
+          return false;
+        }
+        if (call->native_) {
+          *out = call->native_->call(args.data());
+          return true;
+        }
+        return invoke(call->callee_, std::move(args), out);
+      }
+      default:
+        return false;
+    }
+  }
+
+ private:
+  int fuel_{0};
+  int depth_{0};
+  FunctionExpr *tail_{nullptr};
+  std::vector<double> tail_args_;
+};
+
+class Folder {
+ public:
+  explicit Folder(Arena *arena) : arena_(arena) {}
+
+  void body(const ExprList &exprs) {
+    for (auto &expr : exprs) {
+      expr = statement(expr);
+    }
+  }
+
+ private:
+  Expr *number(double value, Type type) {
+    auto num = arena_->make<NumberExpr>(constants().intern(value));
+    num->type_ = type;
+    return num;
+  }
+
+  Expr *statement(Expr *expr) {
+    if (auto ret = expr_cast<ReturnExpe>(expr)) {
+      ret->expr_ = fold(ret->expr_);
+      return ret;
+    }
+    if (auto cond = expr_cast<IfExpr>(expr)) {
+      cond->cond_ = fold(cond->cond_);
+      body(cond->body_);
+      body(cond->other_);
+      double test;
+      if (Literal(cond->cond_, &test)) {
+        if (Holds(cond->cond_->type_, test)) {
+          cond->other_ = ExprList();
+        }
+        else {
+          cond->body_ = ExprList();
+        }
+      }
+      return cond;
+    }
+    return fold(expr);
+  }
+
+  Expr *fold(Expr *expr) {
+    if (auto bin = expr_cast<BinaryExpr>(expr)) {
+      return binary(bin);
+    }
+    if (auto call = expr_cast<CallExpr>(expr)) {
+      return this->call(call);
+    }
+    if (auto cast = expr_cast<CastExpr>(expr)) {
+      cast->expr_ = fold(cast->expr_);
+      double value;
+      if (Literal(cast->expr_, &value)) {
+        return number(Cast(cast->type_, value), cast->type_);
+      }
+    }
+    return expr;
+  }
+
+  Expr *binary(BinaryExpr *bin) {
+    bin->rhs_ = fold(bin->rhs_);
+    if (bin->tok_ == tok_assign) {
+      return bin;
+    }
+    bin->lhs_ = fold(bin->lhs_);
+
+    double lhs = 0, rhs = 0;
+    bool left = Literal(bin->lhs_, &lhs);
+    bool right = Literal(bin->rhs_, &rhs);
+    if (left && right) {
+      return number(Apply(bin, lhs, rhs), bin->type_);
+    }
+    if (bin->lhs_->type_ == Type::kInt) {
+      return integer(bin, left, BitsInt(lhs), right, BitsInt(rhs));
+    }
+    if (right) {
+      if ((bin->tok_ == tok_mul || bin->tok_ == tok_div) && rhs == 1) {
+        return bin->lhs_;
+      }
+      // x + 0 is +0 for x = -0, so only -0 is an identity for +.
+      if ((bin->tok_ == tok_sub && SameBits(rhs, 0.)) ||
+          (bin->tok_ == tok_add && SameBits(rhs, -0.))) {
+        return bin->lhs_;
+      }
+      // 1 / 2^k is exact, so multiplying rounds the same as dividing,
+      // unless 2^-k is too large for a double.
+      int exp;
+      if (bin->tok_ == tok_div && std::isfinite(rhs) && rhs != 0 &&
+          std::fabs(std::frexp(rhs, &exp)) == 0.5 &&
+          std::isfinite(1 / rhs)) {
+        bin->tok_ = tok_mul;
+        bin->rhs_ = number(1 / rhs, Type::kDouble);
+      }
+    }
+    if (left) {
+      if ((bin->tok_ == tok_mul && lhs == 1) ||
+          (bin->tok_ == tok_add && SameBits(lhs, -0.))) {
+        return bin->rhs_;
+      }
+    }
+    return bin;
+  }
+
+  // Ints have no -0 or NaN: x * 1, 1 * x, x / 1, x + 0, 0 + x and
+  // x - 0 are all x.
+  Expr *integer(BinaryExpr *bin, bool left, int64_t lhs, bool right,
+                int64_t rhs) {
+    int tok = bin->tok_;
+    if (right && ((rhs == 1 && (tok == tok_mul || tok == tok_div)) ||
+                  (rhs == 0 && (tok == tok_add || tok == tok_sub)))) {
+      return bin->lhs_;
+    }
+    if (left && ((lhs == 1 && tok == tok_mul) ||
+                 (lhs == 0 && tok == tok_add))) {
+      return bin->rhs_;
+    }
+    return bin;
+  }
+
+  Expr *call(CallExpr *call) {
+    for (auto &arg : call->args_) {
+      arg = fold(arg);
+    }
+    std::vector<double> args(call->args_.size());
+    for (size_t idx = 0; idx < args.size(); ++idx) {
+      if (!Literal(call->args_[idx], &args[idx])) {
+        return call;
+      }
+    }
+    if (call->native_) {
+      if (!natives().builtin(call->native_->name)) {
+        return call;
+      }
+      return number(call->native_->call(args.data()), Type::kDouble);
+    }
+    double value;
+    if (call->callee_->pure_ &&
+        evaluator_.call(call->callee_, std::move(args), &value)) {
+      return number(value, call->type_);
+    }
+    return call;
+  }
+
+ private:
+  Arena *arena_;
+  Evaluator evaluator_;
+};
+
+}  // namespace
+
+void Fold(const std::vector<Expr *> &exprs, Arena *arena) {
+  Folder folder(arena);
+  for (auto expr : exprs) {
+    if (auto func = expr_cast<FunctionExpr>(expr)) {
+      folder.body(func->body_);
+    }
+  }
+}
+
+}  // namespace smcc
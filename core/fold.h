@@ -0,0 +1,26 @@
+// Copyright (c) 2020 smarsufan. All Rights Reserved.
+
+#pragma once
+#include <vector>
+
+#include "arena.h"
+#include "expr.h"
+
+namespace smcc {
+
+/// Simplify the functions of a linked program in place.
+///
+/// Operators on literals become literals, and so do calls of builtins and
+/// of pure_ script functions whose arguments are all literals; the latter
+/// are run at compile time, within a budget. Beyond that, only rewrites
+/// that give the same bits for every operand, NaN and -0 included:
+///
+///   x * 1, 1 * x, x / 1, x - 0, x + -0, -0 + x  ->  x
+///   x / 2^k                                     ->  x * 2^-k
+///
+/// for doubles, the first line with 0 for -0 for ints, and if/else on a
+/// literal loses the branch that can not run. Runs after Check(), so a
+/// conversion of a literal is a literal too. New nodes go in arena.
+void Fold(const std::vector<Expr *> &exprs, Arena *arena);
+
+}  // namespace smcc
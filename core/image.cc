@@ -0,0 +1,753 @@
+// Copyright (c) 2020 smarsufan. All Rights Reserved.
+
+#include "image.h"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+
+#include "ast.h"
+#include "native.h"
+
+namespace smcc {
+
+namespace {
+
+const char kMagic[8] = "smccimg";
+
+// No node, e.g. the callee of a call to a native.
+constexpr uint32_t kNone = UINT32_MAX;
+
+// count items from offset bytes into the file.
+struct Section {
+  uint32_t offset;
+  uint32_t count;
+};
+
+struct Header {
+  char magic[8];
+  uint32_t version;
+  // 1 as written; anything else is the other byte order.
+  uint32_t order;
+  uint64_t hash;
+  // Of the whole file.
+  uint64_t size;
+  // count + 1 uint32_t offsets into names, the last one its end.
+  Section symbols;
+  Section names;
+  // double.
+  Section constants;
+  Section nodes;
+  // uint32_t: node indices of lists, and the types of slots.
+  Section lists;
+  // uint32_t node indices.
+  Section toplevel;
+  Section functions;
+  // Instr.
+  Section code;
+  Section imports;
+};
+
+// Node flags.
+enum : uint8_t {
+  kIntegral = 1,
+  kTail = 2,
+  kInts = 4,
+  kRecursive = 8,
+  kPure = 16,
+};
+
+// One node. Its fields by kind, a list being an offset and a count into
+// the lists section, and symbols indices into the symbols section:
+//
+//   Var        token, name, slot
+//   Prototype  token, name, args list
+//   Function   proto, body list, nslots, slot types list, code
+//   If         cond, body list, other list
+//   Number     constant index, low and high half of the int value;
+//              kIntegral
+//   Binary     tok, lhs, rhs
+//   Call       id, args list, callee or kNone, native name or kNone; kTail
+//   Return     expr or kNone
+//   Cast       expr
+struct Node {
+  uint8_t kind;
+  uint8_t type;
+  uint8_t flags;
+  uint8_t pad;
+  uint32_t f[7];
+};
+
+// A BytecodeFunction, its code a range of the code section.
+struct Function {
+  uint32_t name;
+  uint32_t nparams;
+  uint32_t nregs;
+  Section code;
+};
+
+struct Import {
+  uint32_t name;
+  uint32_t arity;
+};
+
+static_assert(std::is_trivially_copyable<Instr>::value, "code is copied");
+
+size_t Align(size_t size) {
+  return (size + 7) & ~size_t(7);
+}
+
+/// Flattens a program into the sections of an image.
+class Writer {
+ public:
+  Writer(const std::vector<Expr *> &toplevel, const Module &module) {
+    for (auto expr : toplevel) {
+      toplevel_.push_back(node(expr));
+    }
+    for (auto &call : callees_) {
+      nodes_[call.first].f[3] = funcs_.at(call.second);
+    }
+    for (auto &fn : module.functions()) {
+      uint32_t from = code_.size();
+      for (Instr ins : fn.code) {
+        if (ins.op == kOpLoadK) {
+          ins.b = constant(ins.b);
+        }
+        code_.push_back(ins);
+      }
+      functions_.push_back({symbol(fn.name), fn.nparams, fn.nregs,
+                            {from, static_cast<uint32_t>(code_.size() - from)}});
+    }
+    for (auto native : module.imports()) {
+      imports_.push_back({symbol(native->name), native->arity});
+    }
+  }
+
+  std::vector<char> bytes(uint64_t hash) {
+    std::vector<uint32_t> offsets;
+    std::string names;
+    for (Symbol sym : names_) {
+      offsets.push_back(names.size());
+      names += symbols().name(sym);
+    }
+    offsets.push_back(names.size());
+
+    Header header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, kMagic, sizeof(header.magic));
+    header.version = kImageVersion;
+    header.order = 1;
+    header.hash = hash;
+    out_.resize(Align(sizeof(header)));
+    header.symbols = append(offsets.data(), offsets.size());
+    header.symbols.count = names_.size();
+    header.names = append(names.data(), names.size());
+    header.constants = append(constants_.data(), constants_.size());
+    header.nodes = append(nodes_.data(), nodes_.size());
+    header.lists = append(lists_.data(), lists_.size());
+    header.toplevel = append(toplevel_.data(), toplevel_.size());
+    header.functions = append(functions_.data(), functions_.size());
+    header.code = append(code_.data(), code_.size());
+    header.imports = append(imports_.data(), imports_.size());
+    header.size = out_.size();
+    memcpy(out_.data(), &header, sizeof(header));
+    return std::move(out_);
+  }
+
+ private:
+  // Children before parents. The parser builds a tree and no pass shares
+  // a node, so each is reached once.
+  uint32_t node(Expr *expr) {
+    if (!expr) {
+      return kNone;
+    }
+    Node n;
+    memset(&n, 0, sizeof(n));
+    n.kind = static_cast<uint8_t>(expr->kind());
+    n.type = static_cast<uint8_t>(expr->type_);
+    switch (expr->kind()) {
+      case ExprKind::kVar: {
+        auto var = static_cast<VarExpr *>(expr);
+        n.f[0] = var->token_;
+        n.f[1] = symbol(var->name_);
+        n.f[2] = var->slot_;
+        break;
+      }
+      case ExprKind::kPrototype: {
+        auto proto = static_cast<PrototypeExpr *>(expr);
+        n.f[0] = proto->token_;
+        n.f[1] = symbol(proto->name_);
+        list(proto->args_, &n.f[2]);
+        break;
+      }
+      case ExprKind::kFunction: {
+        auto func = static_cast<FunctionExpr *>(expr);
+        n.f[0] = node(func->proto_);
+        list(func->body_, &n.f[1]);
+        n.f[3] = func->nslots_;
+        n.f[4] = lists_.size();
+        n.f[5] = func->slot_types_.size();
+        for (Type type : func->slot_types_) {
+          lists_.push_back(static_cast<uint32_t>(type));
+        }
+        n.f[6] = func->code_;
+        n.flags = (func->ints_ ? kInts : 0) |
+                  (func->recursive_ ? kRecursive : 0) |
+                  (func->pure_ ? kPure : 0);
+        break;
+      }
+      case ExprKind::kIf: {
+        auto branch = static_cast<IfExpr *>(expr);
+        n.f[0] = node(branch->cond_);
+        list(branch->body_, &n.f[1]);
+        list(branch->other_, &n.f[3]);
+        break;
+      }
+      case ExprKind::kNumber: {
+        auto num = static_cast<NumberExpr *>(expr);
+        n.f[0] = constant(num->k_);
+        uint64_t ints = static_cast<uint64_t>(num->int_val_);
+        n.f[1] = static_cast<uint32_t>(ints);
+        n.f[2] = static_cast<uint32_t>(ints >> 32);
+        n.flags = num->integral_ ? kIntegral : 0;
+        break;
+      }
+      case ExprKind::kBinary: {
+        auto bin = static_cast<BinaryExpr *>(expr);
+        n.f[0] = bin->tok_;
+        n.f[1] = node(bin->lhs_);
+        n.f[2] = node(bin->rhs_);
+        break;
+      }
+      case ExprKind::kCall: {
+        auto call = static_cast<CallExpr *>(expr);
+        n.f[0] = symbol(call->id_);
+        list(call->args_, &n.f[1]);
+        n.f[3] = kNone;
+        n.f[4] = call->native_ ? symbol(call->native_->name) : kNone;
+        n.flags = call->tail_ ? kTail : 0;
+        break;
+      }
+      case ExprKind::kReturn:
+        n.f[0] = node(static_cast<ReturnExpe *>(expr)->expr_);
+        break;
+      case ExprKind::kCast:
+        n.f[0] = node(static_cast<CastExpr *>(expr)->expr_);
+        break;
+    }
+    uint32_t idx = nodes_.size();
+    nodes_.push_back(n);
+    if (auto func = expr_cast<FunctionExpr>(expr)) {
+      funcs_.emplace(func, idx);
+    }
+    else if (auto call = expr_cast<CallExpr>(expr)) {
+      // The callee may come later.
+      if (call->callee_) {
+        callees_.emplace_back(idx, call->callee_);
+      }
+    }
+    return idx;
+  }
+
+  // Write items, then their offset and count to at.
+  template <typename T>
+  void list(const Span<T> &items, uint32_t *at) {
+    size_t mark = scratch_.size();
+    for (auto item : items) {
+      scratch_.push_back(node(item));
+    }
+    at[0] = lists_.size();
+    at[1] = scratch_.size() - mark;
+    lists_.insert(lists_.end(), scratch_.begin() + mark, scratch_.end());
+    scratch_.resize(mark);
+  }
+
+  uint32_t symbol(Symbol sym) {
+    auto it = symbols_.emplace(sym, names_.size()).first;
+    if (it->second == names_.size()) {
+      names_.push_back(sym);
+    }
+    return it->second;
+  }
+
+  uint32_t constant(uint32_t k) {
+    auto it = ks_.emplace(k, constants_.size()).first;
+    if (it->second == constants_.size()) {
+      constants_.push_back(constants()[k]);
+    }
+    return it->second;
+  }
+
+  template <typename T>
+  Section append(const T *items, size_t count) {
+    Section section{static_cast<uint32_t>(out_.size()),
+                    static_cast<uint32_t>(count)};
+    out_.resize(out_.size() + count * sizeof(T));
+    if (count) {
+      memcpy(&out_[section.offset], items, count * sizeof(T));
+    }
+    out_.resize(Align(out_.size()));
+    return section;
+  }
+
+ private:
+  std::vector<Node> nodes_;
+  // Node index of each function, and the calls to patch with them.
+  std::unordered_map<const FunctionExpr *, uint32_t> funcs_;
+  std::vector<std::pair<uint32_t, const FunctionExpr *>> callees_;
+  std::vector<uint32_t> lists_;
+  // Children of the lists being written; each moves into lists_ once
+  // complete.
+  std::vector<uint32_t> scratch_;
+  std::vector<uint32_t> toplevel_;
+  std::vector<Function> functions_;
+  std::vector<Instr> code_;
+  std::vector<Import> imports_;
+  // Image index by Symbol, and Symbol by image index.
+  std::unordered_map<Symbol, uint32_t> symbols_;
+  std::vector<Symbol> names_;
+  // The same for constants.
+  std::unordered_map<uint32_t, uint32_t> ks_;
+  std::vector<double> constants_;
+  std::vector<char> out_;
+};
+
+bool IsExpr(uint8_t kind) {
+  switch (static_cast<ExprKind>(kind)) {
+    case ExprKind::kVar:
+    case ExprKind::kNumber:
+    case ExprKind::kBinary:
+    case ExprKind::kCall:
+    case ExprKind::kCast:
+      return true;
+    default:
+      return false;
+  }
+}
+
+bool IsStatement(uint8_t kind) {
+  return IsExpr(kind) || kind == static_cast<uint8_t>(ExprKind::kIf) ||
+         kind == static_cast<uint8_t>(ExprKind::kReturn);
+}
+
+// Whether every index in the sections of file is in bounds and refers to
+// what its field promises: a node of the right kind, a frame slot of its
+// function, a register of its frame. A file that fails this is broken, as
+// the header and the hash can not tell.
+bool Consistent(const char *file, const Header &h) {
+  auto at = [&](const Section &s) { return file + s.offset; };
+  auto offsets = reinterpret_cast<const uint32_t *>(at(h.symbols));
+  auto nodes = reinterpret_cast<const Node *>(at(h.nodes));
+  auto lists = reinterpret_cast<const uint32_t *>(at(h.lists));
+  auto top = reinterpret_cast<const uint32_t *>(at(h.toplevel));
+  auto functions = reinterpret_cast<const Function *>(at(h.functions));
+  auto code = reinterpret_cast<const Instr *>(at(h.code));
+  auto imports = reinterpret_cast<const Import *>(at(h.imports));
+
+  for (uint32_t idx = 0; idx < h.symbols.count; ++idx) {
+    if (offsets[idx] > offsets[idx + 1] || offsets[idx + 1] > h.names.count) {
+      return false;
+    }
+  }
+  auto sym = [&](uint32_t s) { return s < h.symbols.count; };
+  auto kind = [&](uint32_t idx, ExprKind k) {
+    return nodes[idx].kind == static_cast<uint8_t>(k);
+  };
+
+  // Children come before their parents. need is one past the highest
+  // frame slot a node's subtree reads or writes.
+  std::vector<uint64_t> need(h.nodes.count, 0);
+  uint32_t idx = 0;
+  auto expr = [&](uint32_t c) { return c < idx && IsExpr(nodes[c].kind); };
+  auto statement = [&](uint32_t c) {
+    return c < idx && IsStatement(nodes[c].kind);
+  };
+  auto var = [&](uint32_t c) { return c < idx && kind(c, ExprKind::kVar); };
+  auto list = [&](const uint32_t *field, auto item) {
+    if (static_cast<uint64_t>(field[0]) + field[1] > h.lists.count) {
+      return false;
+    }
+    for (uint32_t i = 0; i < field[1]; ++i) {
+      uint32_t c = lists[field[0] + i];
+      if (!item(c)) {
+        return false;
+      }
+      need[idx] = std::max(need[idx], need[c]);
+    }
+    return true;
+  };
+  for (; idx < h.nodes.count; ++idx) {
+    const Node &n = nodes[idx];
+    const uint32_t *f = n.f;
+    if (n.type > static_cast<uint8_t>(Type::kInt)) {
+      return false;
+    }
+    bool ok = false;
+    switch (static_cast<ExprKind>(n.kind)) {
+      case ExprKind::kVar:
+        ok = sym(f[1]);
+        need[idx] = static_cast<uint64_t>(f[2]) + 1;
+        break;
+      case ExprKind::kPrototype:
+        ok = sym(f[1]) && list(&f[2], var);
+        break;
+      case ExprKind::kFunction: {
+        ok = f[0] < idx && kind(f[0], ExprKind::kPrototype) &&
+             list(&f[1], statement) &&
+             std::max(need[idx], need[f[0]]) <= f[3] && f[5] == f[3] &&
+             static_cast<uint64_t>(f[4]) + f[5] <= h.lists.count &&
+             f[6] < h.functions.count &&
+             functions[f[6]].nparams == nodes[f[0]].f[3];
+        for (uint32_t slot = 0; ok && slot < f[5]; ++slot) {
+          ok = lists[f[4] + slot] <= static_cast<uint32_t>(Type::kInt);
+        }
+        // Its slots are its own.
+        need[idx] = 0;
+        break;
+      }
+      case ExprKind::kIf:
+        ok = expr(f[0]) && list(&f[1], statement) && list(&f[3], statement);
+        if (ok) {
+          need[idx] = std::max(need[idx], need[f[0]]);
+        }
+        break;
+      case ExprKind::kNumber:
+        ok = f[0] < h.constants.count;
+        break;
+      case ExprKind::kBinary:
+        ok = expr(f[1]) && expr(f[2]) &&
+             (static_cast<int>(f[0]) != tok_assign || var(f[1]));
+        if (ok) {
+          need[idx] = std::max(need[f[1]], need[f[2]]);
+        }
+        break;
+      case ExprKind::kCall:
+        // Bound to exactly one of a script function, checked below, and a
+        // native.
+        ok = sym(f[0]) && list(&f[1], expr) &&
+             (f[3] == kNone) != (f[4] == kNone) &&
+             (f[3] == kNone || f[3] < h.nodes.count) &&
+             (f[4] == kNone || sym(f[4]));
+        break;
+      case ExprKind::kReturn:
+        ok = f[0] == kNone || expr(f[0]);
+        if (ok && f[0] != kNone) {
+          need[idx] = need[f[0]];
+        }
+        break;
+      case ExprKind::kCast:
+        ok = expr(f[0]);
+        if (ok) {
+          need[idx] = need[f[0]];
+        }
+        break;
+    }
+    if (!ok) {
+      return false;
+    }
+  }
+  for (idx = 0; idx < h.nodes.count; ++idx) {
+    const uint32_t *f = nodes[idx].f;
+    if (kind(idx, ExprKind::kCall) && f[3] != kNone &&
+        (!kind(f[3], ExprKind::kFunction) ||
+         nodes[nodes[f[3]].f[0]].f[3] != f[2])) {
+      return false;
+    }
+  }
+  for (idx = 0; idx < h.toplevel.count; ++idx) {
+    if (top[idx] >= h.nodes.count ||
+        !(kind(top[idx], ExprKind::kFunction) ||
+          kind(top[idx], ExprKind::kPrototype))) {
+      return false;
+    }
+  }
+
+  for (idx = 0; idx < h.imports.count; ++idx) {
+    if (!sym(imports[idx].name)) {
+      return false;
+    }
+  }
+  for (idx = 0; idx < h.functions.count; ++idx) {
+    const Function &fn = functions[idx];
+    if (!sym(fn.name) || fn.nparams > fn.nregs || fn.code.count == 0 ||
+        static_cast<uint64_t>(fn.code.offset) + fn.code.count >
+            h.code.count) {
+      return false;
+    }
+    auto reg = [&](uint32_t r) { return r < fn.nregs; };
+    auto regs = [&](uint32_t r, uint32_t n) {
+      return static_cast<uint64_t>(r) + n <= fn.nregs;
+    };
+    const Instr *begin = code + fn.code.offset;
+    for (const Instr *ins = begin; ins != begin + fn.code.count; ++ins) {
+      bool ok;
+      switch (ins->op) {
+        case kOpLoadK:
+          ok = reg(ins->a) && ins->b < h.constants.count;
+          break;
+        case kOpMov:
+        case kOpToInt:
+        case kOpToDouble:
+        case kOpSqrt:
+        case kOpSin:
+          ok = reg(ins->a) && reg(ins->b);
+          break;
+        case kOpJmp:
+          ok = ins->b < fn.code.count;
+          break;
+        case kOpJmpF:
+        case kOpJmpZ:
+          ok = reg(ins->a) && ins->b < fn.code.count;
+          break;
+        case kOpCall:
+        case kOpTailCall:
+          ok = regs(ins->a, ins->b) && ins->c < h.functions.count;
+          break;
+        case kOpNative:
+          ok = regs(ins->a, ins->b) && ins->c < h.imports.count &&
+               imports[ins->c].arity == ins->b;
+          break;
+        case kOpRet:
+          ok = reg(ins->a);
+          break;
+        default:
+          ok = ins->op < kOpCount && reg(ins->a) && reg(ins->b) &&
+               reg(ins->c);
+          break;
+      }
+      if (!ok) {
+        return false;
+      }
+    }
+    // Nothing runs off the end.
+    uint32_t last = begin[fn.code.count - 1].op;
+    if (last != kOpRet && last != kOpJmp && last != kOpTailCall) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace
+
+uint64_t SourceHash(const char *data, size_t size) {
+  uint64_t hash = 0xcbf29ce484222325ull;
+  for (size_t idx = 0; idx < size; ++idx) {
+    hash = (hash ^ static_cast<unsigned char>(data[idx])) * 0x100000001b3ull;
+  }
+  return hash;
+}
+
+Image::Image(const char *path) : file_(path) {}
+
+bool Image::valid(uint64_t hash) const {
+  if (!file_.data() || file_.size() < sizeof(Header)) {
+    return false;
+  }
+  auto &header = *section<Header>(0);
+  if (memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 ||
+      header.version != kImageVersion || header.order != 1 ||
+      header.hash != hash || header.size != file_.size()) {
+    return false;
+  }
+  // Every section inside the file, so loading reads nothing beyond it.
+  auto inside = [&](const Section &s, size_t size) {
+    return s.offset % 8 == 0 &&
+           s.offset + static_cast<uint64_t>(s.count) * size <= file_.size();
+  };
+  Section offsets = {header.symbols.offset, header.symbols.count + 1};
+  if (!(inside(offsets, sizeof(uint32_t)) &&
+         inside(header.names, 1) &&
+         inside(header.constants, sizeof(double)) &&
+         inside(header.nodes, sizeof(Node)) &&
+         inside(header.lists, sizeof(uint32_t)) &&
+         inside(header.toplevel, sizeof(uint32_t)) &&
+         inside(header.functions, sizeof(Function)) &&
+         inside(header.code, sizeof(Instr)) &&
+         inside(header.imports, sizeof(Import)))) {
+    return false;
+  }
+  return Consistent(file_.data(), header);
+}
+
+bool Image::load(Arena *arena, std::vector<Expr *> *toplevel,
+                 Module *module) const {
+  auto &header = *section<Header>(0);
+  const uint32_t *offsets = section<uint32_t>(header.symbols.offset);
+  const char *names = section<char>(header.names.offset);
+  std::vector<Symbol> syms(header.symbols.count);
+  for (size_t idx = 0; idx < syms.size(); ++idx) {
+    syms[idx] = symbols().intern(names + offsets[idx],
+                                 offsets[idx + 1] - offsets[idx]);
+  }
+
+  // The natives first, so a failed load adds nothing.
+  const Node *nodes = section<Node>(header.nodes.offset);
+  const uint32_t *top = section<uint32_t>(header.toplevel.offset);
+  for (size_t idx = 0; idx < header.toplevel.count; ++idx) {
+    const Node &n = nodes[top[idx]];
+    if (n.kind == static_cast<uint8_t>(ExprKind::kPrototype)) {
+      const Native *native = natives().find(syms[n.f[1]]);
+      if (!native || native->arity != n.f[3]) {
+        return false;
+      }
+    }
+  }
+  for (size_t idx = 0; idx < header.nodes.count; ++idx) {
+    const Node &n = nodes[idx];
+    if (n.kind == static_cast<uint8_t>(ExprKind::kCall) && n.f[4] != kNone) {
+      const Native *native = natives().find(syms[n.f[4]]);
+      if (!native || native->arity != n.f[2]) {
+        return false;
+      }
+    }
+  }
+  const Import *imports = section<Import>(header.imports.offset);
+  std::vector<const Native *> natives(header.imports.count);
+  for (size_t idx = 0; idx < natives.size(); ++idx) {
+    natives[idx] = smcc::natives().find(syms[imports[idx].name]);
+    if (!natives[idx] || natives[idx]->arity != imports[idx].arity) {
+      return false;
+    }
+  }
+
+  const double *values = section<double>(header.constants.offset);
+  std::vector<uint32_t> ks(header.constants.count);
+  for (size_t idx = 0; idx < ks.size(); ++idx) {
+    ks[idx] = constants().intern(values[idx]);
+  }
+
+  const uint32_t *lists = section<uint32_t>(header.lists.offset);
+  std::vector<Expr *> built(header.nodes.count);
+  std::vector<Expr *> scratch;
+  auto expr = [&](uint32_t idx) {
+    return idx == kNone ? nullptr : built[idx];
+  };
+  auto list = [&](const uint32_t *at) {
+    for (uint32_t idx = 0; idx < at[1]; ++idx) {
+      scratch.push_back(built[lists[at[0] + idx]]);
+    }
+    return arena->take(&scratch);
+  };
+  for (size_t idx = 0; idx < built.size(); ++idx) {
+    const Node &n = nodes[idx];
+    Expr *e = nullptr;
+    switch (static_cast<ExprKind>(n.kind)) {
+      case ExprKind::kVar: {
+        auto var = arena->make<VarExpr>(n.f[0], syms[n.f[1]]);
+        var->slot_ = n.f[2];
+        e = var;
+        break;
+      }
+      case ExprKind::kPrototype: {
+        std::vector<VarExpr *> args;
+        for (uint32_t arg = 0; arg < n.f[3]; ++arg) {
+          args.push_back(static_cast<VarExpr *>(built[lists[n.f[2] + arg]]));
+        }
+        e = arena->make<PrototypeExpr>(n.f[0], syms[n.f[1]],
+                                       arena->take(&args));
+        break;
+      }
+      case ExprKind::kFunction: {
+        auto proto = static_cast<PrototypeExpr *>(built[n.f[0]]);
+        auto func = arena->make<FunctionExpr>(proto, list(&n.f[1]));
+        func->nslots_ = n.f[3];
+        for (uint32_t slot = 0; slot < n.f[5]; ++slot) {
+          func->slot_types_.push_back(static_cast<Type>(lists[n.f[4] + slot]));
+        }
+        func->code_ = n.f[6];
+        func->ints_ = n.flags & kInts;
+        func->recursive_ = n.flags & kRecursive;
+        func->pure_ = n.flags & kPure;
+        e = func;
+        break;
+      }
+      case ExprKind::kIf: {
+        Expr *cond = built[n.f[0]];
+        ExprList body = list(&n.f[1]);
+        e = arena->make<IfExpr>(cond, body, list(&n.f[3]));
+        break;
+      }
+      case ExprKind::kNumber:
+        e = arena->make<NumberExpr>(
+            ks[n.f[0]], n.flags & kIntegral,
+            static_cast<int64_t>(n.f[1] | uint64_t(n.f[2]) << 32));
+        break;
+      case ExprKind::kBinary:
+        e = arena->make<BinaryExpr>(n.f[0], built[n.f[1]], built[n.f[2]]);
+        break;
+      case ExprKind::kCall: {
+        auto call = arena->make<CallExpr>(syms[n.f[0]], list(&n.f[1]));
+        if (n.f[4] != kNone) {
+          call->native_ = smcc::natives().find(syms[n.f[4]]);
+        }
+        call->tail_ = n.flags & kTail;
+        e = call;
+        break;
+      }
+      case ExprKind::kReturn:
+        e = arena->make<ReturnExpe>(expr(n.f[0]));
+        break;
+      case ExprKind::kCast:
+        e = arena->make<CastExpr>(built[n.f[0]], static_cast<Type>(n.type));
+        break;
+    }
+    e->type_ = static_cast<Type>(n.type);
+    built[idx] = e;
+  }
+  // Callees may come after their calls.
+  for (size_t idx = 0; idx < built.size(); ++idx) {
+    if (auto call = expr_cast<CallExpr>(built[idx])) {
+      uint32_t callee = nodes[idx].f[3];
+      if (callee != kNone) {
+        call->callee_ = static_cast<FunctionExpr *>(built[callee]);
+      }
+    }
+  }
+  for (size_t idx = 0; idx < header.toplevel.count; ++idx) {
+    toplevel->push_back(built[top[idx]]);
+  }
+
+  const Function *functions = section<Function>(header.functions.offset);
+  const Instr *code = section<Instr>(header.code.offset);
+  module->funcs_.resize(header.functions.count);
+  for (size_t idx = 0; idx < module->funcs_.size(); ++idx) {
+    const Function &f = functions[idx];
+    BytecodeFunction &fn = module->funcs_[idx];
+    fn.name = syms[f.name];
+    fn.nparams = f.nparams;
+    fn.nregs = f.nregs;
+    fn.code.assign(code + f.code.offset, code + f.code.offset + f.code.count);
+    for (auto &ins : fn.code) {
+      if (ins.op == kOpLoadK) {
+        ins.b = ks[ins.b];
+      }
+    }
+  }
+  module->imports_ = std::move(natives);
+  return true;
+}
+
+bool Image::write(const char *path, uint64_t hash,
+                  const std::vector<Expr *> &toplevel, const Module &module) {
+  std::vector<char> bytes = Writer(toplevel, module).bytes(hash);
+  std::string tmp = std::string(path) + "." + std::to_string(getpid());
+  FILE *fp = fopen(tmp.c_str(), "wb");
+  if (!fp) {
+    return false;
+  }
+  bool ok = fwrite(bytes.data(), 1, bytes.size(), fp) == bytes.size();
+  ok = fclose(fp) == 0 && ok;
+  if (!ok || rename(tmp.c_str(), path) != 0) {
+    remove(tmp.c_str());
+    return false;
+  }
+  return true;
+}
+
+}  // namespace smcc
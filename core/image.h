@@ -0,0 +1,64 @@
+// Copyright (c) 2020 smarsufan. All Rights Reserved.
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "arena.h"
+#include "bytecode.h"
+#include "expr.h"
+#include "reader.h"
+
+namespace smcc {
+
+// Bumped whenever the layout below, the nodes or the opcodes change, so
+// images of another build are never loaded.
+constexpr uint32_t kImageVersion = 2;
+
+// FNV-1a of a program's source; an image is only loaded for the source
+// it was made from.
+uint64_t SourceHash(const char *data, size_t size);
+
+/// A parsed, resolved, linked and compiled program as a file, so later
+/// processes map it instead of parsing.
+///
+/// Nothing in the file is a pointer. Symbols, constants and natives are
+/// stored by name or value and interned once on load. The nodes are
+/// fixed-size records referring to each other by index, children before
+/// parents, so they are rebuilt in one pass. The bytecode is copied as
+/// it is, fixing up only the constant of each LoadK.
+class Image {
+ public:
+  // Maps the file at path, if there is one.
+  explicit Image(const char *path);
+
+  // Whether the file is an image of this version, whole, made from source
+  // with hash, and with every index in it in bounds.
+  bool valid(uint64_t hash) const;
+
+  // Rebuild the program into arena, appending the functions and externs
+  // to toplevel, and its bytecode into module, which must be empty.
+  // Returns false, adding nothing, if a native it calls is not
+  // registered as it was when the image was written.
+  bool load(Arena *arena, std::vector<Expr *> *toplevel,
+            Module *module) const;
+
+  // Write the program parsed from source with hash: its toplevel and the
+  // module compiled from it. The file is replaced at once, so readers
+  // never see half of it. Returns false if path can not be written.
+  static bool write(const char *path, uint64_t hash,
+                    const std::vector<Expr *> &toplevel,
+                    const Module &module);
+
+ private:
+  template <typename T>
+  const T *section(uint32_t offset) const {
+    return reinterpret_cast<const T *>(file_.data() + offset);
+  }
+
+ private:
+  ReaderMmap file_;
+};
+
+}  // namespace smcc
@@ -0,0 +1,408 @@
+// Copyright (c) 2020 smarsufan. All Rights Reserved.
+
+#include "jit.h"
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cstring>
+
+namespace smcc {
+
+namespace {
+
+// Opcode bytes after the prefix, by X64Assembler::Sse.
+const struct {
+  uint8_t prefix;
+  uint8_t op;
+} kSse[] = {
+  {0xf2, 0x58},  // addsd
+  {0xf2, 0x5c},  // subsd
+  {0xf2, 0x59},  // mulsd
+  {0xf2, 0x5e},  // divsd
+  {0x66, 0x28},  // movapd
+  {0x66, 0x54},  // andpd
+  {0x66, 0xef},  // pxor
+  {0x66, 0x2e},  // ucomisd
+  {0xf2, 0x51},  // sqrtsd
+};
+
+// Opcodes of X64Assembler::Alu, r/m op= reg, but imul, reg op= r/m.
+const uint8_t kAlu[] = {
+  0x01,  // add
+  0x29,  // sub
+  0xaf,  // imul, after 0x0f
+  0x39,  // cmp
+  0x85,  // test
+  0x89,  // mov
+};
+
+// The most ints and doubles an entry point with ints is called with:
+// those passed in registers.
+constexpr size_t kIntParams = 6;
+constexpr size_t kDoubleParams = 8;
+
+void Patch32(uint8_t *at, int32_t value) {
+  memcpy(at, &value, sizeof(value));
+}
+
+}  // namespace
+
+Jit::Jit(const Program &program, bool registers) : program_(&program) {
+#if !defined(__x86_64__)
+  fprintf(stderr, "jit -100: the JIT only targets x86-64\n");
+  abort();
+#endif
+  for (auto expr : program.toplevel()) {
+    if (auto func = expr_cast<FunctionExpr>(expr)) {
+      LowerX64(func, this, registers);
+    }
+  }
+
+  for (auto &call : calls_) {
+    size_t target = entries_.at(call.second);
+    Patch32(&code_[call.first], target - (call.first + 4));
+  }
+
+  // The constants, 8-aligned after the code.
+  code_.resize((code_.size() + 7) & ~size_t(7));
+  size_t table = code_.size();
+  code_.resize(table + table_.size() * sizeof(double));
+  if (!table_.empty()) {
+    memcpy(&code_[table], table_.data(), table_.size() * sizeof(double));
+  }
+  for (auto &load : loads_) {
+    size_t at = table + load.second * sizeof(double);
+    Patch32(&code_[load.first], at - (load.first + 4));
+  }
+
+  // Writable while the code goes in, executable after; never both.
+  size_t page = sysconf(_SC_PAGESIZE);
+  size_ = code_.size();
+  mapped_ = (size_ + page - 1) / page * page;
+  void *mem = mmap(nullptr, mapped_, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mem == MAP_FAILED) {
+    fprintf(stderr, "jit -200: can not map %zu bytes\n", mapped_);
+    abort();
+  }
+  mem_ = static_cast<uint8_t *>(mem);
+  memcpy(mem_, code_.data(), size_);
+  if (mprotect(mem_, mapped_, PROT_READ | PROT_EXEC) != 0) {
+    fprintf(stderr, "jit -300: can not make code executable\n");
+    abort();
+  }
+  __builtin___clear_cache(reinterpret_cast<char *>(mem_),
+                          reinterpret_cast<char *>(mem_ + size_));
+  code_ = std::vector<uint8_t>();
+}
+
+Jit::~Jit() {
+  if (mem_) {
+    munmap(mem_, mapped_);
+  }
+}
+
+void *Jit::entry(const FunctionExpr *func) const {
+  auto it = entries_.find(func);
+  return it == entries_.end() ? nullptr : mem_ + it->second;
+}
+
+double Jit::call(const FunctionExpr *func, const double *args,
+                 size_t nargs) const {
+  void *fn = entry(func);
+  if (!fn) {
+    fprintf(stderr, "jit -400: function is not compiled\n");
+    abort();
+  }
+  size_t nparams = func->proto_->args_.size();
+  if (func->ints_) {
+    // Each class of registers is filled in order, whatever the order of
+    // the parameters, and unused ones are ignored.
+    double d[kDoubleParams] = {};
+    int64_t i[kIntParams] = {};
+    size_t nd = 0, ni = 0;
+    for (size_t p = 0; p < nparams; ++p) {
+      Type type = func->proto_->args_[p]->type_;
+      double arg = p < nargs ? args[p] : 0;
+      if (type == Type::kInt ? ni == kIntParams : nd == kDoubleParams) {
+        fprintf(stderr, "jit -500: %s takes more than %zu ints or %zu "
+                "doubles\n", symbols().name(func->proto_->name_).c_str(),
+                kIntParams, kDoubleParams);
+        abort();
+      }
+      if (type == Type::kInt) {
+        i[ni++] = TruncInt(arg);
+      }
+      else {
+        d[nd++] = arg;
+      }
+    }
+    if (func->type_ == Type::kInt) {
+      auto f = reinterpret_cast<int64_t (*)(
+          double, double, double, double, double, double, double, double,
+          int64_t, int64_t, int64_t, int64_t, int64_t, int64_t)>(fn);
+      return f(d[0], d[1], d[2], d[3], d[4], d[5], d[6], d[7], i[0], i[1],
+               i[2], i[3], i[4], i[5]);
+    }
+    auto f = reinterpret_cast<double (*)(
+        double, double, double, double, double, double, double, double,
+        int64_t, int64_t, int64_t, int64_t, int64_t, int64_t)>(fn);
+    return f(d[0], d[1], d[2], d[3], d[4], d[5], d[6], d[7], i[0], i[1], i[2],
+             i[3], i[4], i[5]);
+  }
+  if (nparams > kMaxNativeArgs) {
+    fprintf(stderr, "jit -500: %s takes more than %u arguments\n",
+            symbols().name(func->proto_->name_).c_str(), kMaxNativeArgs);
+    abort();
+  }
+  // An entry point is called just like a native.
+  double a[kMaxNativeArgs] = {};
+  memcpy(a, args, std::min(nargs, nparams) * sizeof(double));
+  Native native;
+  native.arity = nparams;
+  native.fn = reinterpret_cast<void (*)()>(fn);
+  return native.call(a);
+}
+
+double Jit::call(const std::string &name,
+                 const std::vector<double> &args) const {
+  FunctionExpr *func = program_->function(name);
+  if (!func) {
+    fprintf(stderr, "jit -400: undefined function %s\n", name.c_str());
+    abort();
+  }
+  return call(func, args.data(), args.size());
+}
+
+void Jit::emit(std::initializer_list<uint8_t> bytes) {
+  code_.insert(code_.end(), bytes);
+}
+
+void Jit::imm32(uint32_t value) {
+  for (int shift = 0; shift < 32; shift += 8) {
+    code_.push_back(static_cast<uint8_t>(value >> shift));
+  }
+}
+
+void Jit::rex_w(int reg, int rm) {
+  code_.push_back(0x48 | (reg & 8) >> 1 | (rm & 8) >> 3);
+}
+
+void Jit::modrm(int reg, int rm) {
+  code_.push_back(static_cast<uint8_t>(0xc0 | (reg & 7) << 3 | (rm & 7)));
+}
+
+void Jit::rbp(int reg, int disp) {
+  // mod 01 takes a disp8, mod 10 a disp32; rm 101 is rbp.
+  if (disp >= -128 && disp <= 127) {
+    emit({static_cast<uint8_t>(0x45 | reg << 3), static_cast<uint8_t>(disp)});
+  }
+  else {
+    emit({static_cast<uint8_t>(0x85 | reg << 3)});
+    imm32(disp);
+  }
+}
+
+void Jit::sse_op(uint8_t prefix, uint8_t op, int reg, int rm) {
+  code_.push_back(prefix);
+  if ((reg | rm) & 8) {
+    code_.push_back(0x40 | (reg & 8) >> 1 | (rm & 8) >> 3);
+  }
+  emit({0x0f, op});
+}
+
+void Jit::rel32(uint32_t label) {
+  jumps_.emplace_back(code_.size(), label);
+  imm32(0);
+}
+
+void Jit::begin(FunctionExpr *func) {
+  // Align entries like a compiler would, with int3 padding.
+  while (code_.size() % 16) {
+    code_.push_back(0xcc);
+  }
+  entries_[func] = code_.size();
+  labels_.clear();
+  jumps_.clear();
+  emit({0x55});                    // push %rbp
+  emit({0x48, 0x89, 0xe5});        // mov %rsp, %rbp
+  emit({0x48, 0x81, 0xec});        // sub $frame, %rsp
+  frame_at_ = code_.size();
+  imm32(0);
+}
+
+void Jit::end(FunctionExpr *func, int frame) {
+  Patch32(&code_[frame_at_], frame);
+  for (auto &jump : jumps_) {
+    Patch32(&code_[jump.first], labels_[jump.second] - (jump.first + 4));
+  }
+}
+
+void Jit::load(int xmm, int disp) {
+  sse_op(0xf2, 0x10, xmm, 0);      // movsd disp(%rbp), %xmm
+  rbp(xmm & 7, disp);
+}
+
+void Jit::store(int disp, int xmm) {
+  sse_op(0xf2, 0x11, xmm, 0);      // movsd %xmm, disp(%rbp)
+  rbp(xmm & 7, disp);
+}
+
+void Jit::constant(int xmm, double value) {
+  uint32_t k = constants().intern(value);
+  auto it = slots_.find(k);
+  if (it == slots_.end()) {
+    it = slots_.emplace(k, table_.size()).first;
+    table_.push_back(value);
+  }
+  // movsd disp32(%rip), %xmm
+  sse_op(0xf2, 0x10, xmm, 0);
+  emit({static_cast<uint8_t>(0x05 | (xmm & 7) << 3)});
+  loads_.emplace_back(code_.size(), it->second);
+  imm32(0);
+}
+
+void Jit::sse(Sse op, int dst, int src) {
+  sse_op(kSse[op].prefix, kSse[op].op, dst, src);
+  emit({static_cast<uint8_t>(0xc0 | (dst & 7) << 3 | (src & 7))});
+}
+
+void Jit::cmpsd(Pred pred, int dst, int src) {
+  sse_op(0xf2, 0xc2, dst, src);
+  emit({static_cast<uint8_t>(0xc0 | (dst & 7) << 3 | (src & 7)),
+        static_cast<uint8_t>(pred)});
+}
+
+void Jit::load_int(int reg, int disp) {
+  rex_w(reg, 0);
+  emit({0x8b});                    // mov disp(%rbp), %reg
+  rbp(reg & 7, disp);
+}
+
+void Jit::store_int(int disp, int reg) {
+  rex_w(reg, 0);
+  emit({0x89});                    // mov %reg, disp(%rbp)
+  rbp(reg & 7, disp);
+}
+
+void Jit::constant_int(int reg, int64_t value) {
+  if (value >= INT32_MIN && value <= INT32_MAX) {
+    rex_w(0, reg);
+    emit({0xc7});                  // mov $imm32, %reg, sign extended
+    modrm(0, reg);
+    imm32(static_cast<uint32_t>(value));
+    return;
+  }
+  rex_w(0, reg);
+  code_.push_back(0xb8 | (reg & 7));  // movabs $imm64, %reg
+  imm32(static_cast<uint32_t>(value));
+  imm32(static_cast<uint32_t>(static_cast<uint64_t>(value) >> 32));
+}
+
+void Jit::alu(Alu op, int dst, int src) {
+  if (op == kImul) {
+    rex_w(dst, src);
+    emit({0x0f, kAlu[op]});
+    modrm(dst, src);
+    return;
+  }
+  rex_w(src, dst);
+  emit({kAlu[op]});
+  modrm(src, dst);
+}
+
+void Jit::neg(int reg) {
+  rex_w(0, reg);
+  emit({0xf7});                    // neg %reg
+  modrm(3, reg);
+}
+
+void Jit::idiv(int src) {
+  emit({0x48, 0x99});              // cqo
+  rex_w(0, src);
+  emit({0xf7});                    // idiv %src
+  modrm(7, src);
+}
+
+void Jit::setcc(Cond cond) {
+  emit({0x0f, static_cast<uint8_t>(0x90 | cond), 0xc0});  // setcc %al
+  emit({0x48, 0x0f, 0xb6, 0xc0});  // movzbq %al, %rax
+}
+
+void Jit::cvtsi2sd(int xmm, int reg) {
+  code_.push_back(0xf2);
+  rex_w(xmm, reg);
+  emit({0x0f, 0x2a});
+  modrm(xmm, reg);
+}
+
+void Jit::cvttsd2si(int reg, int xmm) {
+  code_.push_back(0xf2);
+  rex_w(reg, xmm);
+  emit({0x0f, 0x2c});
+  modrm(reg, xmm);
+}
+
+void Jit::movq(int reg, int xmm) {
+  code_.push_back(0x66);
+  rex_w(xmm, reg);
+  emit({0x0f, 0x7e});              // movq %xmm, %reg
+  modrm(xmm, reg);
+}
+
+uint32_t Jit::new_label() {
+  labels_.push_back(0);
+  return labels_.size() - 1;
+}
+
+void Jit::bind(uint32_t label) {
+  labels_[label] = code_.size();
+}
+
+void Jit::jcc(Cond cond, uint32_t label) {
+  emit({0x0f, static_cast<uint8_t>(0x80 | cond)});
+  rel32(label);
+}
+
+void Jit::jmp(uint32_t label) {
+  emit({0xe9});
+  rel32(label);
+}
+
+void Jit::push(int disp) {
+  emit({0xff});                    // push disp(%rbp)
+  rbp(6, disp);
+}
+
+void Jit::add_rsp(int bytes) {
+  emit({0x48, 0x81, 0xc4});        // add $bytes, %rsp
+  imm32(bytes);
+}
+
+void Jit::call(FunctionExpr *callee) {
+  emit({0xe8});
+  calls_.emplace_back(code_.size(), callee);
+  imm32(0);
+}
+
+void Jit::call(const Native *native) {
+  // Host code may be anywhere in the address space.
+  uint64_t fn = reinterpret_cast<uint64_t>(native->fn);
+  emit({0x48, 0xb8});              // mov $fn, %rax
+  imm32(static_cast<uint32_t>(fn));
+  imm32(static_cast<uint32_t>(fn >> 32));
+  emit({0xff, 0xd0});              // call *%rax
+}
+
+void Jit::tail(FunctionExpr *callee) {
+  emit({0xc9, 0xe9});              // leave; jmp callee
+  calls_.emplace_back(code_.size(), callee);
+  imm32(0);
+}
+
+void Jit::ret() {
+  emit({0xc9, 0xc3});              // leave; ret
+}
+
+}  // namespace smcc
@@ -0,0 +1,127 @@
+// Copyright (c) 2020 smarsufan. All Rights Reserved.
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "program.h"
+#include "x64.h"
+
+namespace smcc {
+
+/// Compiles a program's functions to x86-64 machine code in memory.
+///
+/// The code is what CodeGen would write, encoded directly. It is built in
+/// a buffer, copied to fresh pages while they are writable, and the pages
+/// are made executable (never both) before any entry point is handed out.
+/// Entry points are plain System V functions taking the function's
+/// parameters, `double (*)(double, ...)` for one without ints; an int
+/// parameter or result is an int64_t. They may be called from any thread.
+class Jit : private X64Assembler {
+ public:
+  // registers as for LowerX64(); false keeps every value in the frame.
+  explicit Jit(const Program &program, bool registers = true);
+
+  ~Jit();
+
+  Jit(const Jit &) = delete;
+
+  Jit &operator=(const Jit &) = delete;
+
+  // The entry point of func, or nullptr if it is not in the program.
+  void *entry(const FunctionExpr *func) const;
+
+  // The entry point of name as Fn, e.g. double (*)(double, double).
+  template <typename Fn>
+  Fn function(const std::string &name) const {
+    return reinterpret_cast<Fn>(entry(program_->function(name)));
+  }
+
+  // func(args[0], ..., args[nargs - 1]); missing arguments are 0. func
+  // takes at most kMaxNativeArgs parameters, or with ints, at most 8
+  // doubles and 6 ints. Ints are converted from and to doubles.
+  double call(const FunctionExpr *func, const double *args,
+              size_t nargs) const;
+
+  double call(const std::string &name, const std::vector<double> &args) const;
+
+  // Bytes of code and constants.
+  size_t size() const { return size_; }
+
+ private:
+  void emit(std::initializer_list<uint8_t> bytes);
+
+  void imm32(uint32_t value);
+
+  // A REX.W with the high bits of the ModRM reg and rm fields.
+  void rex_w(int reg, int rm);
+
+  // A ModRM for two registers.
+  void modrm(int reg, int rm);
+
+  // A ModRM for reg and disp(%rbp), with its displacement.
+  void rbp(int reg, int disp);
+
+  // An SSE opcode, 0x0f op after prefix, with a REX for xmm8-15 in the
+  // ModRM reg or rm field.
+  void sse_op(uint8_t prefix, uint8_t op, int reg, int rm);
+
+  // A rel32 to be pointed at label once it is bound.
+  void rel32(uint32_t label);
+
+  void begin(FunctionExpr *func) override;
+  void end(FunctionExpr *func, int frame) override;
+  void load(int xmm, int disp) override;
+  void store(int disp, int xmm) override;
+  void constant(int xmm, double value) override;
+  void sse(Sse op, int dst, int src) override;
+  void cmpsd(Pred pred, int dst, int src) override;
+  void load_int(int reg, int disp) override;
+  void store_int(int disp, int reg) override;
+  void constant_int(int reg, int64_t value) override;
+  void alu(Alu op, int dst, int src) override;
+  void neg(int reg) override;
+  void idiv(int src) override;
+  void setcc(Cond cond) override;
+  void cvtsi2sd(int xmm, int reg) override;
+  void cvttsd2si(int reg, int xmm) override;
+  void movq(int reg, int xmm) override;
+  uint32_t new_label() override;
+  void bind(uint32_t label) override;
+  void jcc(Cond cond, uint32_t label) override;
+  void jmp(uint32_t label) override;
+  void push(int disp) override;
+  void add_rsp(int bytes) override;
+  void call(FunctionExpr *callee) override;
+  void call(const Native *native) override;
+  void tail(FunctionExpr *callee) override;
+  void ret() override;
+
+ private:
+  const Program *program_;
+
+  // Code being built; offsets below are into it.
+  std::vector<uint8_t> code_;
+  std::unordered_map<const FunctionExpr *, size_t> entries_;
+  // Where the current function's frame size goes.
+  size_t frame_at_{0};
+  // Label offsets of the current function, and the rel32s to them.
+  std::vector<size_t> labels_;
+  std::vector<std::pair<size_t, uint32_t>> jumps_;
+  // rel32s to functions, resolved once all are placed.
+  std::vector<std::pair<size_t, const FunctionExpr *>> calls_;
+  // Constants go after the code, each once; disp32s to them.
+  std::vector<double> table_;
+  std::unordered_map<uint32_t, uint32_t> slots_;
+  std::vector<std::pair<size_t, uint32_t>> loads_;
+
+  uint8_t *mem_{nullptr};
+  size_t size_{0};
+  size_t mapped_{0};
+};
+
+}  // namespace smcc
@@ -0,0 +1,287 @@
+// Copyright (c) 2020 smarsufan. All Rights Reserved.
+
+#include "lexer.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <thread>
+
+#include "ast.h"
+
+namespace smcc {
+
+namespace {
+
+inline bool IsSpace(unsigned char c) {
+  return c == ' ' || (c >= '\t' && c <= '\r');
+}
+
+inline bool IsAlpha(unsigned char c) {
+  return static_cast<unsigned char>((c | 0x20) - 'a') < 26;
+}
+
+inline bool IsDigit(unsigned char c) {
+  return static_cast<unsigned char>(c - '0') < 10;
+}
+
+inline bool IsAlnum(unsigned char c) {
+  return IsAlpha(c) || IsDigit(c);
+}
+
+inline bool IsNumber(unsigned char c) {
+  return IsDigit(c) || c == '.';
+}
+
+// Most runs are a few bytes long, so look at those inline and only call the
+// vector kernel for the rest.
+template <bool (*kIn)(unsigned char)>
+inline const char *Skip(const char *p, const char *end,
+                        const char *(*kernel)(const char *, const char *)) {
+  for (int i = 0; i < 8; ++i, ++p) {
+    if (p == end || !kIn(*p)) {
+      return p;
+    }
+  }
+  return kernel(p, end);
+}
+
+const double kPow10[] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8,
+  1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15,
+};
+
+}  // namespace
+
+int KeywordToken(const char *s, size_t n) {
+  switch (n) {
+    case 2:
+      if (s[0] == 'i' && s[1] == 'f') return tok_if;
+      break;
+    case 3:
+      if (memcmp(s, "def", 3) == 0) return tok_def;
+      if (memcmp(s, "int", 3) == 0) return tok_int;
+      break;
+    case 4:
+      if (memcmp(s, "else", 4) == 0) return tok_else;
+      break;
+    case 6:
+      switch (s[0]) {
+        case 'e':
+          if (memcmp(s, "extern", 6) == 0) return tok_extern;
+          break;
+        case 'd':
+          if (memcmp(s, "double", 6) == 0) return tok_dbl;
+          break;
+        case 'r':
+          if (memcmp(s, "return", 6) == 0) return tok_return;
+          break;
+      }
+      break;
+  }
+  return tok_identifier;
+}
+
+double ParseNumber(const char *s, size_t n) {
+  // Fast path: with at most 15 digits both the mantissa and the power of
+  // ten are exact doubles, so a single division is correctly rounded.
+  uint64_t mant = 0;
+  int digits = 0;
+  int frac = -1;
+  bool fast = n <= 16;
+  for (size_t i = 0; fast && i < n; ++i) {
+    if (IsDigit(s[i])) {
+      mant = mant * 10 + (s[i] - '0');
+      ++digits;
+      if (frac >= 0) {
+        ++frac;
+      }
+    }
+    else if (frac < 0) {
+      frac = 0;
+    }
+    else {
+      fast = false;  // "1.2.3", strtod stops at the second '.'.
+    }
+  }
+  if (fast && digits > 0 && digits <= 15) {
+    double value = static_cast<double>(mant);
+    if (frac > 0) {
+      value /= kPow10[frac];
+    }
+    return value;
+  }
+
+  char buf[64];
+  if (n < sizeof(buf)) {
+    memcpy(buf, s, n);
+    buf[n] = '\0';
+    return strtod(buf, nullptr);
+  }
+  return strtod(std::string(s, n).c_str(), nullptr);
+}
+
+bool ParseInt(const char *s, size_t n, int64_t *value) {
+  uint64_t v = 0;
+  for (size_t i = 0; i < n; ++i) {
+    uint64_t digit = s[i] - '0';
+    if (v > (static_cast<uint64_t>(INT64_MAX) - digit) / 10) {
+      return false;
+    }
+    v = v * 10 + digit;
+  }
+  *value = static_cast<int64_t>(v);
+  return true;
+}
+
+int Lexer::gettok() {
+  const char *p = cur_;
+
+  while (true) {
+    // Skip any whitespace.
+    p = Skip<IsSpace>(p, end_, scan_->skip_space);
+
+    if (p + 1 < end_ && p[0] == '/' && p[1] == '/') {
+      // Comment until end of line.
+      p = scan_->skip_line(p + 2, end_);
+      continue;
+    }
+    break;
+  }
+
+  tok_ = p;
+  if (p == end_) {
+    len_ = 0;
+    cur_ = p;
+    return tok_eof;
+  }
+
+  unsigned char c = *p++;
+  int tok = c;
+  if (IsAlpha(c)) { // identifier: [a-zA-Z][a-zA-Z0-9]*
+    p = Skip<IsAlnum>(p, end_, scan_->skip_ident);
+    tok = KeywordToken(tok_, p - tok_);
+  }
+  else if (IsDigit(c) || c == '.') { // Number: [0-9.]+
+    p = Skip<IsNumber>(p, end_, scan_->skip_number);
+    num_val_ = ParseNumber(tok_, p - tok_);
+    tok = tok_number;
+  }
+  else {
+    bool eq = p < end_ && *p == '=';
+    switch (c) {
+      case '/': tok = tok_div; break;
+      case '+': tok = tok_add; break;
+      case '-': tok = tok_sub; break;
+      case '*': tok = tok_mul; break;
+      case '<': tok = eq ? (++p, tok_lessequal) : tok_less; break;
+      case '>': tok = eq ? (++p, tok_greatequal) : tok_great; break;
+      case '=': tok = eq ? (++p, tok_equal) : tok_assign; break;
+    }
+  }
+
+  len_ = static_cast<uint32_t>(p - tok_);
+  cur_ = p;
+  return tok;
+}
+
+namespace {
+
+// Lex [begin, end) into out, offsets relative to base. No tok_eof.
+void LexChunk(const char *base, const char *begin, const char *end,
+              TokenStream *out) {
+  Lexer lexer(begin, end);
+  uint32_t shift = static_cast<uint32_t>(begin - base);
+  // Dense code has about one token every three bytes.
+  size_t guess = (end - begin) / 2 + 1;
+  out->kinds.reserve(guess);
+  out->offsets.reserve(guess);
+  out->lengths.reserve(guess);
+
+  int tok;
+  while ((tok = lexer.gettok()) != tok_eof) {
+    out->kinds.push_back(static_cast<int16_t>(tok));
+    out->offsets.push_back(lexer.offset() + shift);
+    out->lengths.push_back(lexer.length());
+    if (tok == tok_number) {
+      out->numbers.push_back(lexer.num_val());
+    }
+  }
+}
+
+template <typename T>
+void Append(std::vector<T> *dst, const std::vector<T> &src) {
+  dst->insert(dst->end(), src.begin(), src.end());
+}
+
+}  // namespace
+
+TokenStream Tokenize(const char *begin, const char *end, int threads,
+                     size_t chunk_bytes) {
+  size_t size = end - begin;
+  if (threads <= 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  size_t n_chunks = std::min<size_t>(threads, size / chunk_bytes + 1);
+
+  // No token spans a newline (comments stop in front of it), so lexing can
+  // restart right after any '\n'.
+  std::vector<const char *> cuts = {begin};
+  for (size_t i = 1; i < n_chunks; ++i) {
+    const char *cut = std::max(cuts.back(), begin + size * i / n_chunks);
+    cut = static_cast<const char *>(memchr(cut, '\n', end - cut));
+    if (!cut) {
+      break;
+    }
+    cuts.push_back(cut + 1);
+  }
+  cuts.push_back(end);
+
+  TokenStream stream;
+  if (cuts.size() == 2) {
+    LexChunk(begin, begin, end, &stream);
+  }
+  else {
+    std::vector<TokenStream> chunks(cuts.size() - 1);
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < chunks.size(); ++i) {
+      workers.emplace_back(LexChunk, begin, cuts[i], cuts[i + 1], &chunks[i]);
+    }
+    LexChunk(begin, cuts[0], cuts[1], &chunks[0]);
+    for (auto &worker : workers) {
+      worker.join();
+    }
+
+    size_t n = 0, n_numbers = 0;
+    for (auto &chunk : chunks) {
+      n += chunk.size();
+      n_numbers += chunk.numbers.size();
+    }
+    stream.kinds.reserve(n + 1);
+    stream.offsets.reserve(n + 1);
+    stream.lengths.reserve(n + 1);
+    stream.numbers.reserve(n_numbers);
+    for (auto &chunk : chunks) {
+      Append(&stream.kinds, chunk.kinds);
+      Append(&stream.offsets, chunk.offsets);
+      Append(&stream.lengths, chunk.lengths);
+      Append(&stream.numbers, chunk.numbers);
+    }
+  }
+
+  // Interning is serial, after the chunks are stitched.
+  SymbolTable &table = symbols();
+  for (size_t i = 0; i < stream.size(); ++i) {
+    if (stream.kinds[i] == tok_identifier) {
+      stream.symbols.push_back(
+          table.intern(begin + stream.offsets[i], stream.lengths[i]));
+    }
+  }
+
+  stream.kinds.push_back(tok_eof);
+  stream.offsets.push_back(static_cast<uint32_t>(size));
+  stream.lengths.push_back(0);
+  return stream;
+}
+
+}  // namespace smcc
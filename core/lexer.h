@@ -0,0 +1,85 @@
+// Copyright (c) 2020 smarsufan. All Rights Reserved.
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "scan.h"
+#include "symbol.h"
+
+namespace smcc {
+
+/// Keyword token for the identifier [s, s + n), or tok_identifier.
+int KeywordToken(const char *s, size_t n);
+
+/// Parse the number literal [s, s + n) without copying it to the heap.
+double ParseNumber(const char *s, size_t n);
+
+/// The integral literal [s, s + n), digits only, exactly. Returns false if
+/// it does not fit an int64_t.
+bool ParseInt(const char *s, size_t n, int64_t *value);
+
+/// The lexer over a contiguous buffer.
+///
+/// Unlike AST::gettok() on a streaming Reader, identifiers and numbers are
+/// not copied: the current token is a span (offset, length) of the source.
+class Lexer {
+ public:
+  Lexer() = default;
+
+  Lexer(const char *begin, const char *end)
+      : begin_(begin), cur_(begin), end_(end), scan_(&scan_ops()) {}
+
+  // get a tok.
+  int gettok();
+
+  // The span of the last token.
+  uint32_t offset() const { return static_cast<uint32_t>(tok_ - begin_); }
+
+  uint32_t length() const { return len_; }
+
+  const char *text() const { return tok_; }
+
+  std::string str() const { return std::string(tok_, len_); }
+
+  // The value of the last tok_number.
+  double num_val() const { return num_val_; }
+
+  const char *begin() const { return begin_; }
+
+  const char *end() const { return end_; }
+
+ private:
+  const char *begin_{nullptr};
+  const char *cur_{nullptr};
+  const char *end_{nullptr};
+  const ScanOps *scan_{&scan_ops()};
+
+  const char *tok_{nullptr};
+  uint32_t len_{0};
+  double num_val_{0};
+};
+
+/// All tokens of a source, struct-of-arrays, ending with tok_eof.
+struct TokenStream {
+  std::vector<int16_t> kinds;
+  std::vector<uint32_t> offsets;
+  std::vector<uint32_t> lengths;
+  // The payload of each tok_number, in order.
+  std::vector<double> numbers;
+  // The interned name of each tok_identifier, in order.
+  std::vector<Symbol> symbols;
+
+  size_t size() const { return kinds.size(); }
+};
+
+// Sources bigger than this are lexed in chunks on several threads.
+constexpr size_t kChunkBytes = 1 << 20;
+
+/// Lex [begin, end) up front. threads <= 0 uses every core.
+TokenStream Tokenize(const char *begin, const char *end, int threads = 0,
+                     size_t chunk_bytes = kChunkBytes);
+
+}  // namespace smcc
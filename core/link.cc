@@ -0,0 +1,249 @@
+// Copyright (c) 2020 smarsufan. All Rights Reserved.
+
+#include "link.h"
+
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+
+#include "ast.h"
+#include "native.h"
+
+namespace smcc {
+
+namespace {
+
+class Linker {
+ public:
+  explicit Linker(const LinkScope *scope) : scope_(scope) {}
+
+  void run(const std::vector<Expr *> &exprs) {
+    for (auto expr : exprs) {
+      if (auto func = expr_cast<FunctionExpr>(expr)) {
+        define(func);
+      }
+    }
+    for (auto expr : exprs) {
+      auto proto = expr_cast<PrototypeExpr>(expr);
+      if (proto) {
+        declare(proto);
+      }
+    }
+    for (id_ = 0; id_ < defs_.size(); ++id_) {
+      func_ = defs_[id_];
+      body(func_->body_);
+    }
+    components();
+  }
+
+ private:
+  const char *name(Symbol sym) const { return symbols().name(sym).c_str(); }
+
+  // The function linked before as name, or nullptr.
+  FunctionExpr *outer(Symbol sym) const {
+    return scope_ ? scope_->function(sym) : nullptr;
+  }
+
+  bool declared(Symbol sym) const {
+    return externs_.count(sym) || (scope_ && scope_->declared(sym));
+  }
+
+  void define(FunctionExpr *func) {
+    Symbol sym = func->proto_->name_;
+    if (!funcs_.emplace(sym, defs_.size()).second || outer(sym)) {
+      fprintf(stderr, "link -500: %s is defined twice\n", name(sym));
+      abort();
+    }
+    if (scope_ && scope_->declared(sym)) {
+      fprintf(stderr, "link -300: %s is both extern and defined\n",
+              name(sym));
+      abort();
+    }
+    defs_.push_back(func);
+    calls_.emplace_back();
+    impure_.push_back(false);
+  }
+
+  void declare(PrototypeExpr *proto) {
+    const Native *native = natives().find(proto->name_);
+    if (!native) {
+      fprintf(stderr, "link -100: extern %s is not registered\n",
+              name(proto->name_));
+      abort();
+    }
+    if (native->arity != proto->args_.size()) {
+      fprintf(stderr, "link -200: extern %s declares %zu parameters, the "
+              "native takes %u\n", name(proto->name_),
+              proto->args_.size(), native->arity);
+      abort();
+    }
+    if (funcs_.count(proto->name_) || outer(proto->name_)) {
+      fprintf(stderr, "link -300: %s is both extern and defined\n",
+              name(proto->name_));
+      abort();
+    }
+    externs_.insert(proto->name_);
+  }
+
+  void body(const ExprList &exprs) {
+    for (auto expr : exprs) {
+      visit(expr);
+    }
+  }
+
+  void visit(Expr *expr) {
+    if (auto bin = expr_cast<BinaryExpr>(expr)) {
+      visit(bin->lhs_);
+      visit(bin->rhs_);
+    }
+    else if (auto call = expr_cast<CallExpr>(expr)) {
+      body(call->args_);
+      bind(call);
+    }
+    else if (auto cond = expr_cast<IfExpr>(expr)) {
+      visit(cond->cond_);
+      body(cond->body_);
+      body(cond->other_);
+    }
+    else if (auto ret = expr_cast<ReturnExpe>(expr)) {
+      visit(ret->expr_);
+      auto call = expr_cast<CallExpr>(ret->expr_);
+      if (call && call->callee_) {
+        call->tail_ = true;
+      }
+    }
+  }
+
+  void bind(CallExpr *call) {
+    auto it = funcs_.find(call->id_);
+    FunctionExpr *callee = it != funcs_.end() ? defs_[it->second]
+                                              : outer(call->id_);
+    if (callee) {
+      if (it != funcs_.end()) {
+        calls_[id_].push_back(it->second);
+      }
+      else if (!callee->pure_) {
+        // Linked before, so not on a cycle with this function.
+        impure_[id_] = true;
+      }
+      if (callee->proto_->args_.size() != call->args_.size()) {
+        fprintf(stderr, "link -600: %s takes %zu arguments, %zu given in "
+                "%s\n", name(call->id_), callee->proto_->args_.size(),
+                call->args_.size(), name(func_->proto_->name_));
+        abort();
+      }
+      call->callee_ = callee;
+      return;
+    }
+    if (!declared(call->id_) && !natives().builtin(call->id_)) {
+      fprintf(stderr, "link -700: undefined function %s in %s\n",
+              name(call->id_), name(func_->proto_->name_));
+      abort();
+    }
+    const Native *native = natives().find(call->id_);
+    if (native->arity != call->args_.size()) {
+      fprintf(stderr, "link -400: %s takes %u arguments, %zu given in %s\n",
+              name(call->id_), native->arity, call->args_.size(),
+              name(func_->proto_->name_));
+      abort();
+    }
+    call->native_ = native;
+    if (!natives().builtin(call->id_)) {
+      impure_[id_] = true;
+    }
+  }
+
+  // Find the strongly connected components of the call graph (Tarjan's,
+  // without recursion). Functions on a cycle, in a component of more than
+  // one or of one that calls itself, are recursive. A component is pure
+  // unless it calls an extern or an impure component; those come out of
+  // the stack first, so they are known by then.
+  void components() {
+    size_t n = defs_.size();
+    std::vector<int> index(n, -1), low(n, 0);
+    std::vector<bool> on_stack(n, false);
+    std::vector<uint32_t> stack;
+    // (function, next call to follow)
+    std::vector<std::pair<uint32_t, size_t>> work;
+    int counter = 0;
+
+    for (uint32_t root = 0; root < n; ++root) {
+      if (index[root] >= 0) {
+        continue;
+      }
+      work.emplace_back(root, 0);
+      while (!work.empty()) {
+        uint32_t v = work.back().first;
+        if (index[v] < 0) {
+          index[v] = low[v] = counter++;
+          stack.push_back(v);
+          on_stack[v] = true;
+        }
+        if (work.back().second < calls_[v].size()) {
+          uint32_t w = calls_[v][work.back().second++];
+          if (index[w] < 0) {
+            work.emplace_back(w, 0);
+          }
+          else if (on_stack[w]) {
+            low[v] = std::min(low[v], index[w]);
+          }
+          continue;
+        }
+
+        work.pop_back();
+        if (!work.empty()) {
+          uint32_t u = work.back().first;
+          low[u] = std::min(low[u], low[v]);
+        }
+        if (low[v] != index[v]) {
+          continue;
+        }
+        size_t top = stack.size();
+        do {
+          on_stack[stack[--top]] = false;
+        } while (stack[top] != v);
+        bool cycle = stack.size() - top > 1 ||
+                     std::count(calls_[v].begin(), calls_[v].end(), v) > 0;
+        bool pure = true;
+        for (size_t idx = top; idx < stack.size(); ++idx) {
+          uint32_t u = stack[idx];
+          pure = pure && !impure_[u];
+          for (uint32_t w : calls_[u]) {
+            pure = pure && defs_[w]->pure_;
+          }
+        }
+        for (size_t idx = top; idx < stack.size(); ++idx) {
+          defs_[stack[idx]]->recursive_ = cycle;
+          defs_[stack[idx]]->pure_ = pure;
+        }
+        stack.resize(top);
+      }
+    }
+  }
+
+ private:
+  const LinkScope *scope_;
+  FunctionExpr *func_{nullptr};
+  size_t id_{0};
+  // Definitions in source order, and the ones each calls.
+  std::vector<FunctionExpr *> defs_;
+  std::vector<std::vector<uint32_t>> calls_;
+  // Whether each definition calls an extern, or an impure function in
+  // scope, itself.
+  std::vector<bool> impure_;
+  std::unordered_map<Symbol, uint32_t> funcs_;
+  std::unordered_set<Symbol> externs_;
+};
+
+}  // namespace
+
+void Link(const std::vector<Expr *> &exprs) {
+  Linker(nullptr).run(exprs);
+}
+
+void Link(const std::vector<Expr *> &exprs, const LinkScope &scope) {
+  Linker(&scope).run(exprs);
+}
+
+}  // namespace smcc
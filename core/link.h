@@ -0,0 +1,38 @@
+// Copyright (c) 2020 smarsufan. All Rights Reserved.
+
+#pragma once
+#include <vector>
+
+#include "expr.h"
+
+namespace smcc {
+
+/// Bind the call sites of a parsed program, once, after Resolve().
+///
+/// A call goes to the script function of that name if the program defines
+/// one, else to the host function, which must be declared extern (the
+/// builtins need not). Either way it must pass exactly the callee's
+/// parameters. Anything that does not bind is reported here rather than
+/// when the call runs. Functions on a cycle of calls are marked recursive_,
+/// those that reach no extern pure_, and calls whose value is returned as
+/// it is are marked tail_.
+void Link(const std::vector<Expr *> &exprs);
+
+/// The functions and externs linked before a partial Link().
+class LinkScope {
+ public:
+  virtual ~LinkScope() = default;
+
+  // The function defined as name, or nullptr.
+  virtual FunctionExpr *function(Symbol name) const = 0;
+
+  // Whether name is declared extern.
+  virtual bool declared(Symbol name) const = 0;
+};
+
+// Link exprs, part of a program whose other definitions are in scope.
+// Those are linked already and must call nothing exprs define, so a cycle
+// of calls is never split between the two.
+void Link(const std::vector<Expr *> &exprs, const LinkScope &scope);
+
+}  // namespace smcc
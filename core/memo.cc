@@ -0,0 +1,54 @@
+// Copyright (c) 2020 smarsufan. All Rights Reserved.
+
+#include "memo.h"
+
+#include <cstring>
+
+namespace smcc {
+
+MemoTable::MemoTable(uint32_t nargs, size_t entries) : nargs_(nargs) {
+  int bits = 0;
+  while ((size_t(1) << bits) < entries) {
+    ++bits;
+  }
+  // Fibonacci hashing keeps the top bits.
+  shift_ = 64 - bits;
+  entries_.resize(size_t(1) << bits, Entry{0, 0, false});
+  keys_.resize(entries_.size() * nargs_);
+}
+
+bool MemoTable::lookup(const double *args, double *value, Ticket *ticket) {
+  uint64_t hash = 0;
+  for (uint32_t idx = 0; idx < nargs_; ++idx) {
+    uint64_t bits;
+    memcpy(&bits, &args[idx], sizeof(bits));
+    hash = (hash ^ bits) * 0x9e3779b97f4a7c15ull;
+  }
+  uint32_t index = shift_ == 64 ? 0 : static_cast<uint32_t>(hash >> shift_);
+  Entry &entry = entries_[index];
+  uint64_t *key = keys_.data() + index * nargs_;
+  size_t bytes = nargs_ * sizeof(double);
+  if (entry.valid && memcmp(key, args, bytes) == 0) {
+    ++stats_.hits;
+    *value = entry.value;
+    return true;
+  }
+
+  ++stats_.misses;
+  memcpy(key, args, bytes);
+  entry.valid = false;
+  entry.stamp = ++stamp_;
+  ticket->index = index;
+  ticket->stamp = entry.stamp;
+  return false;
+}
+
+void MemoTable::fill(const Ticket &ticket, double value) {
+  Entry &entry = entries_[ticket.index];
+  if (entry.stamp == ticket.stamp) {
+    entry.value = value;
+    entry.valid = true;
+  }
+}
+
+}  // namespace smcc
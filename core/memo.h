@@ -0,0 +1,59 @@
+// Copyright (c) 2020 smarsufan. All Rights Reserved.
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace smcc {
+
+struct MemoStats {
+  uint64_t hits{0};
+  uint64_t misses{0};
+};
+
+/// A direct-mapped cache of a pure function's results, keyed on the bit
+/// patterns of its arguments (so -0 and 0 are different keys, and a NaN
+/// argument can hit). A new key simply replaces whatever shared its entry.
+///
+/// A miss claims the entry up front and the result is filled in when the
+/// call returns, since the callee may overwrite its parameters. If a
+/// nested call took the entry meanwhile, the fill is dropped.
+class MemoTable {
+ public:
+  struct Ticket {
+    uint32_t index;
+    uint64_t stamp;
+  };
+
+  // entries is rounded up to a power of two.
+  MemoTable(uint32_t nargs, size_t entries);
+
+  // On a hit, sets *value and returns true. On a miss, claims the entry
+  // for args and returns false; pass *ticket to fill().
+  bool lookup(const double *args, double *value, Ticket *ticket);
+
+  void fill(const Ticket &ticket, double value);
+
+  const MemoStats &stats() const { return stats_; }
+
+  size_t size() const { return entries_.size(); }
+
+ private:
+  struct Entry {
+    double value;
+    // Of the claim that owns the entry; 0 while empty.
+    uint64_t stamp;
+    bool valid;
+  };
+
+  uint32_t nargs_;
+  int shift_;
+  std::vector<Entry> entries_;
+  // nargs_ key words per entry.
+  std::vector<uint64_t> keys_;
+  uint64_t stamp_{0};
+  MemoStats stats_;
+};
+
+}  // namespace smcc
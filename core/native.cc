@@ -0,0 +1,57 @@
+// Copyright (c) 2020 smarsufan. All Rights Reserved.
+
+#include "native.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+namespace smcc {
+
+NativeRegistry::NativeRegistry() {
+  Register("sqrt", +[](double x) { return std::sqrt(x); });
+  Register("sin", +[](double x) { return std::sin(x); });
+  Register("pow", +[](double x, double y) { return std::pow(x, y); });
+  nbuiltins_ = natives_.size();
+}
+
+void NativeRegistry::add(const std::string &name, uint32_t arity,
+                         void (*fn)()) {
+  Symbol sym = symbols().intern(name);
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (sym < static_cast<Symbol>(by_name_.size()) && by_name_[sym]) {
+    fprintf(stderr, "native -100: %s is already registered\n", name.c_str());
+    abort();
+  }
+  if (sym >= static_cast<Symbol>(by_name_.size())) {
+    by_name_.resize(sym + 1, nullptr);
+  }
+  natives_.push_back(Native{sym, arity, fn});
+  by_name_[sym] = &natives_.back();
+}
+
+const Native *NativeRegistry::find(Symbol name) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (name < 0 || name >= static_cast<Symbol>(by_name_.size())) {
+    return nullptr;
+  }
+  return by_name_[name];
+}
+
+bool NativeRegistry::builtin(Symbol name) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  for (size_t idx = 0; idx < nbuiltins_; ++idx) {
+    if (natives_[idx].name == name) {
+      return true;
+    }
+  }
+  return false;
+}
+
+NativeRegistry &natives() {
+  static NativeRegistry registry;
+  return registry;
+}
+
+}  // namespace smcc
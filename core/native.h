@@ -0,0 +1,105 @@
+// Copyright (c) 2020 smarsufan. All Rights Reserved.
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "symbol.h"
+
+namespace smcc {
+
+// Natives are called like C functions, so their arguments fit the SysV
+// xmm argument registers.
+constexpr uint32_t kMaxNativeArgs = 8;
+
+/// A host function scripts may call.
+struct Native {
+  Symbol name{kNoSymbol};
+  uint32_t arity{0};
+  // A double (*)(double, ...) taking arity arguments.
+  void (*fn)(){nullptr};
+
+  double call(const double *a) const;
+};
+
+namespace detail {
+
+template <typename... Args>
+struct AllDouble : std::true_type {};
+
+template <typename Arg, typename... Args>
+struct AllDouble<Arg, Args...>
+    : std::integral_constant<bool, std::is_same<Arg, double>::value &&
+                                       AllDouble<Args...>::value> {};
+
+}  // namespace detail
+
+/// Host functions by name. Scripts declare the ones they use with
+///
+///   extern double clamp(double x, double lo, double hi);
+///
+/// and the linker binds each call site to its Native once. sqrt, sin and
+/// pow are registered from the start and need no declaration.
+class NativeRegistry {
+ public:
+  NativeRegistry();
+
+  template <typename... Args>
+  void Register(const std::string &name, double (*fn)(Args...)) {
+    static_assert(detail::AllDouble<Args...>::value,
+                  "natives take and return double");
+    static_assert(sizeof...(Args) <= kMaxNativeArgs, "too many arguments");
+    add(name, sizeof...(Args), reinterpret_cast<void (*)()>(fn));
+  }
+
+  // The native registered as name, or nullptr. The pointer stays valid.
+  const Native *find(Symbol name) const;
+
+  // Whether scripts may call name without declaring it.
+  bool builtin(Symbol name) const;
+
+ private:
+  void add(const std::string &name, uint32_t arity, void (*fn)());
+
+ private:
+  mutable std::mutex mutex_;
+  // Deque so entries never move.
+  std::deque<Native> natives_;
+  // Indexed by Symbol.
+  std::vector<const Native *> by_name_;
+  size_t nbuiltins_{0};
+};
+
+// The process-wide registry.
+NativeRegistry &natives();
+
+inline double Native::call(const double *a) const {
+  typedef double D;
+  switch (arity) {
+    case 0: return reinterpret_cast<D (*)()>(fn)();
+    case 1: return reinterpret_cast<D (*)(D)>(fn)(a[0]);
+    case 2: return reinterpret_cast<D (*)(D, D)>(fn)(a[0], a[1]);
+    case 3: return reinterpret_cast<D (*)(D, D, D)>(fn)(a[0], a[1], a[2]);
+    case 4:
+      return reinterpret_cast<D (*)(D, D, D, D)>(fn)(a[0], a[1], a[2], a[3]);
+    case 5:
+      return reinterpret_cast<D (*)(D, D, D, D, D)>(fn)(a[0], a[1], a[2],
+                                                         a[3], a[4]);
+    case 6:
+      return reinterpret_cast<D (*)(D, D, D, D, D, D)>(fn)(a[0], a[1], a[2],
+                                                            a[3], a[4], a[5]);
+    case 7:
+      return reinterpret_cast<D (*)(D, D, D, D, D, D, D)>(fn)(
+          a[0], a[1], a[2], a[3], a[4], a[5], a[6]);
+    default:
+      return reinterpret_cast<D (*)(D, D, D, D, D, D, D, D)>(fn)(
+          a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7]);
+  }
+}
+
+}  // namespace smcc
@@ -0,0 +1,74 @@
+// Copyright (c) 2020 smarsufan. All Rights Reserved.
+
+#include "pool.h"
+
+#include <algorithm>
+
+namespace smcc {
+
+ThreadPool::ThreadPool(int threads) {
+  if (threads <= 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  size_ = threads;
+  for (int worker = 1; worker < size_; ++worker) {
+    threads_.emplace_back(&ThreadPool::loop, this, worker);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  start_.notify_all();
+  for (auto &thread : threads_) {
+    thread.join();
+  }
+}
+
+void ThreadPool::run(const std::function<void(int)> &job) {
+  if (threads_.empty()) {
+    job(0);
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    job_ = &job;
+    pending_ = static_cast<int>(threads_.size());
+    ++generation_;
+  }
+  start_.notify_all();
+
+  job(0);
+
+  std::unique_lock<std::mutex> lock(mutex_);
+  done_.wait(lock, [this] { return pending_ == 0; });
+  job_ = nullptr;
+}
+
+void ThreadPool::loop(int worker) {
+  uint64_t seen = 0;
+  while (true) {
+    const std::function<void(int)> *job;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      start_.wait(lock, [&] { return stop_ || generation_ != seen; });
+      if (stop_) {
+        return;
+      }
+      seen = generation_;
+      job = job_;
+    }
+
+    (*job)(worker);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (--pending_ == 0) {
+      done_.notify_one();
+    }
+  }
+}
+
+}  // namespace smcc
@@ -0,0 +1,50 @@
+// Copyright (c) 2020 smarsufan. All Rights Reserved.
+
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace smcc {
+
+/// Worker threads that run one job at a time. The calling thread takes
+/// part as worker 0, so a pool of one thread starts none.
+class ThreadPool {
+ public:
+  // threads <= 0 uses every core.
+  explicit ThreadPool(int threads = 0);
+
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool &) = delete;
+
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  // Workers, the calling thread included.
+  int size() const { return size_; }
+
+  // Run job(worker) once on every worker, worker in [0, size()), and wait
+  // for all of them.
+  void run(const std::function<void(int)> &job);
+
+ private:
+  void loop(int worker);
+
+ private:
+  int size_{1};
+  std::vector<std::thread> threads_;
+
+  std::mutex mutex_;
+  std::condition_variable start_;
+  std::condition_variable done_;
+  const std::function<void(int)> *job_{nullptr};
+  // Bumped for every job, so a worker runs each exactly once.
+  uint64_t generation_{0};
+  int pending_{0};
+  bool stop_{false};
+};
+
+}  // namespace smcc
@@ -0,0 +1,64 @@
+// Copyright (c) 2020 smarsufan. All Rights Reserved.
+
+#include "program.h"
+
+#include "image.h"
+
+namespace smcc {
+
+Program::Program(Reader *reader) : ast_(reader) {
+  ast_.parse();
+  define();
+  compile();
+}
+
+Program::Program(Reader *reader, const std::string &cache) : ast_(reader) {
+  if (!reader->data()) {
+    ast_.parse();
+    define();
+    compile();
+    return;
+  }
+  uint64_t hash = SourceHash(reader->data(), reader->size());
+  {
+    Image image(cache.c_str());
+    if (image.valid(hash) &&
+        image.load(ast_.arena(), ast_.mutable_toplevel(), &module_)) {
+      cached_ = true;
+      define();
+      return;
+    }
+  }
+  ast_.parse();
+  define();
+  compile();
+  // Only an optimization; a cache that can not be written is no error.
+  Image::write(cache.c_str(), hash, ast_.toplevel(), module_);
+}
+
+void Program::define() {
+  for (auto expr : ast_.toplevel()) {
+    if (auto func = expr_cast<FunctionExpr>(expr)) {
+      define(func);
+    }
+  }
+}
+
+void Program::define(FunctionExpr *func) {
+  Symbol name = func->proto_->name_;
+  if (name >= static_cast<Symbol>(funcs_.size())) {
+    funcs_.resize(name + 1, nullptr);
+  }
+  funcs_[name] = func;
+}
+
+void Program::compile() {
+  // Compile up front; running never touches the nodes' state again.
+  for (auto func : funcs_) {
+    if (func) {
+      module_.compile(func);
+    }
+  }
+}
+
+}  // namespace smcc
@@ -0,0 +1,73 @@
+// Copyright (c) 2020 smarsufan. All Rights Reserved.
+
+#pragma once
+#include <string>
+#include <vector>
+
+#include "ast.h"
+#include "bytecode.h"
+
+namespace smcc {
+
+/// A parsed, resolved, linked and compiled program.
+///
+/// Nothing changes once the constructor returns, so one Program can be
+/// shared by any number of threads, each running it through its own
+/// Context. The one exception is the program of a Session, which changes
+/// in update().
+class Program {
+ public:
+  // Everything reader yields. The reader is not needed afterwards.
+  explicit Program(Reader *reader);
+
+  // The same, through the Image at cache: loaded if it was made from
+  // this very source, else parsed and written there for the next
+  // process. A reader that streams the source is always parsed.
+  Program(Reader *reader, const std::string &cache);
+
+  Program(const Program &) = delete;
+
+  Program &operator=(const Program &) = delete;
+
+  // The function defined as name, or nullptr.
+  FunctionExpr *function(Symbol name) const {
+    if (name < 0 || name >= static_cast<Symbol>(funcs_.size())) {
+      return nullptr;
+    }
+    return funcs_[name];
+  }
+
+  FunctionExpr *function(const std::string &name) const {
+    return function(symbols().find(name));
+  }
+
+  const Module &module() const { return module_; }
+
+  // The functions and externs, in source order.
+  const std::vector<Expr *> &toplevel() const { return ast_.toplevel(); }
+
+  // Whether the program was loaded from a cache rather than parsed.
+  bool cached() const { return cached_; }
+
+ private:
+  friend class Session;
+
+  // Empty, for a Session to fill.
+  Program() : ast_(nullptr) {}
+
+  // Index the functions of the toplevel by name.
+  void define();
+
+  void define(FunctionExpr *func);
+
+  void compile();
+
+ private:
+  AST ast_;
+  // Indexed by Symbol.
+  std::vector<FunctionExpr *> funcs_;
+  Module module_;
+  bool cached_{false};
+};
+
+}  // namespace smcc
@@ -2,25 +2,33 @@
 
 #include "reader.h"
 
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 namespace smcc {
 
-ReaderStdio::ReaderStdio(FILE *fp) : fp_(fp) {
+ReaderStdio::ReaderStdio(FILE *fp, size_t block_size)
+    : fp_(fp), buf_(block_size ? block_size : kBlockSize) {
 }
 
 ReaderStdio::~ReaderStdio() {
+  if (own_ && fp_) {
+    fclose(fp_);
+  }
 }
 
-int ReaderStdio::getchar() {
-  char ch;
-  int ok = fread(&ch, 1, 1, fp_);
-  if (ok <= 0) {
-    return EOF;
-  }
-  return ch;
+bool ReaderStdio::refill() {
+  size_t n = fread(buf_.data(), 1, buf_.size(), fp_);
+  cur_ = buf_.data();
+  end_ = cur_ + n;
+  return n > 0;
 }
 
-ReaderMem::ReaderMem(const char *mem, size_t size) 
-    : mem_(mem), size_(size) {
+ReaderMem::ReaderMem(const char *mem, size_t size)
+    : begin_(mem), mem_(mem), size_(size) {
   end_ = mem_ + size_;
 }
 
@@ -31,7 +39,71 @@ int ReaderMem::getchar() {
   if (mem_ >= end_) {
     return EOF;
   }
-  return *(mem_++);
+  return static_cast<unsigned char>(*(mem_++));
+}
+
+ReaderMmap::ReaderMmap(const char *path) {
+  fd_ = open(path, O_RDONLY);
+  if (fd_ < 0) {
+    return;
+  }
+
+  struct stat st;
+  if (fstat(fd_, &st) != 0) {
+    close(fd_);
+    fd_ = -1;
+    return;
+  }
+
+  size_ = st.st_size;
+  if (size_ == 0) {
+    return;  // mmap refuses empty mappings.
+  }
+
+  void *addr = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+  if (addr == MAP_FAILED) {
+    close(fd_);
+    fd_ = -1;
+    size_ = 0;
+    return;
+  }
+  madvise(addr, size_, MADV_SEQUENTIAL);
+
+  begin_ = static_cast<const char *>(addr);
+  cur_ = begin_;
+  end_ = begin_ + size_;
+}
+
+ReaderMmap::~ReaderMmap() {
+  if (begin_) {
+    munmap(const_cast<char *>(begin_), size_);
+  }
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+}
+
+std::unique_ptr<Reader> OpenReader(const char *path) {
+  if (strcmp(path, "-") == 0) {
+    return std::unique_ptr<Reader>(new ReaderStdio(stdin));
+  }
+
+  struct stat st;
+  if (stat(path, &st) == 0 && S_ISREG(st.st_mode)) {
+    std::unique_ptr<ReaderMmap> reader(new ReaderMmap(path));
+    if (!reader->is_open()) {
+      return nullptr;
+    }
+    return std::move(reader);
+  }
+
+  FILE *fp = fopen(path, "r");
+  if (!fp) {
+    return nullptr;
+  }
+  std::unique_ptr<ReaderStdio> reader(new ReaderStdio(fp));
+  reader->own();
+  return std::move(reader);
 }
 
 }  // namespace smcc
@@ -2,6 +2,8 @@
 
 #pragma once
 #include <cstdio>
+#include <memory>
+#include <vector>
 
 namespace smcc {
 
@@ -14,19 +16,43 @@ class Reader {
 
   // Read one char.
   virtual int getchar() = 0;
+
+  // The whole source as one contiguous buffer, or nullptr if the reader
+  // streams it.
+  virtual const char *data() const { return nullptr; }
+
+  virtual size_t size() const { return 0; }
  private:
 };
 
+/// Reads from a FILE in large blocks, for pipes and stdin.
 class ReaderStdio : public Reader {
  public:
-  ReaderStdio(FILE *fp);
+  static constexpr size_t kBlockSize = 64 * 1024;
+
+  ReaderStdio(FILE *fp, size_t block_size = kBlockSize);
 
   ~ReaderStdio();
 
-  virtual int getchar();
+  virtual int getchar() {
+    if (cur_ == end_ && !refill()) {
+      return EOF;
+    }
+    return static_cast<unsigned char>(*(cur_++));
+  }
+
+  // Close the FILE when the reader is destroyed.
+  void own() { own_ = true; }
+
+ private:
+  bool refill();
 
  private:
   FILE *fp_{nullptr};
+  bool own_{false};
+  std::vector<char> buf_;
+  const char *cur_{nullptr};
+  const char *end_{nullptr};
 };
 
 class ReaderMem : public Reader {
@@ -37,10 +63,48 @@ class ReaderMem : public Reader {
 
   virtual int getchar();
 
+  virtual const char *data() const { return begin_; }
+
+  virtual size_t size() const { return size_; }
+
  private:
+  const char *begin_{nullptr};
   const char *mem_{nullptr};
   size_t size_{0};
   const char *end_{nullptr};
 };
 
+/// Maps a whole source file read-only.
+class ReaderMmap : public Reader {
+ public:
+  ReaderMmap(const char *path);
+
+  ~ReaderMmap();
+
+  bool is_open() const { return fd_ >= 0; }
+
+  virtual int getchar() {
+    if (cur_ >= end_) {
+      return EOF;
+    }
+    return static_cast<unsigned char>(*(cur_++));
+  }
+
+  virtual const char *data() const { return begin_; }
+
+  virtual size_t size() const { return size_; }
+
+ private:
+  int fd_{-1};
+  const char *begin_{nullptr};
+  const char *cur_{nullptr};
+  const char *end_{nullptr};
+  size_t size_{0};
+};
+
+// Open the best reader for path: regular files are mapped, anything else
+// (pipes, devices, "-" for stdin) is read through ReaderStdio.
+// Returns nullptr if path can not be opened.
+std::unique_ptr<Reader> OpenReader(const char *path);
+
 }  // namespace smcc
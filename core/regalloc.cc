@@ -0,0 +1,110 @@
+// Copyright (c) 2020 smarsufan. All Rights Reserved.
+
+#include "regalloc.h"
+
+#include <algorithm>
+#include <cstdint>
+
+namespace smcc {
+
+std::vector<int> LinearScan(const SsaFunction &ssa,
+                            const std::vector<int> &regs,
+                            const std::vector<int> &int_regs,
+                            bool (*call)(SsaOp op)) {
+  size_t n = ssa.values.size();
+  size_t nblocks = ssa.blocks.size();
+
+  // Positions: the start of each block, where its phis are defined, then
+  // one per instruction and one for the jump.
+  std::vector<uint32_t> entry(nblocks), exit(nblocks), at(n);
+  std::vector<uint32_t> calls;
+  uint32_t pos = 0;
+  for (size_t b = 0; b < nblocks; ++b) {
+    entry[b] = pos++;
+    for (uint32_t v : ssa.blocks[b].code) {
+      if (ssa.values[v].op == kSsaPhi) {
+        at[v] = entry[b];
+        continue;
+      }
+      at[v] = pos++;
+      if (call(ssa.values[v].op)) {
+        calls.push_back(at[v]);
+      }
+    }
+    exit[b] = pos++;
+  }
+
+  std::vector<uint32_t> end(n, 0);
+  // Values by definition, which is block order.
+  std::vector<uint32_t> order;
+  for (size_t b = 0; b < nblocks; ++b) {
+    auto &block = ssa.blocks[b];
+    for (uint32_t v : block.code) {
+      auto &ins = ssa.values[v];
+      uint32_t use = ins.op == kSsaPhi ? entry[b] : at[v];
+      for (uint32_t arg : ins.args) {
+        end[arg] = std::max(end[arg], use);
+      }
+      end[v] = std::max(end[v], at[v]);
+      if (ins.op != kSsaConst) {
+        order.push_back(v);
+      }
+    }
+    if (block.jump != SsaBlock::kGoto) {
+      end[block.value] = std::max(end[block.value], exit[b]);
+    }
+  }
+
+  std::vector<int> reg(n, kSpilled);
+  // The two types never share a register, so each is a scan of its own.
+  for (Type type : {Type::kDouble, Type::kInt}) {
+    bool ints = type == Type::kInt;
+    auto &pool = ints ? int_regs : regs;
+    std::vector<int> free(pool.rbegin(), pool.rend());
+    // Sorted by end.
+    std::vector<uint32_t> active;
+    for (uint32_t v : order) {
+      if (ssa.values[v].type != type) {
+        continue;
+      }
+      while (!active.empty() && end[active.front()] < at[v]) {
+        free.push_back(reg[active.front()]);
+        active.erase(active.begin());
+      }
+      auto next = std::upper_bound(calls.begin(), calls.end(), at[v]);
+      if (!ints && next != calls.end() && *next < end[v]) {
+        continue;
+      }
+
+      // Take over the register of a first operand that dies here.
+      auto &args = ssa.values[v].args;
+      if (ssa.values[v].op != kSsaPhi && !args.empty() &&
+          ssa.values[args[0]].type == type && end[args[0]] == at[v] &&
+          reg[args[0]] != kSpilled) {
+        active.erase(std::find(active.begin(), active.end(), args[0]));
+        reg[v] = reg[args[0]];
+      }
+      else if (free.empty()) {
+        if (active.empty() || end[active.back()] <= end[v]) {
+          continue;
+        }
+        uint32_t victim = active.back();
+        active.pop_back();
+        reg[v] = reg[victim];
+        reg[victim] = kSpilled;
+      }
+      else {
+        reg[v] = free.back();
+        free.pop_back();
+      }
+      active.insert(std::upper_bound(active.begin(), active.end(), v,
+                                     [&](uint32_t x, uint32_t y) {
+                                       return end[x] < end[y];
+                                     }),
+                    v);
+    }
+  }
+  return reg;
+}
+
+}  // namespace smcc
@@ -0,0 +1,33 @@
+// Copyright (c) 2020 smarsufan. All Rights Reserved.
+
+#pragma once
+#include <vector>
+
+#include "ssa.h"
+
+namespace smcc {
+
+// A value LinearScan() gave no register.
+constexpr int kSpilled = -1;
+
+/// Linear scan register allocation over the blocks of ssa, in order:
+/// doubles take regs and ints int_regs.
+///
+/// Each value lives from its definition to its last use. There are no
+/// loops, so every block comes after its predecessors and that one range
+/// covers wherever the value is live. Phi arguments are used at the start
+/// of the phi's block. An instruction reads its operands before it writes
+/// its value, so the value may take the register of its first operand if
+/// that dies there and is of its type. Where more values are live than
+/// there are registers, the one that lives longest is spilled.
+///
+/// Instructions for which call(op) holds clobber every one of regs, so
+/// doubles live across one are spilled; int_regs must be registers calls
+/// preserve. Constants get no register; they are cheaper to load where
+/// used. Returns the register of each value, or kSpilled.
+std::vector<int> LinearScan(const SsaFunction &ssa,
+                            const std::vector<int> &regs,
+                            const std::vector<int> &int_regs,
+                            bool (*call)(SsaOp op));
+
+}  // namespace smcc
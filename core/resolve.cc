@@ -0,0 +1,103 @@
+// Copyright (c) 2020 smarsufan. All Rights Reserved.
+
+#include "resolve.h"
+
+#include <unordered_map>
+
+#include "ast.h"
+
+namespace smcc {
+
+namespace {
+
+class Resolver {
+ public:
+  Resolver(FunctionExpr *func) : func_(func) {}
+
+  void run() {
+    func_->slot_types_.clear();
+    for (auto arg : func_->proto_->args_) {
+      declare(arg);
+    }
+    body(func_->body_);
+    func_->nslots_ = static_cast<int>(slots_.size());
+  }
+
+ private:
+  void declare(VarExpr *var) {
+    var->type_ = var->token_ == tok_int ? Type::kInt : Type::kDouble;
+    // A second declaration of a name reuses its slot, so it must keep
+    // the type.
+    auto it = slots_.find(var->name_);
+    if (it != slots_.end()) {
+      var->slot_ = it->second;
+      if (func_->slot_types_[var->slot_] != var->type_) {
+        fprintf(stderr, "resolve -300: %s is redeclared with another type "
+                "in %s\n", symbols().name(var->name_).c_str(),
+                symbols().name(func_->proto_->name_).c_str());
+        abort();
+      }
+      return;
+    }
+    var->slot_ = static_cast<int>(slots_.size());
+    slots_[var->name_] = var->slot_;
+    func_->slot_types_.push_back(var->type_);
+  }
+
+  void body(const ExprList &exprs) {
+    for (auto expr : exprs) {
+      visit(expr);
+    }
+  }
+
+  void visit(Expr *expr) {
+    if (auto var = expr_cast<VarExpr>(expr)) {
+      if (var->token_ != tok_dt) {
+        declare(var);
+        return;
+      }
+      auto it = slots_.find(var->name_);
+      if (it == slots_.end()) {
+        fprintf(stderr, "resolve -100: undefined variable %s in %s\n",
+                symbols().name(var->name_).c_str(),
+                symbols().name(func_->proto_->name_).c_str());
+        abort();
+      }
+      var->slot_ = it->second;
+      var->type_ = func_->slot_types_[var->slot_];
+    }
+    else if (auto bin = expr_cast<BinaryExpr>(expr)) {
+      if (bin->tok_ == tok_assign && !expr_cast<VarExpr>(bin->lhs_)) {
+        fprintf(stderr, "resolve -200: can not assign to an expression "
+                "in %s\n",
+                symbols().name(func_->proto_->name_).c_str());
+        abort();
+      }
+      visit(bin->lhs_);
+      visit(bin->rhs_);
+    }
+    else if (auto call = expr_cast<CallExpr>(expr)) {
+      body(call->args_);
+    }
+    else if (auto cond = expr_cast<IfExpr>(expr)) {
+      visit(cond->cond_);
+      body(cond->body_);
+      body(cond->other_);
+    }
+    else if (auto ret = expr_cast<ReturnExpe>(expr)) {
+      visit(ret->expr_);
+    }
+  }
+
+ private:
+  FunctionExpr *func_;
+  std::unordered_map<Symbol, int> slots_;
+};
+
+}  // namespace
+
+void Resolve(FunctionExpr *func) {
+  Resolver(func).run();
+}
+
+}  // namespace smcc
@@ -0,0 +1,16 @@
+// Copyright (c) 2020 smarsufan. All Rights Reserved.
+
+#pragma once
+#include "expr.h"
+
+namespace smcc {
+
+/// Give every parameter and local of func a fixed slot in its frame.
+///
+/// Parameters take slots [0, nparams) in order, locals follow in the order
+/// they are declared. Each VarExpr records its slot_ and type_, and the
+/// function its frame size in nslots_ and the type of each slot, so
+/// running code never looks a name up.
+void Resolve(FunctionExpr *func);
+
+}  // namespace smcc
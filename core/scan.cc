@@ -0,0 +1,294 @@
+// Copyright (c) 2020 smarsufan. All Rights Reserved.
+
+#include "scan.h"
+
+#include <atomic>
+#include <cstdint>
+#include <initializer_list>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SMCC_SCAN_X86 1
+#endif
+
+namespace smcc {
+
+namespace {
+
+enum : uint8_t {
+  kSpace = 1,
+  kLine = 2,
+  kIdent = 4,
+  kNumber = 8,
+};
+
+// Built at compile time, so kernels called during another file's static
+// initialization see it filled in.
+struct ClassTable {
+  uint8_t bits[256] = {};
+
+  constexpr ClassTable() {
+    for (int c : {' ', '\t', '\n', '\v', '\f', '\r'}) bits[c] |= kSpace;
+    for (int c : {'\n', '\r'}) bits[c] |= kLine;
+    for (int c = 'a'; c <= 'z'; ++c) bits[c] |= kIdent;
+    for (int c = 'A'; c <= 'Z'; ++c) bits[c] |= kIdent;
+    for (int c = '0'; c <= '9'; ++c) bits[c] |= kIdent | kNumber;
+    bits[static_cast<int>('.')] |= kNumber;
+  }
+};
+
+constexpr ClassTable kClass;
+
+template <uint8_t kBits>
+inline const char *SkipWhile(const char *p, const char *end) {
+  while (p < end && (kClass.bits[static_cast<uint8_t>(*p)] & kBits))
+    ++p;
+  return p;
+}
+
+template <uint8_t kBits>
+inline const char *SkipUntil(const char *p, const char *end) {
+  while (p < end && !(kClass.bits[static_cast<uint8_t>(*p)] & kBits))
+    ++p;
+  return p;
+}
+
+const char *ScalarSkipSpace(const char *p, const char *end) {
+  return SkipWhile<kSpace>(p, end);
+}
+
+const char *ScalarSkipLine(const char *p, const char *end) {
+  return SkipUntil<kLine>(p, end);
+}
+
+const char *ScalarSkipIdent(const char *p, const char *end) {
+  return SkipWhile<kIdent>(p, end);
+}
+
+const char *ScalarSkipNumber(const char *p, const char *end) {
+  return SkipWhile<kNumber>(p, end);
+}
+
+const ScanOps kScalarOps = {
+  ScalarSkipSpace, ScalarSkipLine, ScalarSkipIdent, ScalarSkipNumber,
+};
+
+#ifdef SMCC_SCAN_X86
+
+// The classifiers set a byte to 0xff if it belongs to the class. Unsigned
+// x <= n is tested as min(x, n) == x, since SSE2 only compares signed.
+
+inline __m128i InRange(__m128i v, char lo, char n) {
+  __m128i x = _mm_sub_epi8(v, _mm_set1_epi8(lo));
+  return _mm_cmpeq_epi8(_mm_min_epu8(x, _mm_set1_epi8(n)), x);
+}
+
+struct Sse2Space {
+  static __m128i Match(__m128i v) {
+    return _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8(' ')),
+                        InRange(v, '\t', '\r' - '\t'));
+  }
+};
+
+struct Sse2Line {
+  static __m128i Match(__m128i v) {
+    return _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')),
+                        _mm_cmpeq_epi8(v, _mm_set1_epi8('\r')));
+  }
+};
+
+struct Sse2Ident {
+  static __m128i Match(__m128i v) {
+    __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+    return _mm_or_si128(InRange(v, '0', 9), InRange(lower, 'a', 25));
+  }
+};
+
+struct Sse2Number {
+  static __m128i Match(__m128i v) {
+    return _mm_or_si128(InRange(v, '0', 9),
+                        _mm_cmpeq_epi8(v, _mm_set1_epi8('.')));
+  }
+};
+
+// Advance *p to the first byte where Match() is kStop. Returns false if
+// fewer than 16 bytes are left to look at.
+template <typename Class, bool kStop>
+bool Sse2Scan(const char **p, const char *end) {
+  const char *q = *p;
+  while (end - q >= 16) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(q));
+    unsigned mask = _mm_movemask_epi8(Class::Match(v));
+    if (!kStop) {
+      mask = ~mask & 0xffff;
+    }
+    if (mask) {
+      *p = q + __builtin_ctz(mask);
+      return true;
+    }
+    q += 16;
+  }
+  *p = q;
+  return false;
+}
+
+const char *Sse2SkipSpace(const char *p, const char *end) {
+  return Sse2Scan<Sse2Space, false>(&p, end) ? p : ScalarSkipSpace(p, end);
+}
+
+const char *Sse2SkipLine(const char *p, const char *end) {
+  return Sse2Scan<Sse2Line, true>(&p, end) ? p : ScalarSkipLine(p, end);
+}
+
+const char *Sse2SkipIdent(const char *p, const char *end) {
+  return Sse2Scan<Sse2Ident, false>(&p, end) ? p : ScalarSkipIdent(p, end);
+}
+
+const char *Sse2SkipNumber(const char *p, const char *end) {
+  return Sse2Scan<Sse2Number, false>(&p, end) ? p : ScalarSkipNumber(p, end);
+}
+
+const ScanOps kSse2Ops = {
+  Sse2SkipSpace, Sse2SkipLine, Sse2SkipIdent, Sse2SkipNumber,
+};
+
+#define SMCC_AVX2 __attribute__((target("avx2")))
+
+SMCC_AVX2 inline __m256i InRange256(__m256i v, char lo, char n) {
+  __m256i x = _mm256_sub_epi8(v, _mm256_set1_epi8(lo));
+  return _mm256_cmpeq_epi8(_mm256_min_epu8(x, _mm256_set1_epi8(n)), x);
+}
+
+struct Avx2Space {
+  SMCC_AVX2 static __m256i Match(__m256i v) {
+    return _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')),
+                           InRange256(v, '\t', '\r' - '\t'));
+  }
+};
+
+struct Avx2Line {
+  SMCC_AVX2 static __m256i Match(__m256i v) {
+    return _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')),
+                           _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\r')));
+  }
+};
+
+struct Avx2Ident {
+  SMCC_AVX2 static __m256i Match(__m256i v) {
+    __m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+    return _mm256_or_si256(InRange256(v, '0', 9),
+                           InRange256(lower, 'a', 25));
+  }
+};
+
+struct Avx2Number {
+  SMCC_AVX2 static __m256i Match(__m256i v) {
+    return _mm256_or_si256(InRange256(v, '0', 9),
+                           _mm256_cmpeq_epi8(v, _mm256_set1_epi8('.')));
+  }
+};
+
+template <typename Class, bool kStop>
+SMCC_AVX2 bool Avx2Scan(const char **p, const char *end) {
+  const char *q = *p;
+  while (end - q >= 32) {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(q));
+    unsigned mask = _mm256_movemask_epi8(Class::Match(v));
+    if (!kStop) {
+      mask = ~mask;
+    }
+    if (mask) {
+      *p = q + __builtin_ctz(mask);
+      return true;
+    }
+    q += 32;
+  }
+  *p = q;
+  return false;
+}
+
+// The SSE2 kernels finish the last 0..31 bytes.
+
+SMCC_AVX2 const char *Avx2SkipSpace(const char *p, const char *end) {
+  return Avx2Scan<Avx2Space, false>(&p, end) ? p : Sse2SkipSpace(p, end);
+}
+
+SMCC_AVX2 const char *Avx2SkipLine(const char *p, const char *end) {
+  return Avx2Scan<Avx2Line, true>(&p, end) ? p : Sse2SkipLine(p, end);
+}
+
+SMCC_AVX2 const char *Avx2SkipIdent(const char *p, const char *end) {
+  return Avx2Scan<Avx2Ident, false>(&p, end) ? p : Sse2SkipIdent(p, end);
+}
+
+SMCC_AVX2 const char *Avx2SkipNumber(const char *p, const char *end) {
+  return Avx2Scan<Avx2Number, false>(&p, end) ? p : Sse2SkipNumber(p, end);
+}
+
+const ScanOps kAvx2Ops = {
+  Avx2SkipSpace, Avx2SkipLine, Avx2SkipIdent, Avx2SkipNumber,
+};
+
+#endif  // SMCC_SCAN_X86
+
+const ScanOps *Best() {
+#ifdef SMCC_SCAN_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return &kAvx2Ops;
+  }
+  return &kSse2Ops;
+#else
+  return &kScalarOps;
+#endif
+}
+
+// Null until the first scan_ops(). Being constant-initialized, it is
+// already null when a Lexer is made during another file's static
+// initialization, and set_scan_isa() may swap it while other threads
+// lex.
+std::atomic<const ScanOps *> active{nullptr};
+
+}  // namespace
+
+const ScanOps &scan_ops() {
+  const ScanOps *ops = active.load(std::memory_order_acquire);
+  if (!ops) {
+    // Racing callers pick the same kernels; one set_scan_isa() in between
+    // wins over them.
+    const ScanOps *expected = nullptr;
+    ops = Best();
+    if (!active.compare_exchange_strong(expected, ops,
+                                        std::memory_order_acq_rel)) {
+      ops = expected;
+    }
+  }
+  return *ops;
+}
+
+const ScanOps *scan_ops(ScanIsa isa) {
+  switch (isa) {
+    case ScanIsa::kScalar:
+      return &kScalarOps;
+#ifdef SMCC_SCAN_X86
+    case ScanIsa::kSSE2:
+      return &kSse2Ops;
+    case ScanIsa::kAVX2:
+      __builtin_cpu_init();
+      return __builtin_cpu_supports("avx2") ? &kAvx2Ops : nullptr;
+#endif
+    default:
+      return nullptr;
+  }
+}
+
+bool set_scan_isa(ScanIsa isa) {
+  const ScanOps *ops = scan_ops(isa);
+  if (!ops) {
+    return false;
+  }
+  active.store(ops, std::memory_order_release);
+  return true;
+}
+
+}  // namespace smcc
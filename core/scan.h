@@ -0,0 +1,41 @@
+// Copyright (c) 2020 smarsufan. All Rights Reserved.
+
+#pragma once
+
+namespace smcc {
+
+/// Byte-class scanning kernels used by the lexer. Each returns the first
+/// position in [p, end) that ends the run, or end.
+struct ScanOps {
+  // Skip [ \t\n\v\f\r]*.
+  const char *(*skip_space)(const char *p, const char *end);
+
+  // Skip to the next '\n' or '\r'.
+  const char *(*skip_line)(const char *p, const char *end);
+
+  // Skip [a-zA-Z0-9]*.
+  const char *(*skip_ident)(const char *p, const char *end);
+
+  // Skip [0-9.]*.
+  const char *(*skip_number)(const char *p, const char *end);
+};
+
+enum class ScanIsa {
+  kScalar,
+  kSSE2,
+  kAVX2,
+};
+
+// The kernels the lexer uses: the best this CPU supports, picked on the
+// first call, unless set_scan_isa() chose others. Safe to call from any
+// thread, and before main().
+const ScanOps &scan_ops();
+
+// Kernels for isa, or nullptr if this build or CPU can not run them.
+const ScanOps *scan_ops(ScanIsa isa);
+
+// Force the kernels the lexer uses, e.g. to benchmark. Returns false if
+// isa is not supported. Lexers made before keep the kernels they have.
+bool set_scan_isa(ScanIsa isa);
+
+}  // namespace smcc
@@ -0,0 +1,422 @@
+// Copyright (c) 2020 smarsufan. All Rights Reserved.
+
+#include "session.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+
+#include "check.h"
+#include "fold.h"
+#include "image.h"
+#include "resolve.h"
+
+namespace smcc {
+
+struct Session::Definition {
+  std::string text;
+  uint64_t hash;
+  // Where its first expr is in the program's toplevel.
+  size_t first;
+  std::unique_ptr<ReaderMem> reader;
+  std::unique_ptr<AST> ast;
+  // What Check() and Fold() added, shared by the definitions parsed in the
+  // same update().
+  std::shared_ptr<Arena> arena;
+  // The names called, once each.
+  std::vector<Symbol> calls;
+};
+
+namespace {
+
+// The length of the longest common prefix of a and b, n bytes each.
+size_t Head(const char *a, const char *b, size_t n) {
+  const size_t kBlock = 4096;
+  size_t pos = 0;
+  while (pos + kBlock <= n && memcmp(a + pos, b + pos, kBlock) == 0) {
+    pos += kBlock;
+  }
+  while (pos < n && a[pos] == b[pos]) {
+    ++pos;
+  }
+  return pos;
+}
+
+// The length of the longest common suffix of a[0, n) and b[0, n).
+size_t Tail(const char *a, const char *b, size_t n) {
+  const size_t kBlock = 4096;
+  size_t len = 0;
+  while (len + kBlock <= n &&
+         memcmp(a + n - len - kBlock, b + n - len - kBlock, kBlock) == 0) {
+    len += kBlock;
+  }
+  while (len < n && a[n - len - 1] == b[n - len - 1]) {
+    ++len;
+  }
+  return len;
+}
+
+bool Comment(const char *source, size_t size, size_t pos) {
+  return source[pos] == '/' && pos + 1 < size && source[pos + 1] == '/';
+}
+
+size_t SkipLine(const char *source, size_t size, size_t pos) {
+  while (pos < size && source[pos] != '\n' && source[pos] != '\r') {
+    ++pos;
+  }
+  return pos;
+}
+
+// Past the spaces and comments at pos.
+size_t Skip(const char *source, size_t size, size_t pos) {
+  while (pos < size) {
+    if (isspace(static_cast<unsigned char>(source[pos]))) {
+      ++pos;
+    }
+    else if (Comment(source, size, pos)) {
+      pos = SkipLine(source, size, pos);
+    }
+    else {
+      break;
+    }
+  }
+  return pos;
+}
+
+// The end of the top-level definition at pos: the '}' closing its body, or
+// a ';' outside any braces.
+size_t End(const char *source, size_t size, size_t pos) {
+  int depth = 0;
+  while (pos < size) {
+    if (Comment(source, size, pos)) {
+      pos = SkipLine(source, size, pos);
+      continue;
+    }
+    char c = source[pos++];
+    if (c == '{') {
+      ++depth;
+    }
+    else if (c == '}' && --depth == 0) {
+      break;
+    }
+    else if (c == ';' && depth == 0) {
+      break;
+    }
+  }
+  return pos;
+}
+
+// The function or extern expr defines, else kNoSymbol.
+Symbol Name(Expr *expr) {
+  if (auto func = expr_cast<FunctionExpr>(expr)) {
+    return func->proto_->name_;
+  }
+  if (auto proto = expr_cast<PrototypeExpr>(expr)) {
+    return proto->name_;
+  }
+  return kNoSymbol;
+}
+
+void Calls(Expr *expr, std::vector<Symbol> *calls) {
+  if (auto binary = expr_cast<BinaryExpr>(expr)) {
+    Calls(binary->lhs_, calls);
+    Calls(binary->rhs_, calls);
+  }
+  else if (auto call = expr_cast<CallExpr>(expr)) {
+    calls->push_back(call->id_);
+    for (auto arg : call->args_) {
+      Calls(arg, calls);
+    }
+  }
+  else if (auto if_expr = expr_cast<IfExpr>(expr)) {
+    Calls(if_expr->cond_, calls);
+    for (auto e : if_expr->body_) {
+      Calls(e, calls);
+    }
+    for (auto e : if_expr->other_) {
+      Calls(e, calls);
+    }
+  }
+  else if (auto ret = expr_cast<ReturnExpe>(expr)) {
+    Calls(ret->expr_, calls);
+  }
+  else if (auto cast = expr_cast<CastExpr>(expr)) {
+    Calls(cast->expr_, calls);
+  }
+}
+
+}  // namespace
+
+Session::Session() : program_(new Program()) {}
+
+Session::~Session() = default;
+
+void Session::update(const char *source, size_t size) {
+  // Split at a definition's start reads on the same way whatever came
+  // before, so only the definitions between the bytes shared with the old
+  // source at either end are split again: those ending in the shared head
+  // are kept as they are, and splitting stops at the first one starting in
+  // the shared tail.
+  size_t old_size = source_.size();
+  size_t limit = std::min(old_size, size);
+  size_t head = Head(source_.data(), source, limit);
+  size_t tail = Tail(source_.data() + head + old_size - limit,
+                     source + head + size - limit, limit - head);
+  size_t lo = std::partition_point(
+                spans_.begin(), spans_.end(),
+                [&](const std::pair<size_t, size_t> &span) {
+                  return span.second <= head;
+                }) -
+            spans_.begin();
+  size_t hi = std::partition_point(
+                spans_.begin() + lo, spans_.end(),
+                [&](const std::pair<size_t, size_t> &span) {
+                  return span.first < old_size - tail;
+                }) -
+            spans_.begin();
+  ptrdiff_t shift = static_cast<ptrdiff_t>(size) -
+                    static_cast<ptrdiff_t>(old_size);
+  std::vector<std::pair<size_t, size_t>> spans;
+  size_t pos = lo ? spans_[lo - 1].second : 0;
+  while ((pos = Skip(source, size, pos)) < size) {
+    while (hi < spans_.size() && spans_[hi].first + shift < pos) {
+      ++hi;
+    }
+    if (hi < spans_.size() && spans_[hi].first + shift == pos) {
+      break;
+    }
+    size_t end = End(source, size, pos);
+    spans.emplace_back(pos, end);
+    pos = end;
+  }
+  if (pos == size) {
+    hi = spans_.size();
+  }
+
+  // The old definitions in between, by the hash of their text; a span
+  // with the same text takes one over, most often the one in its place.
+  std::vector<std::unique_ptr<Definition>> old(
+      std::make_move_iterator(defs_.begin() + lo),
+      std::make_move_iterator(defs_.begin() + hi));
+  std::unordered_multimap<uint64_t, size_t> by_hash;
+  for (size_t i = 0; i < old.size(); ++i) {
+    by_hash.emplace(old[i]->hash, i);
+  }
+  auto same = [](const Definition &def, const char *text, size_t n) {
+    return def.text.size() == n && memcmp(def.text.data(), text, n) == 0;
+  };
+  auto &toplevel = *program_->ast_.mutable_toplevel();
+  size_t first = hi < defs_.size() ? defs_[hi]->first : toplevel.size();
+  size_t at = old.empty() ? first : old[0]->first;
+  size_t from = at;
+  std::vector<std::unique_ptr<Definition>> defs;
+  std::vector<Definition *> fresh;
+  for (auto &span : spans) {
+    const char *text = source + span.first;
+    size_t n = span.second - span.first;
+    size_t i = defs.size();
+    std::unique_ptr<Definition> def;
+    if (i < old.size() && old[i] && same(*old[i], text, n)) {
+      def = std::move(old[i]);
+    }
+    else {
+      uint64_t hash = SourceHash(text, n);
+      auto range = by_hash.equal_range(hash);
+      for (auto it = range.first; it != range.second; ++it) {
+        if (old[it->second] && same(*old[it->second], text, n)) {
+          def = std::move(old[it->second]);
+          break;
+        }
+      }
+      if (!def) {
+        def.reset(new Definition);
+        def->text.assign(text, n);
+        def->hash = hash;
+        parse(def.get());
+        fresh.push_back(def.get());
+      }
+    }
+    def->first = at;
+    at += def->ast->toplevel().size();
+    defs.push_back(std::move(def));
+  }
+
+  // Splice them in. What follows moves in the source, and in the toplevel
+  // only when the definitions in between now make a different number of
+  // exprs.
+  if (at != first) {
+    for (size_t i = hi; i < defs_.size(); ++i) {
+      defs_[i]->first += at - first;
+    }
+  }
+  for (size_t i = hi; i < spans_.size(); ++i) {
+    spans_[i].first += shift;
+    spans_[i].second += shift;
+  }
+  defs_.erase(defs_.begin() + lo, defs_.begin() + hi);
+  defs_.insert(defs_.begin() + lo, std::make_move_iterator(defs.begin()),
+               std::make_move_iterator(defs.end()));
+  spans_.erase(spans_.begin() + lo, spans_.begin() + hi);
+  spans_.insert(spans_.begin() + lo, spans.begin(), spans.end());
+  std::vector<Expr *> exprs;
+  for (size_t i = lo; i < lo + defs.size(); ++i) {
+    auto &list = defs_[i]->ast->toplevel();
+    exprs.insert(exprs.end(), list.begin(), list.end());
+  }
+  toplevel.erase(toplevel.begin() + from, toplevel.begin() + first);
+  toplevel.insert(toplevel.begin() + from, exprs.begin(), exprs.end());
+  source_.replace(head, old_size - head - tail, source + head,
+                  size - head - tail);
+
+  // The names whose definition went or came.
+  std::vector<Symbol> dirty;
+  auto names = [&](Definition *def) {
+    for (auto expr : def->ast->toplevel()) {
+      Symbol name = Name(expr);
+      if (name != kNoSymbol) {
+        dirty.push_back(name);
+      }
+    }
+  };
+  for (auto &def : old) {
+    if (def) {
+      remove(def.get());
+      names(def.get());
+    }
+  }
+  for (auto def : fresh) {
+    names(def);
+  }
+  // Their callers were bound to the old definitions, and so on up.
+  std::unordered_set<Definition *> batch(fresh.begin(), fresh.end());
+  while (!dirty.empty()) {
+    auto it = callers_.find(dirty.back());
+    dirty.pop_back();
+    if (it == callers_.end()) {
+      continue;
+    }
+    std::vector<Definition *> callers(it->second.begin(), it->second.end());
+    for (auto def : callers) {
+      if (batch.insert(def).second) {
+        remove(def);
+        parse(def);
+        names(def);
+      }
+    }
+  }
+
+  // The passes AST::parse() runs, over the batch only; everything else is
+  // reached through the program as the LinkScope.
+  std::vector<Definition *> parsed(batch.begin(), batch.end());
+  std::sort(parsed.begin(), parsed.end(),
+            [](Definition *a, Definition *b) { return a->first < b->first; });
+  exprs.clear();
+  for (auto def : parsed) {
+    auto &toplevel = def->ast->toplevel();
+    exprs.insert(exprs.end(), toplevel.begin(), toplevel.end());
+  }
+  for (auto expr : exprs) {
+    if (auto func = expr_cast<FunctionExpr>(expr)) {
+      Resolve(func);
+    }
+  }
+  Link(exprs, *this);
+  auto arena = std::make_shared<Arena>();
+  Check(exprs, arena.get());
+  Fold(exprs, arena.get());
+  for (auto def : parsed) {
+    def->arena = arena;
+    add(def);
+  }
+
+  // A name compiled before keeps its index, so the kept bytecode calling
+  // it stays right.
+  std::vector<FunctionExpr *> compile;
+  for (auto expr : exprs) {
+    if (auto func = expr_cast<FunctionExpr>(expr)) {
+      auto it = codes_.find(func->proto_->name_);
+      if (it != codes_.end()) {
+        func->code_ = it->second;
+      }
+      else {
+        compile.push_back(func);
+      }
+    }
+  }
+  Module &module = program_->module_;
+  for (auto expr : exprs) {
+    auto func = expr_cast<FunctionExpr>(expr);
+    if (func && codes_.count(func->proto_->name_)) {
+      module.recompile(func);
+    }
+  }
+  for (auto func : compile) {
+    codes_[func->proto_->name_] = module.compile(func);
+  }
+
+  // What was parsed again in place.
+  for (auto def : parsed) {
+    auto &exprs = def->ast->toplevel();
+    std::copy(exprs.begin(), exprs.end(), toplevel.begin() + def->first);
+  }
+  parsed_ = parsed.size();
+}
+
+void Session::parse(Definition *def) {
+  def->ast.reset();
+  def->arena.reset();
+  def->reader.reset(new ReaderMem(def->text.data(), def->text.size()));
+  def->ast.reset(new AST(def->reader.get()));
+  def->ast->parse_toplevel();
+  def->calls.clear();
+  for (auto expr : def->ast->toplevel()) {
+    if (auto func = expr_cast<FunctionExpr>(expr)) {
+      for (auto e : func->body_) {
+        Calls(e, &def->calls);
+      }
+    }
+  }
+  std::sort(def->calls.begin(), def->calls.end());
+  def->calls.erase(std::unique(def->calls.begin(), def->calls.end()),
+                   def->calls.end());
+}
+
+void Session::remove(Definition *def) {
+  for (Symbol name : def->calls) {
+    auto it = callers_.find(name);
+    if (it != callers_.end()) {
+      it->second.erase(def);
+      if (it->second.empty()) {
+        callers_.erase(it);
+      }
+    }
+  }
+  for (auto expr : def->ast->toplevel()) {
+    if (auto func = expr_cast<FunctionExpr>(expr)) {
+      if (program_->function(func->proto_->name_) == func) {
+        program_->funcs_[func->proto_->name_] = nullptr;
+      }
+    }
+    else if (auto proto = expr_cast<PrototypeExpr>(expr)) {
+      --externs_[proto->name_];
+    }
+  }
+}
+
+void Session::add(Definition *def) {
+  for (Symbol name : def->calls) {
+    callers_[name].insert(def);
+  }
+  for (auto expr : def->ast->toplevel()) {
+    if (auto func = expr_cast<FunctionExpr>(expr)) {
+      program_->define(func);
+    }
+    else if (auto proto = expr_cast<PrototypeExpr>(expr)) {
+      ++externs_[proto->name_];
+    }
+  }
+}
+
+}  // namespace smcc
@@ -0,0 +1,90 @@
+// Copyright (c) 2020 smarsufan. All Rights Reserved.
+
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "ast.h"
+#include "link.h"
+#include "program.h"
+
+namespace smcc {
+
+/// A program kept up to date with a source that changes a few definitions
+/// at a time.
+///
+/// update() splits the source into its top-level definitions, only where
+/// it differs from the last one, and keeps every one whose text is the
+/// same as before, with its nodes and its bytecode. It parses the new and changed ones, and with them the callers
+/// of any name they define or that went away, and their callers in turn:
+/// those calls were bound, typed and maybe folded against the old
+/// definition. Only those are linked, checked and compiled, each function
+/// into the bytecode index its name had before.
+class Session : private LinkScope {
+ public:
+  Session();
+
+  ~Session();
+
+  Session(const Session &) = delete;
+
+  Session &operator=(const Session &) = delete;
+
+  // Bring program() up to date with source[0, size). Errors abort, as
+  // they do for a Program.
+  void update(const char *source, size_t size);
+
+  void update(const std::string &source) {
+    update(source.data(), source.size());
+  }
+
+  // The program as of the last update(). It stays at this address, but
+  // Contexts, Batches and Jits made on it must be made again after an
+  // update().
+  const Program &program() const { return *program_; }
+
+  // Definitions the last update() parsed.
+  size_t parsed() const { return parsed_; }
+
+ private:
+  struct Definition;
+
+  FunctionExpr *function(Symbol name) const override {
+    return program_->function(name);
+  }
+
+  bool declared(Symbol name) const override {
+    auto it = externs_.find(name);
+    return it != externs_.end() && it->second > 0;
+  }
+
+  // Parse def's text on its own.
+  void parse(Definition *def);
+
+  // Take def's definitions out of the program, or put them in.
+  void remove(Definition *def);
+
+  void add(Definition *def);
+
+ private:
+  std::unique_ptr<Program> program_;
+  // The source of the last update(), and where each definition is in it.
+  std::string source_;
+  std::vector<std::pair<size_t, size_t>> spans_;
+  // In source order.
+  std::vector<std::unique_ptr<Definition>> defs_;
+  // The definitions calling each name, before folding.
+  std::unordered_map<Symbol, std::unordered_set<Definition *>> callers_;
+  // Declarations of each extern.
+  std::unordered_map<Symbol, int> externs_;
+  // The bytecode index of every function name compiled so far.
+  std::unordered_map<Symbol, int> codes_;
+  size_t parsed_{0};
+};
+
+}  // namespace smcc
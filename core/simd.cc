@@ -0,0 +1,545 @@
+// Copyright (c) 2020 smarsufan. All Rights Reserved.
+
+#include "simd.h"
+
+#include <cmath>
+#include <cstring>
+
+#include "ast.h"
+
+#if defined(__x86_64__) && defined(__GNUC__)
+// One clone per ISA, picked when the program loads.
+#define SMCC_LANES __attribute__((target_clones("avx2", "default")))
+#else
+#define SMCC_LANES
+#endif
+
+namespace smcc {
+
+namespace {
+
+// Lane kernels: each loop is over the first n lanes of a block, so it
+// vectorizes. Masks are blocks of 1 and 0, the width of the values they
+// select. Ints are read and written through memcpy, which compiles to
+// plain moves.
+
+// for i < n, n being a whole number of kLaneSteps. A full block gets a
+// loop of its own: with a constant count the compiler unrolls it and
+// drops the checks any other n needs.
+#define SMCC_LANE_FOR(i, ...)                                         \
+  if (n == kLanes) {                                                  \
+    for (size_t i = 0; i < kLanes; ++i) {                             \
+      __VA_ARGS__                                                     \
+    }                                                                 \
+  }                                                                   \
+  else {                                                              \
+    if (n % kLaneStep != 0) __builtin_unreachable();                  \
+    for (size_t i = 0; i < n; ++i) {                                  \
+      __VA_ARGS__                                                     \
+    }                                                                 \
+  }
+
+inline int64_t Int(const double *p) {
+  int64_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+inline void SetInt(double *p, int64_t v) {
+  memcpy(p, &v, sizeof(v));
+}
+
+SMCC_LANES void Fill(double *d, double v, size_t n) {
+  SMCC_LANE_FOR(i, d[i] = v;)
+}
+
+SMCC_LANES void Copy(double *d, const double *s, size_t n) {
+  SMCC_LANE_FOR(i, d[i] = s[i];)
+}
+
+#define SMCC_LANE_BINARY(name, expr)                                  \
+  SMCC_LANES void name(double *d, const double *a, const double *b,   \
+                       size_t n) {                                    \
+    SMCC_LANE_FOR(i, {                                                \
+      double x = a[i];                                                \
+      double y = b[i];                                                \
+      d[i] = (expr);                                                  \
+    })                                                                \
+  }
+
+// Comparisons give ints, whatever they compare.
+#define SMCC_LANE_COMPARE(name, type, load, expr)                     \
+  SMCC_LANES void name(double *d, const double *a, const double *b,   \
+                       size_t n) {                                    \
+    SMCC_LANE_FOR(i, {                                                \
+      type x = load(a + i);                                           \
+      type y = load(b + i);                                           \
+      SetInt(d + i, (expr));                                          \
+    })                                                                \
+  }
+
+#define SMCC_LANE_IBINARY(name, expr)                                 \
+  SMCC_LANES void name(double *d, const double *a, const double *b,   \
+                       size_t n) {                                    \
+    SMCC_LANE_FOR(i, {                                                \
+      int64_t x = Int(a + i);                                         \
+      int64_t y = Int(b + i);                                         \
+      SetInt(d + i, (expr));                                          \
+    })                                                                \
+  }
+
+#define SMCC_LANE_DOUBLE(p) (*(p))
+
+SMCC_LANE_BINARY(Add, x + y)
+SMCC_LANE_BINARY(Sub, x - y)
+SMCC_LANE_BINARY(Mul, x * y)
+SMCC_LANE_BINARY(Div, x / y)
+SMCC_LANE_COMPARE(Lt, double, SMCC_LANE_DOUBLE, x < y)
+SMCC_LANE_COMPARE(Le, double, SMCC_LANE_DOUBLE, x <= y)
+SMCC_LANE_COMPARE(Gt, double, SMCC_LANE_DOUBLE, x > y)
+SMCC_LANE_COMPARE(Ge, double, SMCC_LANE_DOUBLE, x >= y)
+SMCC_LANE_COMPARE(Eq, double, SMCC_LANE_DOUBLE, x == y)
+SMCC_LANE_IBINARY(AddI, IntAdd(x, y))
+SMCC_LANE_IBINARY(SubI, IntSub(x, y))
+SMCC_LANE_IBINARY(MulI, IntMul(x, y))
+SMCC_LANE_IBINARY(DivI, IntDiv(x, y))
+SMCC_LANE_COMPARE(LtI, int64_t, Int, x < y)
+SMCC_LANE_COMPARE(LeI, int64_t, Int, x <= y)
+SMCC_LANE_COMPARE(GtI, int64_t, Int, x > y)
+SMCC_LANE_COMPARE(GeI, int64_t, Int, x >= y)
+SMCC_LANE_COMPARE(EqI, int64_t, Int, x == y)
+
+#undef SMCC_LANE_DOUBLE
+#undef SMCC_LANE_IBINARY
+#undef SMCC_LANE_COMPARE
+#undef SMCC_LANE_BINARY
+
+SMCC_LANES void ToInt(double *d, const double *a, size_t n) {
+  SMCC_LANE_FOR(i, SetInt(d + i, TruncInt(a[i]));)
+}
+
+SMCC_LANES void ToDouble(double *d, const double *a, size_t n) {
+  SMCC_LANE_FOR(i, d[i] = static_cast<double>(Int(a + i));)
+}
+
+// d = s in the lanes of m.
+SMCC_LANES void Blend(double *d, const double *s, const double *m, size_t n) {
+  SMCC_LANE_FOR(i, d[i] = m[i] != 0 ? s[i] : d[i];)
+}
+
+// Split the lanes of m by whether c holds.
+SMCC_LANES void Split(double *then, double *other, const double *m,
+                      const double *c, size_t n) {
+  SMCC_LANE_FOR(i, {
+    then[i] = m[i] != 0 && c[i] != 0 ? 1. : 0.;
+    other[i] = m[i] != 0 && c[i] == 0 ? 1. : 0.;
+  })
+}
+
+// The same for c of ints.
+SMCC_LANES void SplitInt(double *then, double *other, const double *m,
+                         const double *c, size_t n) {
+  SMCC_LANE_FOR(i, {
+    then[i] = m[i] != 0 && Int(c + i) != 0 ? 1. : 0.;
+    other[i] = m[i] != 0 && Int(c + i) == 0 ? 1. : 0.;
+  })
+}
+
+// m = a | b.
+SMCC_LANES void Merge(double *m, const double *a, const double *b, size_t n) {
+  SMCC_LANE_FOR(i, m[i] = a[i] != 0 || b[i] != 0 ? 1. : 0.;)
+}
+
+// Counted in ints: a sum of doubles may not be reordered into vectors.
+SMCC_LANES size_t Count(const double *m, size_t n) {
+  size_t count = 0;
+  SMCC_LANE_FOR(i, count += m[i] != 0;)
+  return count;
+}
+
+// Without errno, sqrt is a vector instruction.
+__attribute__((optimize("no-math-errno"))) SMCC_LANES void Sqrt(
+    double *d, const double *a, size_t n) {
+  SMCC_LANE_FOR(i, d[i] = std::sqrt(a[i]);)
+}
+
+#undef SMCC_LANE_FOR
+
+typedef void (*Binary)(double *, const double *, const double *, size_t);
+
+// The kernel of tok on operands of type.
+Binary binary(int tok, Type type) {
+  bool ints = type == Type::kInt;
+  switch (tok) {
+    case tok_less: return ints ? LtI : Lt;
+    case tok_lessequal: return ints ? LeI : Le;
+    case tok_great: return ints ? GtI : Gt;
+    case tok_greatequal: return ints ? GeI : Ge;
+    case tok_equal: return ints ? EqI : Eq;
+    case tok_add: return ints ? AddI : Add;
+    case tok_sub: return ints ? SubI : Sub;
+    case tok_mul: return ints ? MulI : Mul;
+    case tok_div: return ints ? DivI : Div;
+    default:
+      fprintf(stderr, "simd -100: bad operator %d\n", tok);
+      abort();
+  }
+}
+
+// The width of a block running n lanes: whole vectors of them.
+size_t Width(size_t n) {
+  return (n + kLaneStep - 1) / kLaneStep * kLaneStep;
+}
+
+}  // namespace
+
+LaneContext::LaneContext(Context *ctx)
+    : ctx_(ctx),
+      sqrt_(natives().find(symbols().intern("sqrt"))),
+      sin_(natives().find(symbols().intern("sin"))),
+      pow_(natives().find(symbols().intern("pow"))) {
+}
+
+void LaneContext::run(FunctionExpr *func, const double *const *args,
+                      size_t rows, double *out) {
+  native_limit_ = NativeStackFloor();
+
+  size_t width = Width(rows);
+  double *slots = stack_.push(func->nslots_ * kLanes);
+  double *ret = block();
+  double *again = block();
+  double *mask = block();
+  size_t nparams = func->proto_->args_.size();
+  for (size_t p = 0; p < nparams; ++p) {
+    double *slot = slots + p * kLanes;
+    Type type = func->proto_->args_[p]->type_;
+    Fill(slot, 0, width);
+    for (size_t i = 0; i < rows; ++i) {
+      slot[i] = FromHost(type, args[p][i]);
+    }
+  }
+  for (size_t p = nparams; p < static_cast<size_t>(func->nslots_); ++p) {
+    Fill(slots + p * kLanes, 0, width);
+  }
+  Fill(ret, 0, width);
+  for (size_t i = 0; i < width; ++i) {
+    mask[i] = i < rows ? 1. : 0.;
+  }
+
+  Frame frame{func, slots, ret, again, width};
+  invoke(frame, mask);
+
+  for (size_t i = 0; i < rows; ++i) {
+    out[i] = ToHost(func->type_, ret[i]);
+  }
+  stack_.pop(slots);
+}
+
+void LaneContext::invoke(Frame &frame, double *mask) {
+  Fill(frame.again, 0, frame.width);
+  body(frame.func->body_, mask, frame);
+  while (Count(frame.again, frame.width)) {
+    // tail() left their parameters in place.
+    Copy(mask, frame.again, frame.width);
+    Fill(frame.again, 0, frame.width);
+    body(frame.func->body_, mask, frame);
+  }
+}
+
+void LaneContext::body(const ExprList &exprs, double *mask, Frame &frame) {
+  for (auto expr : exprs) {
+    statement(expr, mask, frame);
+    // Only these take lanes out of mask.
+    if (expr->kind() == ExprKind::kReturn || expr->kind() == ExprKind::kIf) {
+      if (Count(mask, frame.width) == 0) {
+        return;
+      }
+    }
+  }
+}
+
+void LaneContext::statement(Expr *expr, double *mask, Frame &frame) {
+  size_t width = frame.width;
+  double *tmp = block();
+  if (auto ret = expr_cast<ReturnExpe>(expr)) {
+    auto call = expr_cast<CallExpr>(ret->expr_);
+    if (call && call->tail_ && call->callee_->recursive_ &&
+        (call->callee_ == frame.func ||
+         call->args_.size() <= kMaxNativeArgs)) {
+      tail(call, mask, frame);
+    }
+    else {
+      Blend(frame.ret, value(ret->expr_, mask, frame, tmp), mask, width);
+    }
+    Fill(mask, 0, width);
+  }
+  else if (auto cond = expr_cast<IfExpr>(expr)) {
+    const double *test = value(cond->cond_, mask, frame, tmp);
+    double *then = block();
+    double *other = block();
+    if (cond->cond_->type_ == Type::kInt) {
+      SplitInt(then, other, mask, test, width);
+    }
+    else {
+      Split(then, other, mask, test, width);
+    }
+    if (Count(then, width)) {
+      body(cond->body_, then, frame);
+    }
+    if (Count(other, width)) {
+      body(cond->other_, other, frame);
+    }
+    Merge(mask, then, other, width);
+  }
+  else {
+    value(expr, mask, frame, tmp);
+  }
+  stack_.pop(tmp);
+}
+
+const double *LaneContext::value(Expr *expr, const double *mask,
+                                 Frame &frame, double *out) {
+  size_t width = frame.width;
+  switch (expr->kind()) {
+    case ExprKind::kNumber:
+      Fill(out, static_cast<NumberExpr *>(expr)->num_val(), width);
+      return out;
+
+    case ExprKind::kVar:
+      return frame.slots + static_cast<VarExpr *>(expr)->slot_ * kLanes;
+
+    case ExprKind::kBinary: {
+      auto bin = static_cast<BinaryExpr *>(expr);
+      if (bin->tok_ == tok_assign) {
+        // Resolve() only accepts variables on the left.
+        double *slot =
+            frame.slots + static_cast<VarExpr *>(bin->lhs_)->slot_ * kLanes;
+        Blend(slot, value(bin->rhs_, mask, frame, out), mask, width);
+        return slot;
+      }
+      double *lhs = block();
+      double *rhs = block();
+      const double *x = value(bin->lhs_, mask, frame, lhs);
+      // A variable read on the left must not see an assignment on the
+      // right.
+      ExprKind right = bin->rhs_->kind();
+      if (x != lhs && right != ExprKind::kVar && right != ExprKind::kNumber) {
+        Copy(lhs, x, width);
+        x = lhs;
+      }
+      const double *y = value(bin->rhs_, mask, frame, rhs);
+      binary(bin->tok_, bin->lhs_->type_)(out, x, y, width);
+      stack_.pop(lhs);
+      return out;
+    }
+
+    case ExprKind::kCast: {
+      auto cast = static_cast<CastExpr *>(expr);
+      const double *x = value(cast->expr_, mask, frame, out);
+      if (cast->type_ == Type::kInt) {
+        ToInt(out, x, width);
+      }
+      else {
+        ToDouble(out, x, width);
+      }
+      return out;
+    }
+
+    case ExprKind::kCall:
+      call(static_cast<CallExpr *>(expr), mask, frame, out);
+      return out;
+
+    default:
+      fprintf(stderr, "simd -200: can not evaluate node %d\n",
+              static_cast<int>(expr->kind()));
+      abort();
+  }
+}
+
+void LaneContext::call(CallExpr *call, const double *mask, Frame &frame,
+                       double *out) {
+  if (call->native_) {
+    native(call, mask, frame, out);
+    return;
+  }
+
+  FunctionExpr *callee = call->callee_;
+  if (static_cast<const char *>(__builtin_frame_address(0)) < native_limit_) {
+    fprintf(stderr, "simd -300: call stack overflow in %s\n",
+            symbols().name(callee->proto_->name_).c_str());
+    abort();
+  }
+
+  size_t width = frame.width;
+  double *slots = stack_.push(callee->nslots_ * kLanes);
+  size_t nargs = call->args_.size();
+  const double *args[kMaxNativeArgs];
+  for (size_t p = 0; p < nargs; ++p) {
+    double *slot = slots + p * kLanes;
+    const double *v = value(call->args_[p], mask, frame, slot);
+    if (v != slot) {
+      Copy(slot, v, width);
+    }
+    if (p < kMaxNativeArgs) {
+      args[p] = slot;
+    }
+  }
+
+  // A lane or two left in recursion runs faster in the bytecode
+  // interpreter than as a block.
+  size_t active = Count(mask, width);
+  if (callee->recursive_ && active <= kScalarLanes &&
+      nargs <= kMaxNativeArgs) {
+    scalar(callee, args, mask, width, out);
+    stack_.pop(slots);
+    return;
+  }
+
+  // Every kernel in a recursive callee costs the width of its block at
+  // every depth, so once the lanes went separate ways the calling ones
+  // move to the front of a narrower one. The arguments move down in place:
+  // a lane only moves to a lower one. A call that does not recurse runs
+  // its body once, which costs less than the moving.
+  size_t lanes[kLanes];
+  size_t inner_width = width;
+  bool pack = callee->recursive_ && Width(active) < width;
+  if (pack) {
+    inner_width = Width(active);
+    size_t n = 0;
+    for (size_t i = 0; i < width; ++i) {
+      // Without a branch: the lanes of a shuffled block are random.
+      lanes[n] = i;
+      n += mask[i] != 0;
+    }
+    for (size_t p = 0; p < nargs; ++p) {
+      double *slot = slots + p * kLanes;
+      for (size_t i = 0; i < inner_width; ++i) {
+        slot[i] = i < active ? slot[lanes[i]] : 0;
+      }
+    }
+  }
+  for (size_t p = nargs; p < static_cast<size_t>(callee->nslots_); ++p) {
+    Fill(slots + p * kLanes, 0, inner_width);
+  }
+
+  double *ret = block();
+  double *again = block();
+  double *inner_mask = block();
+  Fill(ret, 0, inner_width);
+  if (pack) {
+    for (size_t i = 0; i < inner_width; ++i) {
+      inner_mask[i] = i < active ? 1. : 0.;
+    }
+  }
+  else {
+    Copy(inner_mask, mask, width);
+  }
+  Frame inner{callee, slots, ret, again, inner_width};
+  invoke(inner, inner_mask);
+  if (pack) {
+    Fill(out, 0, width);
+    for (size_t i = 0; i < active; ++i) {
+      out[lanes[i]] = ret[i];
+    }
+  }
+  else {
+    Copy(out, ret, width);
+  }
+  stack_.pop(slots);
+}
+
+void LaneContext::tail(CallExpr *call, const double *mask, Frame &frame) {
+  FunctionExpr *callee = call->callee_;
+  size_t width = frame.width;
+  size_t nargs = call->args_.size();
+  double *blocks = stack_.push(nargs * kLanes);
+  const double *args[kMaxNativeArgs];
+  for (size_t p = 0; p < nargs; ++p) {
+    double *arg = blocks + p * kLanes;
+    const double *v = value(call->args_[p], mask, frame, arg);
+    if (v != arg) {
+      Copy(arg, v, width);
+    }
+    if (p < kMaxNativeArgs) {
+      args[p] = arg;
+    }
+  }
+
+  if (callee == frame.func) {
+    // These lanes are done with this run, so their parameters can take
+    // the new arguments; invoke() runs them again.
+    for (size_t p = 0; p < nargs; ++p) {
+      Blend(frame.slots + p * kLanes, blocks + p * kLanes, mask, width);
+    }
+    // And their locals start over at 0, as on a fresh call.
+    double *zero = block();
+    Fill(zero, 0, width);
+    for (size_t p = nargs; p < static_cast<size_t>(callee->nslots_); ++p) {
+      Blend(frame.slots + p * kLanes, zero, mask, width);
+    }
+    Merge(frame.again, frame.again, mask, width);
+  }
+  else {
+    // Elsewhere on the cycle: the bytecode interpreter makes its tail
+    // calls in constant space too.
+    double *out = block();
+    scalar(callee, args, mask, width, out);
+    Blend(frame.ret, out, mask, width);
+  }
+  stack_.pop(blocks);
+}
+
+void LaneContext::native(CallExpr *call, const double *mask, Frame &frame,
+                         double *out) {
+  const Native *native = call->native_;
+  size_t width = frame.width;
+  size_t nargs = call->args_.size();
+  double *blocks = stack_.push(nargs * kLanes);
+  const double *args[kMaxNativeArgs];
+  for (size_t p = 0; p < nargs; ++p) {
+    args[p] = value(call->args_[p], mask, frame, blocks + p * kLanes);
+  }
+
+  if (native == sqrt_) {
+    Sqrt(out, args[0], width);
+  }
+  else if (native == sin_) {
+    for (size_t i = 0; i < width; ++i) out[i] = std::sin(args[0][i]);
+  }
+  else if (native == pow_) {
+    for (size_t i = 0; i < width; ++i) out[i] = std::pow(args[0][i], args[1][i]);
+  }
+  else {
+    // Host functions may have effects, so only the active lanes call.
+    double a[kMaxNativeArgs];
+    for (size_t i = 0; i < width; ++i) {
+      if (mask[i] == 0) {
+        out[i] = 0;
+        continue;
+      }
+      for (size_t p = 0; p < nargs; ++p) {
+        a[p] = args[p][i];
+      }
+      out[i] = native->call(a);
+    }
+  }
+  stack_.pop(blocks);
+}
+
+void LaneContext::scalar(FunctionExpr *callee, const double *const *args,
+                         const double *mask, size_t width, double *out) {
+  size_t nargs = callee->proto_->args_.size();
+  double a[kMaxNativeArgs];
+  for (size_t i = 0; i < width; ++i) {
+    if (mask[i] == 0) {
+      out[i] = 0;
+      continue;
+    }
+    for (size_t p = 0; p < nargs; ++p) {
+      a[p] = args[p][i];
+    }
+    out[i] = ctx_->run(callee, a, nargs);
+  }
+}
+
+}  // namespace smcc
@@ -0,0 +1,97 @@
+// Copyright (c) 2020 smarsufan. All Rights Reserved.
+
+#pragma once
+#include <cstddef>
+
+#include "context.h"
+#include "stack.h"
+
+namespace smcc {
+
+// Rows that run together in SIMD mode.
+constexpr size_t kLanes = 64;
+
+// Blocks are narrowed this many lanes at a time.
+constexpr size_t kLaneStep = 8;
+
+// At most this many lanes left in a recursive call run it one at a time.
+constexpr size_t kScalarLanes = 2;
+
+/// Runs a function over kLanes rows at once.
+///
+/// Each node is evaluated for a whole block of lanes by kernels the
+/// compiler vectorizes (AVX2 where the CPU has it), so walking the tree
+/// costs once per block rather than once per row. if/else runs each arm
+/// under a mask of the lanes that take it. A call into recursion made by
+/// fewer lanes than the block holds packs them into a narrower block, so
+/// lanes that left stop costing: recursion that bottoms out at a different
+/// depth in each lane narrows as it goes, and the last few lanes finish in
+/// ctx's bytecode interpreter. Lanes that tail-call their own function run it
+/// again in the same frame.
+class LaneContext {
+ public:
+  explicit LaneContext(Context *ctx);
+
+  LaneContext(const LaneContext &) = delete;
+
+  LaneContext &operator=(const LaneContext &) = delete;
+
+  // out[i] = func(args[0][i], ..., args[nparams - 1][i]) for i < rows,
+  // rows <= kLanes. Arguments and results are host doubles, as for
+  // Context::call().
+  void run(FunctionExpr *func, const double *const *args, size_t rows,
+           double *out);
+
+ private:
+  // A running call.
+  struct Frame {
+    FunctionExpr *func;
+    double *slots;
+    // The value each lane returned, 0 until it does.
+    double *ret;
+    // Lanes that tail-called func, to run it again.
+    double *again;
+    // The lanes of each block in use, a multiple of kLaneStep.
+    size_t width;
+  };
+
+  // Run frame.func for the lanes in mask, and again for those that
+  // tail-call it. Uses up mask.
+  void invoke(Frame &frame, double *mask);
+
+  // A scratch block, released by popping it (or an earlier one).
+  double *block() { return stack_.push(kLanes); }
+
+  // Run exprs under mask; lanes that return leave mask.
+  void body(const ExprList &exprs, double *mask, Frame &frame);
+
+  void statement(Expr *expr, double *mask, Frame &frame);
+
+  // expr for every lane, in out or in a block that outlives it, like a
+  // variable's slot. Only the lanes in mask are assigned to.
+  const double *value(Expr *expr, const double *mask, Frame &frame,
+                      double *out);
+
+  void call(CallExpr *call, const double *mask, Frame &frame, double *out);
+
+  void native(CallExpr *call, const double *mask, Frame &frame, double *out);
+
+  // `return call` for the lanes in mask, call being a tail call of a
+  // recursive function: frame.func itself, or one taking at most
+  // kMaxNativeArgs arguments.
+  void tail(CallExpr *call, const double *mask, Frame &frame);
+
+  // Run callee on each lane of the first width in mask by itself.
+  void scalar(FunctionExpr *callee, const double *const *args,
+              const double *mask, size_t width, double *out);
+
+ private:
+  Context *ctx_;
+  Stack stack_;
+  const char *native_limit_{nullptr};
+  const Native *sqrt_;
+  const Native *sin_;
+  const Native *pow_;
+};
+
+}  // namespace smcc
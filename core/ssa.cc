@@ -0,0 +1,516 @@
+// Copyright (c) 2020 smarsufan. All Rights Reserved.
+
+#include "ssa.h"
+
+#include <algorithm>
+#include <map>
+
+#include "ast.h"
+
+namespace smcc {
+
+namespace {
+
+constexpr uint32_t kNone = UINT32_MAX;
+
+const Symbol sym_sqrt = symbols().intern("sqrt");
+const Symbol sym_sin = symbols().intern("sin");
+const Symbol sym_pow = symbols().intern("pow");
+
+const char *kSsaNames[] = {
+  "param", "const", "copy", "phi", "add", "sub", "mul", "div", "lt", "le",
+  "gt", "ge", "eq", "toint", "todouble", "sqrt", "sin", "pow", "call",
+  "native",
+};
+
+bool Pure(const SsaInstr &ins) {
+  switch (ins.op) {
+    case kSsaNative:
+      return false;
+    case kSsaCall:
+      return ins.callee->pure_;
+    default:
+      return true;
+  }
+}
+
+bool Commutative(SsaOp op) {
+  return op == kSsaAdd || op == kSsaMul || op == kSsaEq;
+}
+
+/// Builds the blocks of one function. Variables map to the value they
+/// hold; an if/else joins the maps of the branches that fall through
+/// with phis.
+class Builder {
+ public:
+  Builder(FunctionExpr *func) : func_(func) {}
+
+  SsaFunction build() {
+    ssa_.func = func_;
+    block_ = block();
+    size_t nparams = func_->proto_->args_.size();
+    defs_.resize(std::max<size_t>(func_->nslots_, nparams));
+    for (size_t p = 0; p < nparams; ++p) {
+      defs_[p] = emit(kSsaParam, {}, p, func_->slot_types_[p]);
+    }
+    // Locals read before any assignment hold 0, which has the same bits
+    // as either type.
+    uint32_t zero[2] = {kNone, kNone};
+    for (size_t slot = nparams; slot < defs_.size(); ++slot) {
+      Type type = func_->slot_types_[slot];
+      uint32_t &z = zero[type == Type::kInt];
+      if (z == kNone) {
+        z = emit(kSsaConst, {}, constants().intern(0), type);
+      }
+      defs_[slot] = z;
+    }
+
+    body(func_->body_);
+
+    // Falling off the end returns 0.
+    if (block_ != kNone) {
+      ret(emit(kSsaConst, {}, constants().intern(0), func_->type_));
+    }
+    return std::move(ssa_);
+  }
+
+ private:
+  struct Exit {
+    uint32_t block;
+    std::vector<uint32_t> defs;
+  };
+
+  uint32_t block() {
+    ssa_.blocks.emplace_back();
+    return static_cast<uint32_t>(ssa_.blocks.size() - 1);
+  }
+
+  uint32_t emit(SsaOp op, std::vector<uint32_t> args, uint32_t k,
+                Type type) {
+    SsaInstr ins;
+    ins.op = op;
+    ins.type = type;
+    ins.k = k;
+    ins.args = std::move(args);
+    return add(std::move(ins), block_);
+  }
+
+  uint32_t add(SsaInstr ins, uint32_t block) {
+    uint32_t v = static_cast<uint32_t>(ssa_.values.size());
+    ssa_.values.push_back(std::move(ins));
+    ssa_.blocks[block].code.push_back(v);
+    return v;
+  }
+
+  void ret(uint32_t v) {
+    auto &b = ssa_.blocks[block_];
+    b.jump = SsaBlock::kReturn;
+    b.value = v;
+    block_ = kNone;
+  }
+
+  void body(const ExprList &exprs) {
+    for (auto expr : exprs) {
+      // Nothing after a return runs.
+      if (block_ == kNone) {
+        return;
+      }
+      statement(expr);
+    }
+  }
+
+  void statement(Expr *expr) {
+    if (auto r = expr_cast<ReturnExpe>(expr)) {
+      ret(value(r->expr_));
+    }
+    else if (auto cond = expr_cast<IfExpr>(expr)) {
+      branch(cond);
+    }
+    else {
+      value(expr);
+    }
+  }
+
+  void branch(IfExpr *cond) {
+    uint32_t test = value(cond->cond_);
+    uint32_t from = block_;
+    std::vector<uint32_t> saved = defs_;
+    std::vector<Exit> exits;
+
+    // An empty else still gets a block, so a branch never goes straight
+    // to a join and phi moves always have a goto to ride on.
+    for (const ExprList *arm : {&cond->body_, &cond->other_}) {
+      block_ = block();
+      ssa_.blocks[block_].preds.push_back(from);
+      ssa_.blocks[from].succ[arm == &cond->other_] = block_;
+      defs_ = saved;
+      body(*arm);
+      if (block_ != kNone) {
+        exits.push_back({block_, std::move(defs_)});
+      }
+    }
+    auto &b = ssa_.blocks[from];
+    b.jump = SsaBlock::kBranch;
+    b.value = test;
+
+    if (exits.empty()) {
+      block_ = kNone;
+      return;
+    }
+    if (exits.size() == 1) {
+      block_ = exits[0].block;
+      defs_ = std::move(exits[0].defs);
+      return;
+    }
+
+    uint32_t join = block();
+    for (auto &exit : exits) {
+      auto &pred = ssa_.blocks[exit.block];
+      pred.jump = SsaBlock::kGoto;
+      pred.succ[0] = join;
+      ssa_.blocks[join].preds.push_back(exit.block);
+    }
+    defs_ = std::move(exits[0].defs);
+    for (size_t slot = 0; slot < defs_.size(); ++slot) {
+      uint32_t other = exits[1].defs[slot];
+      if (other != defs_[slot]) {
+        SsaInstr phi;
+        phi.op = kSsaPhi;
+        phi.type = func_->slot_types_[slot];
+        phi.args = {defs_[slot], other};
+        defs_[slot] = add(std::move(phi), join);
+      }
+    }
+    block_ = join;
+  }
+
+  uint32_t value(Expr *expr) {
+    if (auto num = expr_cast<NumberExpr>(expr)) {
+      return emit(kSsaConst, {}, num->k_, num->type_);
+    }
+    if (auto v = expr_cast<VarExpr>(expr)) {
+      return defs_[v->slot_];
+    }
+    if (auto bin = expr_cast<BinaryExpr>(expr)) {
+      return binary(bin);
+    }
+    if (auto call = expr_cast<CallExpr>(expr)) {
+      return this->call(call);
+    }
+    if (auto cast = expr_cast<CastExpr>(expr)) {
+      SsaOp op = cast->type_ == Type::kInt ? kSsaToInt : kSsaToDouble;
+      return emit(op, {value(cast->expr_)}, 0, cast->type_);
+    }
+    fprintf(stderr, "ssa -100: unexpected expression\n");
+    abort();
+  }
+
+  uint32_t binary(BinaryExpr *bin) {
+    if (bin->tok_ == tok_assign) {
+      // Resolve() only accepts variables on the left.
+      uint32_t v = emit(kSsaCopy, {value(bin->rhs_)}, 0, bin->type_);
+      defs_[static_cast<VarExpr *>(bin->lhs_)->slot_] = v;
+      return v;
+    }
+
+    SsaOp op;
+    switch (bin->tok_) {
+      case tok_less: op = kSsaLt; break;
+      case tok_lessequal: op = kSsaLe; break;
+      case tok_great: op = kSsaGt; break;
+      case tok_greatequal: op = kSsaGe; break;
+      case tok_equal: op = kSsaEq; break;
+      case tok_add: op = kSsaAdd; break;
+      case tok_sub: op = kSsaSub; break;
+      case tok_mul: op = kSsaMul; break;
+      case tok_div: op = kSsaDiv; break;
+      default:
+        fprintf(stderr, "ssa -200: bad operator %d\n", bin->tok_);
+        abort();
+    }
+    uint32_t lhs = value(bin->lhs_);
+    uint32_t rhs = value(bin->rhs_);
+    return emit(op, {lhs, rhs}, 0, bin->type_);
+  }
+
+  uint32_t call(CallExpr *call) {
+    std::vector<uint32_t> args;
+    for (auto arg : call->args_) {
+      args.push_back(value(arg));
+    }
+    SsaInstr ins;
+    ins.type = call->type_;
+    if (const Native *native = call->native_) {
+      ins.native = native;
+      if (native->name == sym_sqrt) {
+        ins.op = kSsaSqrt;
+      }
+      else if (native->name == sym_sin) {
+        ins.op = kSsaSin;
+      }
+      else if (native->name == sym_pow) {
+        ins.op = kSsaPow;
+      }
+      else {
+        ins.op = kSsaNative;
+      }
+    }
+    else if (call->callee_) {
+      ins.op = kSsaCall;
+      ins.callee = call->callee_;
+      ins.tail = call->tail_;
+    }
+    else {
+      fprintf(stderr, "ssa -300: %s was not linked\n",
+              symbols().name(call->id_).c_str());
+      abort();
+    }
+    ins.args = std::move(args);
+    return add(std::move(ins), block_);
+  }
+
+ private:
+  FunctionExpr *func_;
+  SsaFunction ssa_;
+  // The block being filled, kNone after a return.
+  uint32_t block_{kNone};
+  // The value of each frame slot.
+  std::vector<uint32_t> defs_;
+};
+
+// Keep the values of each block that keep(v) holds for.
+template <typename Keep>
+void Filter(SsaFunction *ssa, Keep keep) {
+  for (auto &b : ssa->blocks) {
+    b.code.erase(std::remove_if(b.code.begin(), b.code.end(),
+                                [&](uint32_t v) { return !keep(v); }),
+                 b.code.end());
+  }
+}
+
+// Rename every operand through to.
+void Rename(SsaFunction *ssa, const std::vector<uint32_t> &to) {
+  for (auto &b : ssa->blocks) {
+    for (uint32_t v : b.code) {
+      for (auto &arg : ssa->values[v].args) {
+        arg = to[arg];
+      }
+    }
+    if (b.jump != SsaBlock::kGoto) {
+      b.value = to[b.value];
+    }
+  }
+}
+
+/// Value numbering over the dominator tree: a pure instruction is looked
+/// up among those of its dominators, by operation and operands.
+class Numbering {
+ public:
+  explicit Numbering(SsaFunction *ssa) : ssa_(ssa) {}
+
+  void run() {
+    size_t n = ssa_->blocks.size();
+    // Every predecessor comes first, so one pass finds the dominators.
+    std::vector<uint32_t> idom(n, 0);
+    children_.assign(n, {});
+    for (uint32_t b = 1; b < n; ++b) {
+      auto &preds = ssa_->blocks[b].preds;
+      uint32_t d = preds[0];
+      for (uint32_t p : preds) {
+        uint32_t q = p;
+        while (d != q) {
+          if (d > q) {
+            d = idom[d];
+          }
+          else {
+            q = idom[q];
+          }
+        }
+      }
+      idom[b] = d;
+      children_[d].push_back(b);
+    }
+
+    to_.resize(ssa_->values.size());
+    for (uint32_t v = 0; v < to_.size(); ++v) {
+      to_[v] = v;
+    }
+    visit(0);
+    Rename(ssa_, to_);
+    Filter(ssa_, [this](uint32_t v) { return to_[v] == v; });
+  }
+
+ private:
+  typedef std::vector<uintptr_t> Key;
+
+  void visit(uint32_t b) {
+    std::vector<Key> added;
+    for (uint32_t v : ssa_->blocks[b].code) {
+      auto &ins = ssa_->values[v];
+      for (auto &arg : ins.args) {
+        arg = to_[arg];
+      }
+      if (!Pure(ins) || ins.op == kSsaParam || ins.op == kSsaCopy) {
+        continue;
+      }
+      // A constant's bits can be either type.
+      Key key = {ins.op, static_cast<uintptr_t>(ins.type), ins.k,
+                 reinterpret_cast<uintptr_t>(ins.callee)};
+      // Phis of different blocks merge different paths.
+      if (ins.op == kSsaPhi) {
+        key.push_back(b);
+      }
+      size_t first = key.size();
+      key.insert(key.end(), ins.args.begin(), ins.args.end());
+      if (Commutative(ins.op)) {
+        std::sort(key.begin() + first, key.end());
+      }
+      auto it = table_.find(key);
+      if (it != table_.end()) {
+        to_[v] = it->second;
+      }
+      else {
+        table_.emplace(key, v);
+        added.push_back(std::move(key));
+      }
+    }
+    for (uint32_t c : children_[b]) {
+      visit(c);
+    }
+    for (auto &key : added) {
+      table_.erase(key);
+    }
+  }
+
+ private:
+  SsaFunction *ssa_;
+  std::vector<std::vector<uint32_t>> children_;
+  std::map<Key, uint32_t> table_;
+  std::vector<uint32_t> to_;
+};
+
+}  // namespace
+
+SsaFunction BuildSsa(FunctionExpr *func) {
+  return Builder(func).build();
+}
+
+void PropagateCopies(SsaFunction *ssa) {
+  std::vector<uint32_t> to(ssa->values.size());
+  for (uint32_t v = 0; v < to.size(); ++v) {
+    to[v] = v;
+  }
+  // Sources are defined before their uses, so one pass is enough.
+  for (auto &b : ssa->blocks) {
+    for (uint32_t v : b.code) {
+      auto &ins = ssa->values[v];
+      for (auto &arg : ins.args) {
+        arg = to[arg];
+      }
+      if (ins.op == kSsaCopy) {
+        to[v] = ins.args[0];
+      }
+      else if (ins.op == kSsaPhi &&
+               std::all_of(ins.args.begin(), ins.args.end(),
+                           [&](uint32_t a) { return a == ins.args[0]; })) {
+        to[v] = ins.args[0];
+      }
+    }
+  }
+  Rename(ssa, to);
+  Filter(ssa, [&](uint32_t v) { return to[v] == v; });
+}
+
+void EliminateCommon(SsaFunction *ssa) {
+  Numbering(ssa).run();
+}
+
+void EliminateDead(SsaFunction *ssa) {
+  std::vector<bool> live(ssa->values.size());
+  std::vector<uint32_t> work;
+  auto mark = [&](uint32_t v) {
+    if (!live[v]) {
+      live[v] = true;
+      work.push_back(v);
+    }
+  };
+  for (auto &b : ssa->blocks) {
+    for (uint32_t v : b.code) {
+      if (!Pure(ssa->values[v])) {
+        mark(v);
+      }
+    }
+    if (b.jump != SsaBlock::kGoto) {
+      mark(b.value);
+    }
+  }
+  while (!work.empty()) {
+    uint32_t v = work.back();
+    work.pop_back();
+    for (uint32_t arg : ssa->values[v].args) {
+      mark(arg);
+    }
+  }
+  // Parameters stay, since the frame layout depends on them.
+  Filter(ssa, [&](uint32_t v) {
+    return live[v] || ssa->values[v].op == kSsaParam;
+  });
+}
+
+void OptimizeSsa(SsaFunction *ssa) {
+  PropagateCopies(ssa);
+  EliminateCommon(ssa);
+  // Merging values can leave phis with equal arguments.
+  PropagateCopies(ssa);
+  EliminateDead(ssa);
+}
+
+void SsaFunction::dump(FILE *fp) const {
+  fprintf(fp, "%s:\n", symbols().name(func->proto_->name_).c_str());
+  for (size_t idx = 0; idx < blocks.size(); ++idx) {
+    auto &b = blocks[idx];
+    fprintf(fp, "  b%zu:", idx);
+    for (uint32_t p : b.preds) {
+      fprintf(fp, " b%u", p);
+    }
+    fprintf(fp, "\n");
+    for (uint32_t v : b.code) {
+      auto &ins = values[v];
+      bool ints = ins.type == Type::kInt;
+      fprintf(fp, "    v%u%s = %s", v, ints ? ":int" : "", kSsaNames[ins.op]);
+      if (ins.op == kSsaParam) {
+        fprintf(fp, " %u", ins.k);
+      }
+      else if (ins.op == kSsaConst && ints) {
+        fprintf(fp, " %lld",
+                static_cast<long long>(BitsInt(constants()[ins.k])));
+      }
+      else if (ins.op == kSsaConst) {
+        fprintf(fp, " %g", constants()[ins.k]);
+      }
+      else if (ins.op == kSsaCall) {
+        fprintf(fp, " %s", symbols().name(ins.callee->proto_->name_).c_str());
+      }
+      else if (ins.op == kSsaNative) {
+        fprintf(fp, " %s", symbols().name(ins.native->name).c_str());
+      }
+      for (uint32_t arg : ins.args) {
+        fprintf(fp, " v%u", arg);
+      }
+      fprintf(fp, "\n");
+    }
+    switch (b.jump) {
+      case SsaBlock::kGoto:
+        fprintf(fp, "    goto b%u\n", b.succ[0]);
+        break;
+      case SsaBlock::kBranch:
+        fprintf(fp, "    branch v%u b%u b%u\n", b.value, b.succ[0], b.succ[1]);
+        break;
+      case SsaBlock::kReturn:
+        fprintf(fp, "    %s v%u\n", tail(b) ? "tail" : "return", b.value);
+        break;
+    }
+  }
+}
+
+}  // namespace smcc
@@ -0,0 +1,112 @@
+// Copyright (c) 2020 smarsufan. All Rights Reserved.
+
+#pragma once
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#include "expr.h"
+#include "native.h"
+
+namespace smcc {
+
+enum SsaOp : uint8_t {
+  // Parameter k.
+  kSsaParam,
+  // constants()[k].
+  kSsaConst,
+  // args[0], from an assignment.
+  kSsaCopy,
+  // args[i] when entered from preds[i].
+  kSsaPhi,
+  kSsaAdd,
+  kSsaSub,
+  kSsaMul,
+  kSsaDiv,
+  kSsaLt,
+  kSsaLe,
+  kSsaGt,
+  kSsaGe,
+  kSsaEq,
+  // args[0], a double, toward zero; and an int to double.
+  kSsaToInt,
+  kSsaToDouble,
+  kSsaSqrt,
+  kSsaSin,
+  kSsaPow,
+  // callee(args...), a script function.
+  kSsaCall,
+  // native(args...), a host function but the builtins above.
+  kSsaNative,
+};
+
+/// One instruction. It defines the value numbered as it is.
+struct SsaInstr {
+  SsaOp op;
+  // The type of the value. Arithmetic on ints has int operands; the
+  // operands of a comparison, which gives an int, may be either.
+  Type type{Type::kDouble};
+  // A Call of `return f(...)`; see SsaFunction::tail().
+  bool tail{false};
+  uint32_t k{0};
+  // The callee of a Call; the host function of a Native or builtin.
+  FunctionExpr *callee{nullptr};
+  const Native *native{nullptr};
+  std::vector<uint32_t> args;
+};
+
+struct SsaBlock {
+  enum Jump : uint8_t {
+    kGoto,
+    kBranch,
+    kReturn,
+  };
+
+  // Values, phis first.
+  std::vector<uint32_t> code;
+  std::vector<uint32_t> preds;
+  Jump jump{kReturn};
+  // The branch condition or the returned value.
+  uint32_t value{0};
+  // Goto succ[0]. Branch to succ[0] unless value is 0, else to succ[1].
+  uint32_t succ[2]{0, 0};
+};
+
+/// A function as SSA basic blocks. Every block comes after its
+/// predecessors, so the order is also one where definitions come before
+/// their uses. A branch goes to blocks with no other predecessor, so only
+/// gotos carry phi arguments.
+struct SsaFunction {
+  FunctionExpr *func{nullptr};
+  // By value number; those no block lists any more are dead.
+  std::vector<SsaInstr> values;
+  std::vector<SsaBlock> blocks;
+
+  // Whether block returns the value of a tail call that ends it, so the
+  // call can reuse the frame.
+  bool tail(const SsaBlock &block) const {
+    return block.jump == SsaBlock::kReturn && !block.code.empty() &&
+           block.code.back() == block.value && values[block.value].tail;
+  }
+
+  void dump(FILE *fp) const;
+};
+
+/// func, resolved and linked, in SSA form. Every assignment is a Copy and
+/// statements that can not run are left out.
+SsaFunction BuildSsa(FunctionExpr *func);
+
+/// Forward copies, and phis whose arguments agree, to their source.
+void PropagateCopies(SsaFunction *ssa);
+
+/// Replace a pure instruction by an equal one that dominates it.
+/// Builtins and calls of pure_ functions count as pure.
+void EliminateCommon(SsaFunction *ssa);
+
+/// Drop pure instructions whose values are never used.
+void EliminateDead(SsaFunction *ssa);
+
+/// All of the above; what the backends compile.
+void OptimizeSsa(SsaFunction *ssa);
+
+}  // namespace smcc
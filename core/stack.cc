@@ -0,0 +1,56 @@
+// Copyright (c) 2020 smarsufan. All Rights Reserved.
+
+#include "stack.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <pthread.h>
+#include <sys/mman.h>
+
+namespace smcc {
+
+Stack::Stack(size_t max_slots) {
+  size_t bytes = max_slots * sizeof(double);
+  void *addr = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (addr == MAP_FAILED) {
+    fprintf(stderr, "stack -100: can not reserve %zu bytes\n", bytes);
+    abort();
+  }
+  begin_ = top_ = static_cast<double *>(addr);
+  limit_ = begin_ + max_slots;
+}
+
+Stack::~Stack() {
+  munmap(begin_, (limit_ - begin_) * sizeof(double));
+}
+
+void Stack::release() {
+  madvise(begin_, (limit_ - begin_) * sizeof(double), MADV_DONTNEED);
+}
+
+void Stack::overflow() {
+  fprintf(stderr, "stack -200: stack overflow (%zu slots)\n",
+          static_cast<size_t>(limit_ - begin_));
+  abort();
+}
+
+const char *NativeStackFloor() {
+  constexpr size_t kMargin = 256 << 10;
+  thread_local const char *floor = [] {
+    pthread_attr_t attr;
+    void *addr = nullptr;
+    size_t size = 0;
+    if (pthread_getattr_np(pthread_self(), &attr) == 0) {
+      pthread_attr_getstack(&attr, &addr, &size);
+      pthread_attr_destroy(&attr);
+    }
+    if (!addr || size <= 2 * kMargin) {
+      return static_cast<const char *>(nullptr);
+    }
+    return static_cast<const char *>(addr) + kMargin;
+  }();
+  return floor;
+}
+
+}  // namespace smcc
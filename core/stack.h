@@ -0,0 +1,68 @@
+// Copyright (c) 2020 smarsufan. All Rights Reserved.
+
+#pragma once
+#include <cstddef>
+
+namespace smcc {
+
+/// The value stack holding call frames.
+///
+/// The whole range is reserved as address space up front and the kernel
+/// commits pages on first touch, so a fresh stack costs nothing and frames
+/// never move. Running past the end is reported, not corrupted.
+class Stack {
+ public:
+  // 512 MiB of address space.
+  static constexpr size_t kMaxSlots = 64 << 20;
+
+  Stack(size_t max_slots = kMaxSlots);
+
+  ~Stack();
+
+  Stack(const Stack &) = delete;
+
+  Stack &operator=(const Stack &) = delete;
+
+  double *begin() const { return begin_; }
+
+  double *top() const { return top_; }
+
+  // A frame of n slots at the top.
+  double *push(size_t n) {
+    double *frame = top_;
+    top_ = reserve(frame, n);
+    return frame;
+  }
+
+  // Drop frame and everything above it.
+  void pop(double *frame) { top_ = frame; }
+
+  // Check that [at, at + n) fits, for frames laid out by the caller.
+  // Returns at + n.
+  double *reserve(double *at, size_t n) {
+    if (static_cast<size_t>(limit_ - at) < n) {
+      overflow();
+    }
+    return at + n;
+  }
+
+  void reset() { top_ = begin_; }
+
+  // Give the pages touched so far back to the system.
+  void release();
+
+ private:
+  [[noreturn]] void overflow();
+
+ private:
+  double *begin_{nullptr};
+  double *top_{nullptr};
+  double *limit_{nullptr};
+};
+
+// How deep the calling thread's C++ stack may grow before a recursive
+// evaluator should stop: its lowest address plus a margin for the frames
+// between checks and for reporting the error. nullptr if unknown.
+const char *NativeStackFloor();
+
+}  // namespace smcc
@@ -0,0 +1,98 @@
+// Copyright (c) 2020 smarsufan. All Rights Reserved.
+
+#include "symbol.h"
+
+#include <cstring>
+
+namespace smcc {
+
+namespace {
+
+uint64_t Hash(const char *s, size_t n) {
+  // FNV-1a
+  uint64_t h = 14695981039346656037ull;
+  for (size_t i = 0; i < n; ++i) {
+    h = (h ^ static_cast<unsigned char>(s[i])) * 1099511628211ull;
+  }
+  return h;
+}
+
+}  // namespace
+
+SymbolTable::SymbolTable() : slots_(256, kNoSymbol) {
+}
+
+Symbol SymbolTable::lookup(const char *s, size_t n, uint64_t hash,
+                           size_t *slot) const {
+  size_t mask = slots_.size() - 1;
+  for (size_t i = hash & mask;; i = (i + 1) & mask) {
+    Symbol sym = slots_[i];
+    if (sym == kNoSymbol) {
+      *slot = i;
+      return kNoSymbol;
+    }
+    const std::string &name = names_[sym];
+    if (hashes_[sym] == hash && name.size() == n &&
+        memcmp(name.data(), s, n) == 0) {
+      *slot = i;
+      return sym;
+    }
+  }
+}
+
+void SymbolTable::grow() {
+  std::vector<Symbol> slots(slots_.size() * 2, kNoSymbol);
+  size_t mask = slots.size() - 1;
+  for (Symbol sym = 0; sym < static_cast<Symbol>(names_.size()); ++sym) {
+    size_t i = hashes_[sym] & mask;
+    while (slots[i] != kNoSymbol) {
+      i = (i + 1) & mask;
+    }
+    slots[i] = sym;
+  }
+  slots_.swap(slots);
+}
+
+Symbol SymbolTable::intern(const char *s, size_t n) {
+  uint64_t hash = Hash(s, n);
+  std::lock_guard<std::mutex> lock(mutex_);
+  size_t slot;
+  Symbol sym = lookup(s, n, hash, &slot);
+  if (sym != kNoSymbol) {
+    return sym;
+  }
+
+  sym = static_cast<Symbol>(names_.size());
+  names_.emplace_back(s, n);
+  hashes_.push_back(hash);
+  slots_[slot] = sym;
+  // Keep the load factor under 1/2.
+  if (names_.size() * 2 > slots_.size()) {
+    grow();
+  }
+  return sym;
+}
+
+Symbol SymbolTable::find(const std::string &s) const {
+  uint64_t hash = Hash(s.data(), s.size());
+  std::lock_guard<std::mutex> lock(mutex_);
+  size_t slot;
+  return lookup(s.data(), s.size(), hash, &slot);
+}
+
+const std::string &SymbolTable::name(Symbol sym) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return names_[sym];
+}
+
+size_t SymbolTable::size() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return names_.size();
+}
+
+SymbolTable &symbols() {
+  static SymbolTable table;
+  return table;
+}
+
+}  // namespace smcc
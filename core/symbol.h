@@ -0,0 +1,52 @@
+// Copyright (c) 2020 smarsufan. All Rights Reserved.
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace smcc {
+
+/// Dense id of an interned identifier.
+typedef int32_t Symbol;
+
+constexpr Symbol kNoSymbol = -1;
+
+/// Interns every identifier once; ids start at 0 and are never reused, so
+/// later stages can index tables by them.
+class SymbolTable {
+ public:
+  SymbolTable();
+
+  Symbol intern(const char *s, size_t n);
+
+  Symbol intern(const std::string &s) { return intern(s.data(), s.size()); }
+
+  // The id of s, or kNoSymbol if it was never interned.
+  Symbol find(const std::string &s) const;
+
+  const std::string &name(Symbol sym) const;
+
+  size_t size() const;
+
+ private:
+  Symbol lookup(const char *s, size_t n, uint64_t hash, size_t *slot) const;
+
+  void grow();
+
+ private:
+  mutable std::mutex mutex_;
+  // Deque so names never move once interned.
+  std::deque<std::string> names_;
+  std::vector<uint64_t> hashes_;
+  // Open addressing over ids, kNoSymbol marks an empty slot.
+  std::vector<Symbol> slots_;
+};
+
+// The process-wide symbol table.
+SymbolTable &symbols();
+
+}  // namespace smcc
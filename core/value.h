@@ -0,0 +1,80 @@
+// Copyright (c) 2020 smarsufan. All Rights Reserved.
+
+#pragma once
+#include <cstdint>
+#include <cstring>
+
+namespace smcc {
+
+/// The static type of a value, from the declarations; see Check().
+///
+/// Every slot, register and constant is 8 bytes, whatever it holds: an
+/// int is stored as the bits of its int64_t, never converted, so only the
+/// operations that read a value need to know its type.
+enum class Type : uint8_t {
+  kDouble,
+  kInt,
+};
+
+inline double IntBits(int64_t value) {
+  double bits;
+  memcpy(&bits, &value, sizeof(bits));
+  return bits;
+}
+
+inline int64_t BitsInt(double bits) {
+  int64_t value;
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+// double to int as cvttsd2si does it: toward zero, and INT64_MIN for NaN
+// and out of range.
+inline int64_t TruncInt(double x) {
+  return x >= -9223372036854775808.0 && x < 9223372036854775808.0
+             ? static_cast<int64_t>(x)
+             : INT64_MIN;
+}
+
+// Int arithmetic wraps around, and x / 0 is 0, so no backend traps.
+inline int64_t IntAdd(int64_t a, int64_t b) {
+  return static_cast<int64_t>(static_cast<uint64_t>(a) + b);
+}
+
+inline int64_t IntSub(int64_t a, int64_t b) {
+  return static_cast<int64_t>(static_cast<uint64_t>(a) - b);
+}
+
+inline int64_t IntMul(int64_t a, int64_t b) {
+  return static_cast<int64_t>(static_cast<uint64_t>(a) * b);
+}
+
+inline int64_t IntDiv(int64_t a, int64_t b) {
+  if (b == 0) {
+    return 0;
+  }
+  return b == -1 ? IntSub(0, a) : a / b;
+}
+
+// A value of the other type converted to type.
+inline double Cast(Type type, double value) {
+  return type == Type::kInt ? IntBits(TruncInt(value))
+                            : static_cast<double>(BitsInt(value));
+}
+
+// Whether a condition of type holds: anything but 0, NaN included.
+inline bool Holds(Type type, double value) {
+  return type == Type::kInt ? BitsInt(value) != 0 : value != 0;
+}
+
+// A host double as a value of type, and back: the conversions at the
+// edge of a script, where every argument and result is a double.
+inline double FromHost(Type type, double x) {
+  return type == Type::kInt ? IntBits(TruncInt(x)) : x;
+}
+
+inline double ToHost(Type type, double value) {
+  return type == Type::kInt ? static_cast<double>(BitsInt(value)) : value;
+}
+
+}  // namespace smcc
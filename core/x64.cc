@@ -0,0 +1,575 @@
+// Copyright (c) 2020 smarsufan. All Rights Reserved.
+
+#include "x64.h"
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "ast.h"
+#include "regalloc.h"
+#include "ssa.h"
+
+namespace smcc {
+
+namespace {
+
+// Doubles passed in xmm0-xmm7, ints in rdi, rsi, rdx, rcx, r8 and r9; the
+// rest go on the stack.
+constexpr size_t kArgRegs = 8;
+const int kIntArgRegs[] = {7, 6, 2, 1, 8, 9};
+constexpr size_t kIntArgs = sizeof(kIntArgRegs) / sizeof(kIntArgRegs[0]);
+
+// Values get xmm8-xmm15. Those are never arguments, so moving values into
+// argument registers never overwrites another; xmm0 and xmm1 are scratch.
+const std::vector<int> kValueRegs = {8, 9, 10, 11, 12, 13, 14, 15};
+
+// Ints get rbx and r12-r15: never arguments either, and calls preserve
+// them, so they stay put across calls. rax, rcx and rdx are scratch.
+const std::vector<int> kIntValueRegs = {3, 12, 13, 14, 15};
+
+bool Compare(SsaOp op) {
+  return op >= kSsaLt && op <= kSsaEq;
+}
+
+// The instructions lowered to calls, which clobber every xmm register.
+bool Call(SsaOp op) {
+  return op == kSsaSin || op == kSsaPow || op == kSsaCall ||
+         op == kSsaNative;
+}
+
+// rbp displacement of frame slot.
+int Slot(int slot) {
+  return -8 * (slot + 1);
+}
+
+// Where an argument goes: the register, or the stack.
+struct Place {
+  int reg;
+  // Its index among those on the stack, or -1.
+  int stack;
+};
+
+// The places of arguments of types, in order.
+std::vector<Place> Places(const std::vector<Type> &types) {
+  std::vector<Place> at;
+  size_t xmm = 0, ints = 0;
+  int stack = 0;
+  for (Type type : types) {
+    if (type == Type::kInt ? ints < kIntArgs : xmm < kArgRegs) {
+      int reg = type == Type::kInt ? kIntArgRegs[ints++]
+                                   : static_cast<int>(xmm++);
+      at.push_back({reg, -1});
+    }
+    else {
+      at.push_back({-1, stack++});
+    }
+  }
+  return at;
+}
+
+/// Lowers the SSA form of a function. LinearScan() puts values in
+/// registers; the ones it spills get frame slots, or stay where the caller
+/// passed them. Constants are loaded where they are used.
+class Lowering {
+ public:
+  Lowering(FunctionExpr *func, X64Assembler *as, bool registers)
+      : func_(func), as_(as), registers_(registers) {}
+
+  void run() {
+    ssa_ = BuildSsa(func_);
+    OptimizeSsa(&ssa_);
+    reg_ = LinearScan(ssa_, registers_ ? kValueRegs : std::vector<int>(),
+                      registers_ ? kIntValueRegs : std::vector<int>(), Call);
+
+    size_t nparams = func_->proto_->args_.size();
+    std::vector<Place> params = Places(std::vector<Type>(
+        func_->slot_types_.begin(), func_->slot_types_.begin() + nparams));
+    size_t nvalues = ssa_.values.size();
+    disp_.assign(nvalues, 0);
+    uses_.assign(nvalues, 0);
+    int slots = 0;
+    int scratch = 0;
+    std::vector<int> saved;
+    for (auto &b : ssa_.blocks) {
+      for (uint32_t v : b.code) {
+        auto &ins = ssa_.values[v];
+        if (ins.op == kSsaParam && params[ins.k].stack >= 0) {
+          // Above the return address, in the caller's frame.
+          disp_[v] = 16 + 8 * params[ins.k].stack;
+        }
+        else if (reg_[v] == kSpilled && ins.op != kSsaConst) {
+          disp_[v] = Slot(slots++);
+        }
+        if (reg_[v] != kSpilled && ins.type == Type::kInt &&
+            std::find(saved.begin(), saved.end(), reg_[v]) == saved.end()) {
+          saved.push_back(reg_[v]);
+        }
+        for (uint32_t arg : ins.args) {
+          ++uses_[arg];
+        }
+        if (ins.op == kSsaCall || ins.op == kSsaNative) {
+          int stack = 0;
+          for (auto &place : Places(types(ins.args))) {
+            stack += place.stack >= 0;
+          }
+          scratch = std::max(scratch, stack);
+        }
+      }
+      if (b.jump != SsaBlock::kGoto) {
+        ++uses_[b.value];
+      }
+    }
+    // The caller's values in the registers we use for ints.
+    for (int reg : saved) {
+      saved_.emplace_back(reg, Slot(slots++));
+    }
+    // Stack arguments not already in a slot go through these.
+    scratch_ = slots;
+
+    as_->begin(func_);
+    for (auto &save : saved_) {
+      as_->store_int(save.second, save.first);
+    }
+    for (uint32_t v : ssa_.blocks[0].code) {
+      auto &ins = ssa_.values[v];
+      if (ins.op != kSsaParam) {
+        continue;
+      }
+      if (params[ins.k].stack < 0) {
+        def(v, params[ins.k].reg);
+      }
+      else if (reg_[v] != kSpilled) {
+        load(reg_[v], v);
+      }
+    }
+
+    labels_.resize(ssa_.blocks.size());
+    for (auto &label : labels_) {
+      label = as_->new_label();
+    }
+    for (uint32_t b = 0; b < ssa_.blocks.size(); ++b) {
+      as_->bind(labels_[b]);
+      block(b);
+    }
+
+    // A multiple of 16 keeps calls aligned.
+    as_->end(func_, ((slots + scratch) * 8 + 15) / 16 * 16);
+  }
+
+ private:
+  bool ints(uint32_t v) const {
+    return ssa_.values[v].type == Type::kInt;
+  }
+
+  std::vector<Type> types(const std::vector<uint32_t> &values) const {
+    std::vector<Type> out;
+    for (uint32_t v : values) {
+      out.push_back(ssa_.values[v].type);
+    }
+    return out;
+  }
+
+  // Give the caller its registers back, before leaving the frame.
+  void restore() {
+    for (auto &save : saved_) {
+      as_->load_int(save.first, save.second);
+    }
+  }
+
+  void block(uint32_t idx) {
+    typedef X64Assembler A;
+    const SsaBlock &b = ssa_.blocks[idx];
+    bool tail = ssa_.tail(b);
+    if (tail) {
+      for (auto &place : Places(types(ssa_.values[b.value].args))) {
+        tail = tail && place.stack < 0;
+      }
+    }
+    // A comparison the branch alone uses becomes a compare-and-jump.
+    bool fused = b.jump == SsaBlock::kBranch && !b.code.empty() &&
+                 b.code.back() == b.value && uses_[b.value] == 1 &&
+                 Compare(ssa_.values[b.value].op);
+    for (uint32_t v : b.code) {
+      if (fused && v == b.value) {
+        break;
+      }
+      instr(v, tail && v == b.value);
+    }
+
+    uint32_t next = idx + 1;
+    switch (b.jump) {
+      case SsaBlock::kGoto: {
+        const SsaBlock &succ = ssa_.blocks[b.succ[0]];
+        size_t from = std::find(succ.preds.begin(), succ.preds.end(), idx) -
+                      succ.preds.begin();
+        // No phi shares a register with an argument of a phi of the same
+        // block, so the moves need no order.
+        for (uint32_t v : succ.code) {
+          auto &ins = ssa_.values[v];
+          if (ins.op == kSsaPhi) {
+            if (reg_[v] != kSpilled) {
+              move(reg_[v], ins.args[from]);
+            }
+            else {
+              def(v, use(ins.args[from], 0));
+            }
+          }
+        }
+        if (b.succ[0] != next) {
+          as_->jmp(labels_[b.succ[0]]);
+        }
+        break;
+      }
+      case SsaBlock::kBranch:
+        if (fused) {
+          branch_false(ssa_.values[b.value], labels_[b.succ[1]]);
+        }
+        else if (ints(b.value)) {
+          int cond = use(b.value, 0);
+          as_->alu(A::kTest, cond, cond);
+          as_->jcc(A::kE, labels_[b.succ[1]]);
+        }
+        else {
+          // Anything but 0 is true, NaN included.
+          uint32_t taken = as_->new_label();
+          int cond = use(b.value, 0);
+          as_->sse(A::kPxor, 1, 1);
+          as_->sse(A::kUcomisd, cond, 1);
+          as_->jcc(A::kP, taken);
+          as_->jcc(A::kE, labels_[b.succ[1]]);
+          as_->bind(taken);
+        }
+        if (b.succ[0] != next) {
+          as_->jmp(labels_[b.succ[0]]);
+        }
+        break;
+      case SsaBlock::kReturn:
+        if (!tail) {
+          // xmm0 or rax.
+          move(0, b.value);
+          restore();
+          as_->ret();
+        }
+        break;
+    }
+  }
+
+  // Jump to target unless the comparison ins holds. ucomisd sets CF on
+  // unordered, so NaN operands take the jump, as a false comparison
+  // should.
+  void branch_false(const SsaInstr &ins, uint32_t target) {
+    typedef X64Assembler A;
+    int lhs = use(ins.args[0], 0);
+    int rhs = use(ins.args[1], 1);
+    if (ints(ins.args[0])) {
+      as_->alu(A::kCmp, lhs, rhs);
+      switch (ins.op) {
+        case kSsaLt: as_->jcc(A::kGE, target); break;
+        case kSsaLe: as_->jcc(A::kG, target); break;
+        case kSsaGt: as_->jcc(A::kLE, target); break;
+        case kSsaGe: as_->jcc(A::kL, target); break;
+        default: as_->jcc(A::kNE, target); break;
+      }
+      return;
+    }
+    switch (ins.op) {
+      case kSsaLt:
+        as_->sse(A::kUcomisd, rhs, lhs);
+        as_->jcc(A::kBE, target);
+        break;
+      case kSsaLe:
+        as_->sse(A::kUcomisd, rhs, lhs);
+        as_->jcc(A::kB, target);
+        break;
+      case kSsaGt:
+        as_->sse(A::kUcomisd, lhs, rhs);
+        as_->jcc(A::kBE, target);
+        break;
+      case kSsaGe:
+        as_->sse(A::kUcomisd, lhs, rhs);
+        as_->jcc(A::kB, target);
+        break;
+      default:
+        as_->sse(A::kUcomisd, lhs, rhs);
+        as_->jcc(A::kNE, target);
+        as_->jcc(A::kP, target);
+        break;
+    }
+  }
+
+  // v into reg, an xmm register for a double, a general one for an int.
+  void move(int reg, uint32_t v) {
+    typedef X64Assembler A;
+    auto &ins = ssa_.values[v];
+    if (ins.op == kSsaConst) {
+      if (ints(v)) {
+        as_->constant_int(reg, BitsInt(constants()[ins.k]));
+      }
+      else {
+        as_->constant(reg, constants()[ins.k]);
+      }
+    }
+    else if (reg_[v] == kSpilled) {
+      load(reg, v);
+    }
+    else if (reg_[v] != reg) {
+      if (ints(v)) {
+        as_->alu(A::kMov, reg, reg_[v]);
+      }
+      else {
+        as_->sse(A::kMovapd, reg, reg_[v]);
+      }
+    }
+  }
+
+  // The slot of v into reg.
+  void load(int reg, uint32_t v) {
+    if (ints(v)) {
+      as_->load_int(reg, disp_[v]);
+    }
+    else {
+      as_->load(reg, disp_[v]);
+    }
+  }
+
+  // reg, holding a value like v, into disp(%rbp).
+  void store(int disp, int reg, uint32_t v) {
+    if (ints(v)) {
+      as_->store_int(disp, reg);
+    }
+    else {
+      as_->store(disp, reg);
+    }
+  }
+
+  // A register holding v: its own, or scratch with v loaded.
+  int use(uint32_t v, int scratch) {
+    if (reg_[v] != kSpilled) {
+      return reg_[v];
+    }
+    move(scratch, v);
+    return scratch;
+  }
+
+  // Where to compute v: its register, or xmm0 or rax for def() to store.
+  int target(uint32_t v) const {
+    return reg_[v] != kSpilled ? reg_[v] : 0;
+  }
+
+  // v is computed in reg; put it where it lives.
+  void def(uint32_t v, int reg) {
+    if (reg_[v] == kSpilled) {
+      store(disp_[v], reg, v);
+    }
+    else if (reg_[v] != reg) {
+      if (ints(v)) {
+        as_->alu(X64Assembler::kMov, reg_[v], reg);
+      }
+      else {
+        as_->sse(X64Assembler::kMovapd, reg_[v], reg);
+      }
+    }
+  }
+
+  void instr(uint32_t v, bool tail) {
+    typedef X64Assembler A;
+    const SsaInstr &ins = ssa_.values[v];
+    // Only the first operand can share a register with the value, and
+    // it is read first.
+    int dst = target(v);
+    bool ints = !ins.args.empty() && this->ints(ins.args[0]);
+    switch (ins.op) {
+      case kSsaParam:
+      case kSsaConst:
+      case kSsaPhi:
+        return;
+      case kSsaCopy:
+        move(dst, ins.args[0]);
+        break;
+      case kSsaAdd:
+        ints ? alu(A::kAdd, dst, ins) : arith(A::kAddsd, dst, ins);
+        break;
+      case kSsaSub:
+        ints ? alu(A::kSub, dst, ins) : arith(A::kSubsd, dst, ins);
+        break;
+      case kSsaMul:
+        ints ? alu(A::kImul, dst, ins) : arith(A::kMulsd, dst, ins);
+        break;
+      case kSsaDiv:
+        if (ints) {
+          divide(ins);
+          dst = 0;
+        }
+        else {
+          arith(A::kDivsd, dst, ins);
+        }
+        break;
+      // A comparison gives the int 1 or 0 in rax.
+      case kSsaLt:
+      case kSsaLe:
+      case kSsaGt:
+      case kSsaGe:
+      case kSsaEq:
+        ints ? compare_int(ins) : compare(ins);
+        dst = 0;
+        break;
+      case kSsaToInt:
+        as_->cvttsd2si(dst, use(ins.args[0], 1));
+        break;
+      case kSsaToDouble:
+        as_->cvtsi2sd(dst, use(ins.args[0], 1));
+        break;
+      case kSsaSqrt:
+        as_->sse(A::kSqrtsd, dst, use(ins.args[0], 1));
+        break;
+      case kSsaSin:
+      case kSsaPow:
+      case kSsaCall:
+      case kSsaNative:
+        if (!call(ins, tail)) {
+          return;
+        }
+        // xmm0 or rax.
+        dst = 0;
+        break;
+    }
+    def(v, dst);
+  }
+
+  void arith(X64Assembler::Sse op, int dst, const SsaInstr &ins) {
+    move(dst, ins.args[0]);
+    as_->sse(op, dst, use(ins.args[1], 1));
+  }
+
+  void alu(X64Assembler::Alu op, int dst, const SsaInstr &ins) {
+    move(dst, ins.args[0]);
+    as_->alu(op, dst, use(ins.args[1], 1));
+  }
+
+  // rax = args[0] / args[1]. idiv traps on x / 0 and INT64_MIN / -1;
+  // those give 0 and -x instead, as IntDiv() has it.
+  void divide(const SsaInstr &ins) {
+    typedef X64Assembler A;
+    move(0, ins.args[0]);
+    int d = use(ins.args[1], 1);
+    uint32_t zero = as_->new_label();
+    uint32_t negate = as_->new_label();
+    uint32_t done = as_->new_label();
+    as_->alu(A::kTest, d, d);
+    as_->jcc(A::kE, zero);
+    // rdx is overwritten by idiv anyway.
+    as_->constant_int(2, -1);
+    as_->alu(A::kCmp, d, 2);
+    as_->jcc(A::kE, negate);
+    as_->idiv(d);
+    as_->jmp(done);
+    as_->bind(negate);
+    as_->neg(0);
+    as_->jmp(done);
+    as_->bind(zero);
+    as_->constant_int(0, 0);
+    as_->bind(done);
+  }
+
+  void compare_int(const SsaInstr &ins) {
+    typedef X64Assembler A;
+    as_->alu(A::kCmp, use(ins.args[0], 0), use(ins.args[1], 1));
+    switch (ins.op) {
+      case kSsaLt: as_->setcc(A::kL); break;
+      case kSsaLe: as_->setcc(A::kLE); break;
+      case kSsaGt: as_->setcc(A::kG); break;
+      case kSsaGe: as_->setcc(A::kGE); break;
+      default: as_->setcc(A::kE); break;
+    }
+  }
+
+  // An all-ones mask in xmm1, whose bits negate to 1. Greater is less
+  // with the operands swapped.
+  void compare(const SsaInstr &ins) {
+    typedef X64Assembler A;
+    bool swap = ins.op == kSsaGt || ins.op == kSsaGe;
+    A::Pred pred = ins.op == kSsaEq ? A::kEq
+                   : ins.op == kSsaLt || ins.op == kSsaGt ? A::kLt
+                                                          : A::kLe;
+    move(1, ins.args[swap]);
+    as_->cmpsd(pred, 1, use(ins.args[!swap], 0));
+    as_->movq(0, 1);
+    as_->neg(0);
+  }
+
+  // Returns false for a tail call, which leaves the frame and jumps to
+  // the callee.
+  bool call(const SsaInstr &ins, bool tail) {
+    size_t nargs = ins.args.size();
+    std::vector<Place> places = Places(types(ins.args));
+    int pushed = 0;
+    for (auto &place : places) {
+      pushed += place.stack >= 0;
+    }
+    if (pushed) {
+      // rsp must stay 16-byte aligned at the call.
+      if (pushed % 2) {
+        as_->add_rsp(-8);
+        ++pushed;
+      }
+      for (size_t p = nargs; p-- > 0;) {
+        if (places[p].stack < 0) {
+          continue;
+        }
+        uint32_t arg = ins.args[p];
+        if (reg_[arg] == kSpilled && ssa_.values[arg].op != kSsaConst) {
+          as_->push(disp_[arg]);
+        }
+        else {
+          int disp = Slot(scratch_ + places[p].stack);
+          store(disp, use(arg, 0), arg);
+          as_->push(disp);
+        }
+      }
+    }
+    for (size_t p = 0; p < nargs; ++p) {
+      if (places[p].stack < 0) {
+        move(places[p].reg, ins.args[p]);
+      }
+    }
+    if (ins.native) {
+      as_->call(ins.native);
+    }
+    else if (tail) {
+      restore();
+      as_->tail(ins.callee);
+      return false;
+    }
+    else {
+      as_->call(ins.callee);
+    }
+    if (pushed) {
+      as_->add_rsp(8 * pushed);
+    }
+    return true;
+  }
+
+ private:
+  FunctionExpr *func_;
+  X64Assembler *as_;
+  bool registers_;
+  SsaFunction ssa_;
+  // Register of each value, and the rbp displacement of spilled ones.
+  std::vector<int> reg_;
+  std::vector<int> disp_;
+  // How often each value is used, the jump of its block included.
+  std::vector<int> uses_;
+  std::vector<uint32_t> labels_;
+  // The registers for ints this function uses, and where it saves them.
+  std::vector<std::pair<int, int>> saved_;
+  int scratch_{0};
+};
+
+}  // namespace
+
+void LowerX64(FunctionExpr *func, X64Assembler *as, bool registers) {
+  Lowering(func, as, registers).run();
+}
+
+}  // namespace smcc
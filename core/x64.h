@@ -0,0 +1,146 @@
+// Copyright (c) 2020 smarsufan. All Rights Reserved.
+
+#pragma once
+#include <cstdint>
+
+#include "expr.h"
+#include "native.h"
+
+namespace smcc {
+
+/// The instructions the x86-64 backends need. CodeGen writes them as GNU
+/// as text, Jit encodes them as machine code; LowerX64() picks them.
+///
+/// Values are doubles in xmm registers, ints in general purpose ones, or
+/// either in 8-byte slots of the rbp frame, addressed by their
+/// displacement from rbp. General purpose registers are numbered as in
+/// the encoding: rax 0, rcx 1, rdx 2, rbx 3, ..., r15 15.
+class X64Assembler {
+ public:
+  // Condition codes, numbered as in jcc.
+  enum Cond : uint8_t {
+    kB = 0x2,
+    kE = 0x4,
+    kNE = 0x5,
+    kBE = 0x6,
+    kP = 0xa,
+    kL = 0xc,
+    kGE = 0xd,
+    kLE = 0xe,
+    kG = 0xf,
+  };
+
+  // Two-register SSE instructions, dst op= src.
+  enum Sse : uint8_t {
+    kAddsd,
+    kSubsd,
+    kMulsd,
+    kDivsd,
+    kMovapd,
+    kAndpd,
+    kPxor,
+    // Sets the flags from dst ? src.
+    kUcomisd,
+    kSqrtsd,
+  };
+
+  // Two-register 64-bit integer instructions, dst op= src.
+  enum Alu : uint8_t {
+    kAdd,
+    kSub,
+    kImul,
+    // Set the flags from dst ? src, and from dst & src.
+    kCmp,
+    kTest,
+    kMov,
+  };
+
+  // cmpsd predicates.
+  enum Pred : uint8_t {
+    kEq = 0,
+    kLt = 1,
+    kLe = 2,
+  };
+
+  virtual ~X64Assembler() = default;
+
+  // push rbp; mov rsp, rbp; then room for the frame.
+  virtual void begin(FunctionExpr *func) = 0;
+
+  // The function needs frame bytes below rbp, a multiple of 16.
+  virtual void end(FunctionExpr *func, int frame) = 0;
+
+  // movsd disp(%rbp), xmm
+  virtual void load(int xmm, int disp) = 0;
+
+  // movsd xmm, disp(%rbp)
+  virtual void store(int disp, int xmm) = 0;
+
+  virtual void constant(int xmm, double value) = 0;
+
+  virtual void sse(Sse op, int dst, int src) = 0;
+
+  virtual void cmpsd(Pred pred, int dst, int src) = 0;
+
+  // movq disp(%rbp), reg
+  virtual void load_int(int reg, int disp) = 0;
+
+  // movq reg, disp(%rbp)
+  virtual void store_int(int disp, int reg) = 0;
+
+  virtual void constant_int(int reg, int64_t value) = 0;
+
+  virtual void alu(Alu op, int dst, int src) = 0;
+
+  // negq reg
+  virtual void neg(int reg) = 0;
+
+  // cqo; idivq src: rax = rdx:rax / src.
+  virtual void idiv(int src) = 0;
+
+  // rax = 1 if cond holds, else 0.
+  virtual void setcc(Cond cond) = 0;
+
+  // cvtsi2sdq reg, xmm
+  virtual void cvtsi2sd(int xmm, int reg) = 0;
+
+  // cvttsd2siq xmm, reg
+  virtual void cvttsd2si(int reg, int xmm) = 0;
+
+  // movq xmm, reg: the bits of a double.
+  virtual void movq(int reg, int xmm) = 0;
+
+  // A label local to the function.
+  virtual uint32_t new_label() = 0;
+
+  virtual void bind(uint32_t label) = 0;
+
+  virtual void jcc(Cond cond, uint32_t label) = 0;
+
+  virtual void jmp(uint32_t label) = 0;
+
+  // pushq disp(%rbp)
+  virtual void push(int disp) = 0;
+
+  // addq $bytes, %rsp; negative bytes subtract.
+  virtual void add_rsp(int bytes) = 0;
+
+  virtual void call(FunctionExpr *callee) = 0;
+
+  virtual void call(const Native *native) = 0;
+
+  // leave; jmp callee: a tail call, returning straight to our caller.
+  virtual void tail(FunctionExpr *callee) = 0;
+
+  // leave; ret
+  virtual void ret() = 0;
+};
+
+/// Lower func through as, System V ABI: doubles in xmm0-xmm7, ints in
+/// rdi, rsi, rdx, rcx, r8 and r9, the rest on the stack, the result in
+/// xmm0 or rax. Works on the optimized SSA form, with doubles in
+/// xmm8-xmm15 and ints in rbx and r12-r15 as far as they go, or in frame
+/// slots only if registers is false.
+void LowerX64(FunctionExpr *func, X64Assembler *as, bool registers = true);
+
+}  // namespace smcc
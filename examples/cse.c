@@ -0,0 +1,21 @@
+double twice(double x) {
+  return x * 2;
+}
+
+double main(double pos, double size) {
+  double a = pos / size;
+  double b = pos / size;
+  double c = a;
+  double d = twice(a) + twice(b);
+  if (c < 0.5) {
+    d = d + sqrt(a) * sqrt(b);
+  }
+  else {
+    d = d - size * pos;
+  }
+  if (pos / size > 0.25) {
+    return d + pos * size;
+  }
+  return d;
+  d = 0;
+}
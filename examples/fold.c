@@ -0,0 +1,70 @@
+double add(double pos, double size, double times) {
+  if (times < 1) {
+    return pos;
+  }
+
+  return add(pos + size, size, times - 1);
+}
+
+double constant() {
+  return sqrt(add(1, 1000, 3)) + 2 * 3 - 1 / 4;
+}
+
+double same(double x) {
+  return x * 1 / 1 - 0;
+}
+
+double plus0(double x) {
+  return x + 0;
+}
+
+double quarter(double x) {
+  return x / 4;
+}
+
+double branch(double x) {
+  if (1 < 2) {
+    return x;
+  }
+  else {
+    return 0;
+  }
+}
+
+double forever(double x) {
+  return forever(x);
+}
+
+double main(double pos, double size) {
+  if (pos < 0) {
+    return forever(1);
+  }
+  return constant() + same(pos) + quarter(size) + branch(pos);
+}
+
+double inc(double x) {
+  return x + 1;
+}
+
+double pair(double a, double b) {
+  return a * 10 + b;
+}
+
+double nested(double x) {
+  return pair(inc(x), inc(x + 5));
+}
+
+double nested3() {
+  return nested(3);
+}
+
+double half(double n, double acc) {
+  if (n < 1) {
+    return acc;
+  }
+  return half(n - 1, acc * 0.5);
+}
+
+double tiny(double x) {
+  return x / half(1074, 1);
+}
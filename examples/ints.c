@@ -0,0 +1,45 @@
+double add(double pos, double size, int times) {
+  if (times < 1) {
+    return pos;
+  }
+
+  return add(pos + size, size, times - 1);
+}
+
+int collatz(int n, int steps) {
+  if (n < 2) {
+    return steps;
+  }
+  if (n - n / 2 * 2 == 0) {
+    return collatz(n / 2, steps + 1);
+  }
+  return collatz(3 * n + 1, steps + 1);
+}
+
+double main(double pos, double size) {
+  int i = pos;
+  int k = i / 1000;
+  return add(0, size / 7, k) + collatz(i + 1, 0) + i / 3 + (i < size / 2) * 5;
+}
+
+double quarter() {
+  return 1 / 4;
+}
+
+int wrap(int n, int d) {
+  return n * 4611686018427387904 + 7 / d;
+}
+
+int trunc(double x) {
+  return x;
+}
+
+int exact() {
+  int x = 9007199254740993;
+  return x - 9007199254740992;
+}
+
+int largest() {
+  int x = 9223372036854775807;
+  return x;
+}
@@ -0,0 +1,24 @@
+extern double tick(double x);
+
+double fib(double n) {
+  if (n < 2) {
+    return n;
+  }
+  return fib(n - 1) + fib(n - 2);
+}
+
+double inverse(double x) {
+  return 1 / x;
+}
+
+double noisy(double x) {
+  return tick(x) + 1;
+}
+
+double score(double x) {
+  return sqrt(x) * sin(x) + pow(x, 0.25) + fib(x / 1000);
+}
+
+double main(double pos, double size) {
+  return score(pos) / size;
+}
@@ -0,0 +1,10 @@
+extern double clamp(double x, double lo, double hi);
+extern double lookup(double idx);
+
+double score(double x) {
+  return clamp(x * 2, 0, 10) + lookup(x) + sqrt(x);
+}
+
+double main(double pos, double size) {
+  return score(pos / size * 8);
+}
@@ -0,0 +1,24 @@
+double steps(double n) {
+  if (n < 1) {
+    return 0;
+  }
+  return steps(n - 1) + 1;
+}
+
+double main(double pos, double size) {
+  double x = pos / size;
+  double y = 0;
+  if (x < 0.25) {
+    y = x * x;
+  }
+  else if (x < 0.5) {
+    y = sqrt(x);
+    if (y > 0.6) {
+      y = y - 0.1;
+    }
+  }
+  else {
+    return 1 - x + steps(x * 40);
+  }
+  return y * 3 + steps(pos / 500);
+}
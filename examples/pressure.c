@@ -0,0 +1,41 @@
+double mix(double a, double b, double c, double d, double e, double f,
+           double g, double h, double i, double j) {
+  return a - b + c * d - e / f + g * h - i + j;
+}
+
+double wide(double x) {
+  double a = x + 1;
+  double b = x * 2;
+  double c = x - 3;
+  double d = x / 4;
+  double e = a * b;
+  double f = c * d;
+  double g = a + c;
+  double h = b - d;
+  double i = e / 7;
+  double j = f + g;
+  double k = h * i;
+  double l = j - k;
+  return a * l + b * k + c * j + d * i + e * h + f * g + a * b * c;
+}
+
+double spread(double x) {
+  double a = x + 1;
+  double b = x * 2;
+  double c = sin(x);
+  double d = a * c + b;
+  double e = pow(d, 0.5) + a;
+  return a + b + c + d + e;
+}
+
+double main(double pos, double size) {
+  double x = pos / size;
+  double y = 0;
+  if (x < 0.5) {
+    y = mix(x, 1, 2, 3, 4, 5, 6, 7, 8, x * 9) + wide(x);
+  }
+  else {
+    y = spread(x) + mix(x, x, x, x, x, x, x, x, x, 0.5);
+  }
+  return y + x * sqrt(size) + pow(x, 2);
+}
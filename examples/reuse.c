@@ -0,0 +1,19 @@
+double reuse(double x) {
+  if (x > 0) {
+    x = x;
+  }
+  return 4 - (x > 0);
+}
+
+int ireuse(int p0) {
+  p0 = (p0 > 0);
+  if (p0) {
+    p0 = p0 + 0;
+  }
+  return 4 - p0;
+}
+
+double main(double pos, double size) {
+  double x = pos - size / 2;
+  return reuse(x) * 10 + ireuse(x);
+}
@@ -0,0 +1,25 @@
+double add(double pos, double size, double times) {
+  if (times < 1) {
+    return pos;
+  }
+
+  return add(pos + size, size, times - 1);
+}
+
+double even(double n) {
+  if (n < 1) {
+    return 1;
+  }
+  return odd(n - 1);
+}
+
+double odd(double n) {
+  if (n < 1) {
+    return 0;
+  }
+  return even(n - 1);
+}
+
+double main(double pos, double size) {
+  return add(0, size, pos) + even(pos);
+}
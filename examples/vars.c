@@ -0,0 +1,48 @@
+double square(double x) {
+  double y = x * x;
+  return y;
+}
+
+double sum(double n, double acc) {
+  if (n < 1) {
+    return acc;
+  }
+  double next = acc + square(n);
+  n = n - 1;
+  return sum(n, next);
+}
+
+double noop(double x) {
+  double y = x;
+}
+
+double paren(double x) {
+  double y = 0;
+  (y) = x * 2;
+  return y;
+}
+
+double spill(double a, double b, double c) {
+  double s = a + b + c;
+  return s;
+}
+
+// u is never assigned, so it reads 0 whatever ran before.
+double unset(double x) {
+  double u;
+  return u + x;
+}
+
+double main(double pos, double size) {
+  double ratio = pos / size;
+  double total = 0;
+  if (ratio < 0.5) {
+    double scale = 2;
+    total = sum(10, 0) * scale;
+  }
+  else {
+    total = square(ratio) + 1;
+  }
+  return total - ratio + noop(total) + paren(ratio) +
+         spill(ratio, 7, 9) + unset(ratio);
+}
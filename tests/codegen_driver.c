@@ -0,0 +1,15 @@
+/* Copyright (c) 2020 smarsufan. All Rights Reserved. */
+
+/* Prints sm_main(pos, size) for each pair of arguments, in hex. */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+double sm_main(double pos, double size);
+
+int main(int argc, char *argv[]) {
+  for (int idx = 1; idx + 1 < argc; idx += 2) {
+    printf("%a\n", sm_main(strtod(argv[idx], NULL), strtod(argv[idx + 1], NULL)));
+  }
+  return 0;
+}
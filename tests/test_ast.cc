@@ -10,16 +10,13 @@ int main(int argv, char *args[]) {
   }
 
   const char *path = args[1];
-  FILE *fb = fopen(path, "r");
-  if (!fb) {
+  auto reader = smcc::OpenReader(path);
+  if (!reader) {
     fprintf(stderr, "can not open %s\n", path);
     return -1;
   }
 
-  smcc::ReaderStdio reader(fb);
-  smcc::AST ast(&reader);
+  smcc::AST ast(reader.get());
 
   ast.parse();
-
-  fclose(fb);
 }
@@ -0,0 +1,52 @@
+// Copyright (c) 2020 smarsufan. All Rights Reserved.
+
+#include <iostream>
+#include <vector>
+
+#include "api.h"
+
+int main(int argv, char *args[]) {
+  if (argv != 2) {
+    fprintf(stderr, "Usage: %s <input.sm>", args[0]);
+  }
+
+  const char *path = args[1];
+  auto reader = smcc::OpenReader(path);
+  if (!reader) {
+    fprintf(stderr, "can not open %s\n", path);
+    return -1;
+  }
+
+  smcc::Program program(reader.get());
+  smcc::Context ctx(&program);
+
+  // Not a multiple of kBatchRows, so the last chunk is partial.
+  const size_t kRows = 5 * smcc::kBatchRows + 17;
+  std::vector<double> pos(kRows), size(kRows, 16000.);
+  const double *columns[] = {pos.data(), size.data()};
+
+  // Every row must match a call on its own, whatever the thread count. In
+  // order, neighbouring rows take the same branches; shuffled, they don't.
+  for (size_t stride : {1, 7919}) {
+    for (size_t row = 0; row < kRows; ++row) {
+      pos[row] = (row * stride % kRows) * 3.;
+    }
+    for (int threads : {1, 4}) {
+      smcc::Batch batch(&program, threads);
+      for (auto engine : {smcc::Engine::kWalk, smcc::Engine::kBytecode,
+                          smcc::Engine::kSimd}) {
+        std::vector<double> out(kRows);
+        batch.run("main", columns, kRows, out.data(), engine);
+        for (size_t row = 0; row < kRows; ++row) {
+          double expect = ctx.call("main", {pos[row], size[row]});
+          if (out[row] != expect) {
+            fprintf(stderr, "row %zu: %f != %f (%d threads, engine %d)\n",
+                    row, out[row], expect, threads,
+                    static_cast<int>(engine));
+            return -1;
+          }
+        }
+      }
+    }
+  }
+}
@@ -10,21 +10,25 @@ int main(int argv, char *args[]) {
   }
 
   const char *path = args[1];
-  FILE *fb = fopen(path, "r");
-  if (!fb) {
+  auto reader = smcc::OpenReader(path);
+  if (!reader) {
     fprintf(stderr, "can not open %s\n", path);
     return -1;
   }
 
-  smcc::ReaderStdio reader(fb);
-  smcc::AST ast(&reader);
+  smcc::Program program(reader.get());
+  smcc::Context ctx(&program);
 
-  ast.parse();
+  // The bytecode interpreter must agree with the tree walker on every
+  // branch of main.
+  for (double pos : {0., 8000., 15000.}) {
+    auto expect = ctx.eval("main", {pos, 16000.});
+    auto v = ctx.call("main", {pos, 16000.});
 
-  smcc::reset();
-  auto v = smcc::call("main", {0., 16000.});
-
-  fprintf(stderr, "%f\n", v);  
-
-  fclose(fb);
+    fprintf(stderr, "%f\n", v);
+    if (v != expect) {
+      fprintf(stderr, "call %f != eval %f\n", v, expect);
+      return -1;
+    }
+  }
 }
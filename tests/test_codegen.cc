@@ -0,0 +1,82 @@
+// Copyright (c) 2020 smarsufan. All Rights Reserved.
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "api.h"
+
+int main(int argv, char *args[]) {
+  if (argv != 4) {
+    fprintf(stderr, "Usage: %s <input.sm> <cc> <driver.c>\n", args[0]);
+    return -1;
+  }
+
+  const char *path = args[1];
+  auto reader = smcc::OpenReader(path);
+  if (!reader) {
+    fprintf(stderr, "can not open %s\n", path);
+    return -1;
+  }
+
+  smcc::Program program(reader.get());
+  smcc::Context ctx(&program);
+
+  std::string base = path;
+  base = base.substr(base.find_last_of('/') + 1);
+  std::string asm_path = base + ".s";
+  std::string exe_path = "./" + base + ".bin";
+
+  FILE *fp = fopen(asm_path.c_str(), "w");
+  if (!fp) {
+    fprintf(stderr, "can not open %s\n", asm_path.c_str());
+    return -1;
+  }
+  smcc::CodeGen(fp, "sm_").emit(program);
+  fclose(fp);
+
+  std::string cc = std::string(args[2]) + " -o " + exe_path + " " +
+                   asm_path + " " + args[3] + " -lm";
+  if (system(cc.c_str()) != 0) {
+    fprintf(stderr, "failed: %s\n", cc.c_str());
+    return -1;
+  }
+
+  // Rows across every branch, passed in hex so nothing is rounded.
+  std::vector<double> pos;
+  const double size = 16000;
+  for (double p = 0; p < size; p += 333) {
+    pos.push_back(p);
+  }
+  std::string run = exe_path;
+  char buf[64];
+  for (double p : pos) {
+    snprintf(buf, sizeof(buf), " %a %a", p, size);
+    run += buf;
+  }
+
+  FILE *pipe = popen(run.c_str(), "r");
+  if (!pipe) {
+    fprintf(stderr, "failed: %s\n", exe_path.c_str());
+    return -1;
+  }
+  size_t row = 0;
+  for (; fgets(buf, sizeof(buf), pipe); ++row) {
+    if (row >= pos.size()) {
+      break;
+    }
+    double got = strtod(buf, nullptr);
+    double expect = ctx.call("main", {pos[row], size});
+    if (got != expect) {
+      fprintf(stderr, "pos %f: %a != %a\n", pos[row], got, expect);
+      pclose(pipe);
+      return -1;
+    }
+  }
+  if (pclose(pipe) != 0 || row != pos.size()) {
+    fprintf(stderr, "%s printed %zu of %zu rows\n", exe_path.c_str(), row,
+            pos.size());
+    return -1;
+  }
+}
@@ -0,0 +1,58 @@
+// Copyright (c) 2020 smarsufan. All Rights Reserved.
+
+#include <atomic>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "api.h"
+
+int main(int argv, char *args[]) {
+  if (argv != 2) {
+    fprintf(stderr, "Usage: %s <input.sm>", args[0]);
+  }
+
+  const char *path = args[1];
+  auto reader = smcc::OpenReader(path);
+  if (!reader) {
+    fprintf(stderr, "can not open %s\n", path);
+    return -1;
+  }
+
+  const smcc::Program program(reader.get());
+
+  const int kRows = 2000;
+  std::vector<double> expect(kRows);
+  {
+    smcc::Context ctx(&program);
+    for (int row = 0; row < kRows; ++row) {
+      expect[row] = ctx.eval("main", {row * 8., 16000.});
+    }
+  }
+
+  // Threads share the program, each running it in a Context of its own.
+  std::atomic<int> errors(0);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([&program, &expect, &errors, t] {
+      smcc::Context ctx(&program);
+      for (int round = 0; round < 20; ++round) {
+        for (int row = t; row < kRows; row += 3) {
+          double e = ctx.eval("main", {row * 8., 16000.});
+          double v = ctx.call("main", {row * 8., 16000.});
+          if (e != expect[row] || v != expect[row]) {
+            ++errors;
+          }
+        }
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  if (errors) {
+    fprintf(stderr, "%d rows differ across threads\n", errors.load());
+    return -1;
+  }
+}
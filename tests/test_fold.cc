@@ -0,0 +1,97 @@
+// Copyright (c) 2020 smarsufan. All Rights Reserved.
+
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <limits>
+
+#include "api.h"
+
+namespace {
+
+// The single statement of name's body.
+smcc::Expr *Only(const smcc::Program &program, const char *name) {
+  auto body = program.function(name)->body_;
+  return body.size() == 1 ? body[0] : nullptr;
+}
+
+smcc::Expr *Returned(const smcc::Program &program, const char *name) {
+  auto ret = smcc::expr_cast<smcc::ReturnExpe>(Only(program, name));
+  return ret ? ret->expr_ : nullptr;
+}
+
+bool SameBits(double a, double b) {
+  return memcmp(&a, &b, sizeof(a)) == 0;
+}
+
+}  // namespace
+
+int main(int argv, char *args[]) {
+  if (argv != 2) {
+    fprintf(stderr, "Usage: %s <input.sm>", args[0]);
+  }
+
+  const char *path = args[1];
+  auto reader = smcc::OpenReader(path);
+  if (!reader) {
+    fprintf(stderr, "can not open %s\n", path);
+    return -1;
+  }
+
+  smcc::Program program(reader.get());
+  smcc::Context ctx(&program);
+  smcc::Jit jit(program);
+
+  // What the tree should look like once folded.
+  auto constant =
+      smcc::expr_cast<smcc::NumberExpr>(Returned(program, "constant"));
+  auto nested =
+      smcc::expr_cast<smcc::NumberExpr>(Returned(program, "nested3"));
+  auto quarter =
+      smcc::expr_cast<smcc::BinaryExpr>(Returned(program, "quarter"));
+  auto branch = smcc::expr_cast<smcc::IfExpr>(Only(program, "branch"));
+  auto main = program.function("main")->body_;
+  auto forever = smcc::expr_cast<smcc::ReturnExpe>(
+      smcc::expr_cast<smcc::IfExpr>(main[0])->body_[0]);
+  if (!constant || constant->num_val() != std::sqrt(3001.) + 6 - 0.25 ||
+      !nested || nested->num_val() != 49 ||
+      !smcc::expr_cast<smcc::VarExpr>(Returned(program, "same")) ||
+      !smcc::expr_cast<smcc::BinaryExpr>(Returned(program, "plus0")) ||
+      !quarter || quarter->tok_ != tok_mul ||
+      !branch || !branch->other_.empty() ||
+      !smcc::expr_cast<smcc::CallExpr>(forever->expr_)) {
+    fprintf(stderr, "not folded as expected\n");
+    return -1;
+  }
+
+  // Folding must not change a bit of any result.
+  const double kInf = std::numeric_limits<double>::infinity();
+  const double kNaN = std::numeric_limits<double>::quiet_NaN();
+  for (double x : {0., -0., 3.5, -7., 1e-310, kInf, -kInf, kNaN}) {
+    struct {
+      const char *name;
+      double expect;
+    } cases[] = {
+      {"same", x},
+      {"plus0", x + 0},
+      {"quarter", x / 4},
+      {"branch", x},
+      {"tiny", x / std::ldexp(1., -1074)},
+    };
+    for (auto &c : cases) {
+      double e = ctx.eval(c.name, {x});
+      double v = ctx.call(c.name, {x});
+      double j = jit.call(c.name, {x});
+      if (!SameBits(e, c.expect) || !SameBits(v, c.expect) ||
+          !SameBits(j, c.expect)) {
+        fprintf(stderr, "%s(%g): eval %g, call %g, jit %g, expected %g\n",
+                c.name, x, e, v, j, c.expect);
+        return -1;
+      }
+    }
+  }
+  if (ctx.call("main", {1., 16000.}) != std::sqrt(3001.) + 6 - 0.25 + 4002) {
+    fprintf(stderr, "main(1, 16000) = %f\n", ctx.call("main", {1., 16000.}));
+    return -1;
+  }
+}
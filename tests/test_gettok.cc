@@ -10,14 +10,13 @@ int main(int argv, char *args[]) {
   }
 
   const char *path = args[1];
-  FILE *fb = fopen(path, "r");
-  if (!fb) {
+  auto reader = smcc::OpenReader(path);
+  if (!reader) {
     fprintf(stderr, "can not open %s\n", path);
     return -1;
   }
 
-  smcc::ReaderStdio reader(fb);
-  smcc::AST ast(&reader);
+  smcc::AST ast(reader.get());
 
   int tok = 0;
   while ((tok = ast.gettok()) != tok_eof) {
@@ -28,6 +27,4 @@ int main(int argv, char *args[]) {
       fprintf(stderr, "%c\n", tok);
     }
   }
-
-  fclose(fb);
 }
@@ -0,0 +1,115 @@
+// Copyright (c) 2020 smarsufan. All Rights Reserved.
+
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#include "api.h"
+
+namespace {
+
+// The bytecode of program, as text.
+std::string Dump(const smcc::Program &program) {
+  FILE *fp = tmpfile();
+  program.module().dump(fp);
+  std::string text(ftell(fp), '\0');
+  rewind(fp);
+  size_t n = fread(&text[0], 1, text.size(), fp);
+  fclose(fp);
+  return text.substr(0, n);
+}
+
+}  // namespace
+
+int main(int argv, char *args[]) {
+  if (argv != 2) {
+    fprintf(stderr, "Usage: %s <input.sm>", args[0]);
+  }
+
+  const char *path = args[1];
+  auto reader = smcc::OpenReader(path);
+  if (!reader) {
+    fprintf(stderr, "can not open %s\n", path);
+    return -1;
+  }
+  std::string base = path;
+  std::string cache = base.substr(base.find_last_of('/') + 1) + ".img";
+  remove(cache.c_str());
+
+  // Parsed the first time, which writes the cache, loaded the next.
+  smcc::Program parsed(reader.get(), cache);
+  smcc::Program loaded(reader.get(), cache);
+  if (parsed.cached() || !loaded.cached()) {
+    fprintf(stderr, "parsed %d, loaded %d\n", parsed.cached(),
+            loaded.cached());
+    return -1;
+  }
+  if (Dump(parsed) != Dump(loaded) ||
+      parsed.toplevel().size() != loaded.toplevel().size()) {
+    fprintf(stderr, "loaded program differs\n");
+    return -1;
+  }
+
+  // Every backend runs the loaded program as it ran the parsed one.
+  smcc::Context expect(&parsed);
+  smcc::Context ctx(&loaded);
+  smcc::Jit jit(loaded);
+  for (double pos = 0; pos < 16000; pos += 333) {
+    double e = expect.call("main", {pos, 16000.});
+    if (ctx.call("main", {pos, 16000.}) != e ||
+        ctx.eval("main", {pos, 16000.}) != e ||
+        jit.call("main", {pos, 16000.}) != e) {
+      fprintf(stderr, "loaded program disagrees at %f\n", pos);
+      return -1;
+    }
+  }
+
+  // Other source, or a broken file, is parsed again.
+  std::string edited(reader->data(), reader->size());
+  edited += "\ndouble edited() {\n  return 1;\n}\n";
+  smcc::ReaderMem mem(edited.data(), edited.size());
+  smcc::Program stale(&mem, cache);
+  smcc::Program fresh(&mem, cache);
+  if (stale.cached() || !fresh.cached() || !fresh.function("edited")) {
+    fprintf(stderr, "stale cache loaded\n");
+    return -1;
+  }
+  FILE *fp = fopen(cache.c_str(), "r+b");
+  fseek(fp, 0, SEEK_END);
+  long size = ftell(fp);
+  fclose(fp);
+  if (truncate(cache.c_str(), size / 2) != 0 ||
+      smcc::Program(&mem, cache).cached()) {
+    fprintf(stderr, "truncated cache loaded\n");
+    return -1;
+  }
+
+  // With any word overwritten, the file is parsed again, or loads if the
+  // word was a value rather than an index; it never takes the process
+  // down.
+  fp = fopen(cache.c_str(), "rb");
+  std::string image(size, '\0');
+  image.resize(fread(&image[0], 1, image.size(), fp));
+  fclose(fp);
+  int rejected = 0;
+  for (size_t pos = 0; pos + 4 <= image.size(); pos += 4) {
+    uint32_t word;
+    memcpy(&word, &image[pos], sizeof(word));
+    for (uint32_t value : {word + 1, 0x7fffffffu}) {
+      std::string broken = image;
+      memcpy(&broken[pos], &value, sizeof(value));
+      fp = fopen(cache.c_str(), "wb");
+      fwrite(broken.data(), 1, broken.size(), fp);
+      fclose(fp);
+      rejected += !smcc::Program(&mem, cache).cached();
+    }
+  }
+  if (!rejected) {
+    fprintf(stderr, "no broken cache rejected\n");
+    return -1;
+  }
+  remove(cache.c_str());
+}
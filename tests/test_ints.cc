@@ -0,0 +1,131 @@
+// Copyright (c) 2020 smarsufan. All Rights Reserved.
+
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <vector>
+
+#include "api.h"
+
+namespace {
+
+double Add(double size, int64_t times) {
+  double pos = 0;
+  for (; times >= 1; --times) {
+    pos += size;
+  }
+  return pos;
+}
+
+int64_t Collatz(int64_t n) {
+  int64_t steps = 0;
+  for (; n >= 2; ++steps) {
+    n = n % 2 == 0 ? n / 2 : 3 * n + 1;
+  }
+  return steps;
+}
+
+// main of ints.c, in C++.
+double Main(double pos, double size) {
+  int64_t i = static_cast<int64_t>(pos);
+  return Add(size / 7, i / 1000) + Collatz(i + 1) + i / 3 +
+         (i < size / 2) * 5;
+}
+
+}  // namespace
+
+int main(int argv, char *args[]) {
+  if (argv != 2) {
+    fprintf(stderr, "Usage: %s <input.sm>", args[0]);
+  }
+
+  const char *path = args[1];
+  auto reader = smcc::OpenReader(path);
+  if (!reader) {
+    fprintf(stderr, "can not open %s\n", path);
+    return -1;
+  }
+
+  smcc::Program program(reader.get());
+  smcc::Context ctx(&program);
+  smcc::Jit jit(program);
+  smcc::Jit slots(program, false);
+
+  // Types as declared; a function with an int anywhere converts at the
+  // boundary.
+  auto collatz = program.function("collatz");
+  auto add = program.function("add");
+  if (collatz->type_ != smcc::Type::kInt || !collatz->ints_ ||
+      add->type_ != smcc::Type::kDouble || !add->ints_ ||
+      add->proto_->args_[2]->type_ != smcc::Type::kInt ||
+      program.function("quarter")->ints_) {
+    fprintf(stderr, "not typed as declared\n");
+    return -1;
+  }
+
+  // A literal without '.' is still a double next to doubles, and exact as
+  // an int; ints wrap, divide by 0 to 0, and truncate doubles toward zero.
+  struct {
+    const char *name;
+    std::vector<double> args;
+    double expect;
+  } cases[] = {
+    {"quarter", {}, 0.25},
+    {"wrap", {4, 0}, 0},
+    {"wrap", {1, 2}, static_cast<double>(smcc::IntAdd(INT64_C(1) << 62, 3))},
+    {"wrap", {-7, -1},
+     static_cast<double>(smcc::IntAdd(smcc::IntMul(-7, INT64_C(1) << 62), -7))},
+    {"trunc", {-2.7}, -2},
+    {"trunc", {std::numeric_limits<double>::quiet_NaN()},
+     static_cast<double>(INT64_MIN)},
+    {"trunc", {1e300}, static_cast<double>(INT64_MIN)},
+    {"collatz", {27, 0}, 111},
+    {"exact", {}, 1},
+    {"largest", {}, static_cast<double>(INT64_MAX)},
+  };
+  for (auto &c : cases) {
+    double e = ctx.eval(c.name, c.args);
+    double v = ctx.call(c.name, c.args);
+    double j = jit.call(c.name, c.args);
+    double s = slots.call(c.name, c.args);
+    if (e != c.expect || v != c.expect || j != c.expect || s != c.expect) {
+      fprintf(stderr, "%s: eval %g, call %g, jit %g, slots %g, expected %g\n",
+              c.name, e, v, j, s, c.expect);
+      return -1;
+    }
+  }
+
+  // Every backend agrees with C++ across the branches of main.
+  const double size = 16000;
+  std::vector<double> pos, sizes, expect;
+  for (double p = 0; p < size; p += 333) {
+    pos.push_back(p);
+    sizes.push_back(size);
+    expect.push_back(Main(p, size));
+  }
+  auto main = jit.function<double (*)(double, double)>("main");
+  for (size_t row = 0; row < pos.size(); ++row) {
+    double e = ctx.eval("main", {pos[row], size});
+    double v = ctx.call("main", {pos[row], size});
+    double j = main(pos[row], size);
+    double s = slots.call("main", {pos[row], size});
+    if (e != expect[row] || v != expect[row] || j != expect[row] ||
+        s != expect[row]) {
+      fprintf(stderr, "pos %f: eval %f, call %f, jit %f, slots %f, "
+              "expected %f\n", pos[row], e, v, j, s, expect[row]);
+      return -1;
+    }
+  }
+
+  const double *columns[] = {pos.data(), sizes.data()};
+  smcc::Batch batch(&program, 1);
+  for (auto engine : {smcc::Engine::kWalk, smcc::Engine::kBytecode,
+                      smcc::Engine::kSimd}) {
+    std::vector<double> out(pos.size());
+    batch.run("main", columns, pos.size(), out.data(), engine);
+    if (out != expect) {
+      fprintf(stderr, "batch engine %d disagrees\n", static_cast<int>(engine));
+      return -1;
+    }
+  }
+}
@@ -0,0 +1,37 @@
+// Copyright (c) 2020 smarsufan. All Rights Reserved.
+
+#include <iostream>
+
+#include "api.h"
+
+int main(int argv, char *args[]) {
+  if (argv != 2) {
+    fprintf(stderr, "Usage: %s <input.sm>", args[0]);
+  }
+
+  const char *path = args[1];
+  auto reader = smcc::OpenReader(path);
+  if (!reader) {
+    fprintf(stderr, "can not open %s\n", path);
+    return -1;
+  }
+
+  smcc::Program program(reader.get());
+  smcc::Context ctx(&program);
+  smcc::Jit jit(program);
+  smcc::Jit slots(program, false);
+
+  // Machine code must agree with the interpreter on every branch of main,
+  // called through the entry point and through Jit::call, with values in
+  // registers or not.
+  auto main = jit.function<double (*)(double, double)>("main");
+  for (double pos = 0; pos < 16000; pos += 250) {
+    auto expect = ctx.call("main", {pos, 16000.});
+    auto v = main(pos, 16000.);
+    if (v != expect || jit.call("main", {pos, 16000.}) != expect ||
+        slots.call("main", {pos, 16000.}) != expect) {
+      fprintf(stderr, "jit %f != call %f at %f\n", v, expect, pos);
+      return -1;
+    }
+  }
+}
@@ -0,0 +1,75 @@
+// Copyright (c) 2020 smarsufan. All Rights Reserved.
+
+#include <cmath>
+#include <iostream>
+
+#include "api.h"
+
+static double tick(double x) {
+  return x;
+}
+
+int main(int argv, char *args[]) {
+  if (argv != 2) {
+    fprintf(stderr, "Usage: %s <input.sm>", args[0]);
+  }
+
+  smcc::natives().Register("tick", tick);
+
+  const char *path = args[1];
+  auto reader = smcc::OpenReader(path);
+  if (!reader) {
+    fprintf(stderr, "can not open %s\n", path);
+    return -1;
+  }
+
+  smcc::Program program(reader.get());
+  if (!program.function("fib")->pure_ || program.function("noisy")->pure_) {
+    fprintf(stderr, "purity: fib must be pure, noisy must not\n");
+    return -1;
+  }
+
+  // fib(n) calls itself with each of n + 1 values, so with a cache the
+  // first run misses about n + 1 times and a second run hits at once. A
+  // table of two entries keeps evicting, and must still be right.
+  for (size_t entries : {1024, 2}) {
+    smcc::Context ctx(&program);
+    ctx.memoize("fib", entries);
+    smcc::MemoStats first;
+    for (int round = 0; round < 2; ++round) {
+      double e = ctx.eval("fib", {25.});
+      double v = ctx.call("fib", {25.});
+      if (e != 75025 || v != 75025) {
+        fprintf(stderr, "fib(25): eval %f, call %f\n", e, v);
+        return -1;
+      }
+      if (round == 0) {
+        first = ctx.memo_stats("fib");
+      }
+    }
+    auto stats = ctx.memo_stats("fib");
+    fprintf(stderr, "%zu entries: %llu hits, %llu misses\n", entries,
+            static_cast<unsigned long long>(stats.hits),
+            static_cast<unsigned long long>(stats.misses));
+    if (entries == 1024 &&
+        (first.misses > 30 || stats.misses != first.misses ||
+         stats.hits != first.hits + 2)) {
+      return -1;
+    }
+  }
+
+  // Keys are bit patterns: 0 and -0 are different calls.
+  smcc::Context ctx(&program);
+  ctx.memoize("inverse");
+  if (ctx.call("inverse", {0.}) != INFINITY ||
+      ctx.call("inverse", {-0.}) != -INFINITY ||
+      ctx.eval("inverse", {0.}) != INFINITY) {
+    fprintf(stderr, "inverse: -0 hit the entry of 0\n");
+    return -1;
+  }
+  auto stats = ctx.memo_stats("inverse");
+  if (stats.hits != 1 || stats.misses != 2 ||
+      ctx.memo_stats("score").misses != 0) {
+    return -1;
+  }
+}
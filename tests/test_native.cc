@@ -0,0 +1,53 @@
+// Copyright (c) 2020 smarsufan. All Rights Reserved.
+
+#include <cmath>
+#include <iostream>
+
+#include "api.h"
+
+static double clamp(double x, double lo, double hi) {
+  return x < lo ? lo : x > hi ? hi : x;
+}
+
+static const double kTable[] = {1, 2, 4, 8, 16, 32, 64, 128};
+
+static double lookup(double idx) {
+  return kTable[static_cast<int>(clamp(idx, 0, 7))];
+}
+
+int main(int argv, char *args[]) {
+  if (argv != 2) {
+    fprintf(stderr, "Usage: %s <input.sm>", args[0]);
+  }
+
+  smcc::natives().Register("clamp", clamp);
+  smcc::natives().Register("lookup", lookup);
+
+  const char *path = args[1];
+  auto reader = smcc::OpenReader(path);
+  if (!reader) {
+    fprintf(stderr, "can not open %s\n", path);
+    return -1;
+  }
+
+  smcc::Program program(reader.get());
+  smcc::Context ctx(&program);
+  smcc::Jit jit(program);
+
+  // Every backend must call the host functions the script declared.
+  for (double pos : {0., 3000., 8000., 15000.}) {
+    double x = pos / 16000. * 8;
+    double expect = clamp(x * 2, 0, 10) + lookup(x) + std::sqrt(x);
+
+    auto e = ctx.eval("main", {pos, 16000.});
+    auto v = ctx.call("main", {pos, 16000.});
+    auto j = jit.call("main", {pos, 16000.});
+
+    fprintf(stderr, "%f\n", v);
+    if (e != expect || v != expect || j != expect) {
+      fprintf(stderr, "eval %f, call %f, jit %f, expected %f\n", e, v, j,
+              expect);
+      return -1;
+    }
+  }
+}
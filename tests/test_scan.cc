@@ -0,0 +1,93 @@
+// Copyright (c) 2020 smarsufan. All Rights Reserved.
+
+#include <iostream>
+#include <string>
+
+#include "api.h"
+#include "lexer.h"
+#include "scan.h"
+
+namespace {
+
+// Runs of every length from 0 to past two AVX2 blocks, so each kernel
+// stops at every position of a block and across block ends. Identifiers
+// take in every letter and digit.
+std::string Runs() {
+  const std::string alnum =
+      "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+  std::string src;
+  for (int n = 0; n < 70; ++n) {
+    src += std::string(n, ' ') + "x" + (alnum + alnum).substr(n % 62, n);
+    src += std::string(n % 7, '\t') + "\n// " + std::string(n, 'c') + "\r";
+    src += std::string(n, '7') + "." + std::string(n % 5, '1');
+    src += std::string(n % 3, '\n');
+  }
+  return src;
+}
+
+int Count(const std::string &src) {
+  smcc::Lexer lexer(src.data(), src.data() + src.size());
+  int n = 0;
+  while (lexer.gettok() != tok_eof) {
+    ++n;
+  }
+  return n;
+}
+
+const char *kEarly = "double f(double x) {\n  return x1 + 2.5; // x\n}\n";
+
+// Lexed before main(), maybe before scan.cc picked its kernels.
+const int early = Count(kEarly);
+
+bool Same(const smcc::TokenStream &a, const smcc::TokenStream &b) {
+  return a.kinds == b.kinds && a.offsets == b.offsets &&
+         a.lengths == b.lengths && a.numbers == b.numbers;
+}
+
+}  // namespace
+
+int main(int argv, char *args[]) {
+  if (argv != 2) {
+    fprintf(stderr, "Usage: %s <input.sm>", args[0]);
+  }
+
+  const char *path = args[1];
+  auto reader = smcc::OpenReader(path);
+  if (!reader || !reader->data()) {
+    fprintf(stderr, "can not map %s\n", path);
+    return -1;
+  }
+
+  if (early != Count(kEarly)) {
+    fprintf(stderr, "%d tokens before main\n", early);
+    return -1;
+  }
+
+  // Every kernel set this CPU runs must lex as the scalar one does.
+  std::string src(reader->data(), reader->size());
+  src += Runs();
+  const char *begin = src.data();
+  const char *end = begin + src.size();
+  smcc::set_scan_isa(smcc::ScanIsa::kScalar);
+  auto expect = smcc::Tokenize(begin, end, 1);
+
+  struct {
+    const char *name;
+    smcc::ScanIsa isa;
+  } isas[] = {
+    {"sse2", smcc::ScanIsa::kSSE2},
+    {"avx2", smcc::ScanIsa::kAVX2},
+  };
+  for (auto &isa : isas) {
+    if (!smcc::set_scan_isa(isa.isa)) {
+      fprintf(stderr, "%s: not supported\n", isa.name);
+      continue;
+    }
+    if (!Same(smcc::Tokenize(begin, end, 1), expect)) {
+      fprintf(stderr, "%s tokens differ\n", isa.name);
+      return -1;
+    }
+  }
+
+  fprintf(stderr, "%zu tokens\n", expect.size());
+}
@@ -0,0 +1,129 @@
+// Copyright (c) 2020 smarsufan. All Rights Reserved.
+
+#include <cstdio>
+#include <iostream>
+#include <string>
+
+#include "api.h"
+
+namespace {
+
+// A chain of callers, the last folded, appended to the example.
+const char *kChain =
+    "\ndouble leaf(double x) {\n  return x + %d;\n}\n"
+    "\ndouble mid(double x) {\n  return leaf(x) * 2;\n}\n"
+    "\ndouble top(double x) {\n  return mid(x) + 1;\n}\n"
+    "\ndouble folded() {\n  return top(1);\n}\n"
+    "%s";
+
+const char *kOther = "\n// Calls nothing.\ndouble other(double x) {\n"
+                     "  return x;\n}\n";
+
+std::string Source(const std::string &base, int leaf, bool other) {
+  char buf[512];
+  snprintf(buf, sizeof(buf), kChain, leaf, other ? kOther : "");
+  return base + buf;
+}
+
+bool Expect(const char *what, size_t parsed, size_t expect) {
+  if (parsed != expect) {
+    fprintf(stderr, "%s: parsed %zu, expected %zu\n", what, parsed, expect);
+    return false;
+  }
+  return true;
+}
+
+// Whether every backend runs program as a fresh parse of source.
+bool Agrees(const smcc::Program &program, const std::string &source) {
+  smcc::ReaderMem reader(source.data(), source.size());
+  smcc::Program parsed(&reader);
+  smcc::Context expect(&parsed);
+  smcc::Context ctx(&program);
+  smcc::Jit jit(program);
+  for (double pos = 0; pos < 16000; pos += 333) {
+    double e = expect.call("main", {pos, 16000.});
+    if (ctx.call("main", {pos, 16000.}) != e ||
+        ctx.eval("main", {pos, 16000.}) != e ||
+        jit.call("main", {pos, 16000.}) != e) {
+      fprintf(stderr, "main disagrees at %f\n", pos);
+      return false;
+    }
+  }
+  double e = expect.call("folded", {});
+  if (ctx.call("folded", {}) != e || jit.call("folded", {}) != e) {
+    fprintf(stderr, "folded disagrees\n");
+    return false;
+  }
+  return true;
+}
+
+}  // namespace
+
+int main(int argv, char *args[]) {
+  if (argv != 2) {
+    fprintf(stderr, "Usage: %s <input.sm>", args[0]);
+  }
+
+  const char *path = args[1];
+  auto reader = smcc::OpenReader(path);
+  if (!reader) {
+    fprintf(stderr, "can not open %s\n", path);
+    return -1;
+  }
+  std::string base(reader->data(), reader->size());
+  smcc::Session session;
+
+  std::string source = Source(base, 1, true);
+  session.update(source);
+  if (!Expect("first", session.parsed(),
+              session.program().toplevel().size()) ||
+      !Agrees(session.program(), source)) {
+    return -1;
+  }
+
+  // Nothing changed, nothing parsed.
+  session.update(source);
+  if (!Expect("same", session.parsed(), 0)) {
+    return -1;
+  }
+
+  // The leaf and everything up to the folded call above it.
+  source = Source(base, 2, true);
+  session.update(source);
+  if (!Expect("leaf", session.parsed(), 4) ||
+      !Agrees(session.program(), source)) {
+    return -1;
+  }
+  smcc::Context ctx(&session.program());
+  if (ctx.call("folded", {}) != 7) {
+    fprintf(stderr, "folded %f\n", ctx.call("folded", {}));
+    return -1;
+  }
+
+  // A definition nothing calls goes, and comes back.
+  source = Source(base, 2, false);
+  session.update(source);
+  if (!Expect("remove", session.parsed(), 0) ||
+      session.program().function("other") ||
+      !Agrees(session.program(), source)) {
+    return -1;
+  }
+  source = Source(base, 2, true);
+  session.update(source);
+  if (!Expect("add", session.parsed(), 1) ||
+      !session.program().function("other") ||
+      !Agrees(session.program(), source)) {
+    return -1;
+  }
+
+  // Moving a definition parses nothing.
+  source = base + kOther + Source("", 2, false);
+  session.update(source);
+  if (!Expect("move", session.parsed(), 0) ||
+      !Agrees(session.program(), source)) {
+    return -1;
+  }
+
+  std::cout << "ok" << std::endl;
+  return 0;
+}
@@ -0,0 +1,66 @@
+// Copyright (c) 2020 smarsufan. All Rights Reserved.
+
+#include <iostream>
+
+#include "api.h"
+
+namespace {
+
+size_t Count(const smcc::SsaFunction &ssa, smcc::SsaOp op) {
+  size_t n = 0;
+  for (auto &b : ssa.blocks) {
+    for (uint32_t v : b.code) {
+      n += ssa.values[v].op == op;
+    }
+  }
+  return n;
+}
+
+}  // namespace
+
+int main(int argv, char *args[]) {
+  if (argv != 2) {
+    fprintf(stderr, "Usage: %s <input.sm>", args[0]);
+  }
+
+  const char *path = args[1];
+  auto reader = smcc::OpenReader(path);
+  if (!reader) {
+    fprintf(stderr, "can not open %s\n", path);
+    return -1;
+  }
+
+  smcc::Program program(reader.get());
+  smcc::Context ctx(&program);
+  smcc::Jit jit(program);
+
+  smcc::SsaFunction ssa = smcc::BuildSsa(program.function("main"));
+  if (Count(ssa, smcc::kSsaDiv) != 3 || Count(ssa, smcc::kSsaCall) != 2 ||
+      Count(ssa, smcc::kSsaCopy) != 6) {
+    ssa.dump(stderr);
+    fprintf(stderr, "unexpected SSA before optimizing\n");
+    return -1;
+  }
+  // pos / size once, twice(a) and sqrt(a) once, no copies, and nothing
+  // left of the assignment after the return.
+  smcc::OptimizeSsa(&ssa);
+  ssa.dump(stdout);
+  if (Count(ssa, smcc::kSsaDiv) != 1 || Count(ssa, smcc::kSsaCall) != 1 ||
+      Count(ssa, smcc::kSsaSqrt) != 1 || Count(ssa, smcc::kSsaCopy) != 0 ||
+      Count(ssa, smcc::kSsaPhi) != 1 || Count(ssa, smcc::kSsaMul) != 3) {
+    fprintf(stderr, "not optimized as expected\n");
+    return -1;
+  }
+
+  // Every backend compiled from SSA agrees with the tree walker.
+  for (double pos = 0; pos <= 1000; pos += 12.5) {
+    double e = ctx.eval("main", {pos, 1000.});
+    double v = ctx.call("main", {pos, 1000.});
+    double j = jit.call("main", {pos, 1000.});
+    if (e != v || e != j) {
+      fprintf(stderr, "main(%g): eval %f, call %f, jit %f\n", pos, e, v, j);
+      return -1;
+    }
+  }
+  return 0;
+}
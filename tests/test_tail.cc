@@ -0,0 +1,55 @@
+// Copyright (c) 2020 smarsufan. All Rights Reserved.
+
+#include <iostream>
+#include <vector>
+
+#include "api.h"
+
+int main(int argv, char *args[]) {
+  if (argv != 2) {
+    fprintf(stderr, "Usage: %s <input.sm>", args[0]);
+  }
+
+  const char *path = args[1];
+  auto reader = smcc::OpenReader(path);
+  if (!reader) {
+    fprintf(stderr, "can not open %s\n", path);
+    return -1;
+  }
+
+  smcc::Program program(reader.get());
+  smcc::Context ctx(&program);
+  smcc::Jit jit(program);
+
+  // main(n, size) = n * size + (n is even) takes n tail calls of add, and
+  // n more alternating between even and odd: far deeper than any backend
+  // could go if each call kept its frame.
+  for (double n : {1e6, 1e6 + 1}) {
+    double expect = n * 3 + (static_cast<long>(n) % 2 == 0);
+    double e = ctx.eval("main", {n, 3.});
+    double v = ctx.call("main", {n, 3.});
+    double j = jit.call("main", {n, 3.});
+    if (e != expect || v != expect || j != expect) {
+      fprintf(stderr, "eval %f, call %f, jit %f, expected %f\n", e, v, j,
+              expect);
+      return -1;
+    }
+  }
+
+  // Lanes that stop at different depths.
+  const size_t kRows = 100;
+  std::vector<double> n(kRows), size(kRows, 3.), out(kRows);
+  for (size_t row = 0; row < kRows; ++row) {
+    n[row] = row * 997;
+  }
+  const double *columns[] = {n.data(), size.data()};
+  smcc::Batch batch(&program, 1);
+  batch.run("main", columns, kRows, out.data(), smcc::Engine::kSimd);
+  for (size_t row = 0; row < kRows; ++row) {
+    double expect = n[row] * 3 + (row * 997 % 2 == 0);
+    if (out[row] != expect) {
+      fprintf(stderr, "row %zu: %f != %f\n", row, out[row], expect);
+      return -1;
+    }
+  }
+}
@@ -0,0 +1,32 @@
+// Copyright (c) 2020 smarsufan. All Rights Reserved.
+
+#include <iostream>
+
+#include "api.h"
+
+int main(int argv, char *args[]) {
+  if (argv != 2) {
+    fprintf(stderr, "Usage: %s <input.sm>", args[0]);
+  }
+
+  const char *path = args[1];
+  auto reader = smcc::OpenReader(path);
+  if (!reader || !reader->data()) {
+    fprintf(stderr, "can not map %s\n", path);
+    return -1;
+  }
+
+  // Chunked lexing must agree with one pass of the lexer.
+  const char *begin = reader->data();
+  const char *end = begin + reader->size();
+  auto serial = smcc::Tokenize(begin, end, 1);
+  auto chunked = smcc::Tokenize(begin, end, 4, 16);
+
+  if (serial.kinds != chunked.kinds || serial.offsets != chunked.offsets ||
+      serial.lengths != chunked.lengths || serial.numbers != chunked.numbers) {
+    fprintf(stderr, "chunked tokens differ\n");
+    return -1;
+  }
+
+  fprintf(stderr, "%zu tokens\n", serial.size());
+}